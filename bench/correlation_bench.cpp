@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "smpp/correlationstore.h"
+
+DEFINE_int32(entries, 2000000, "Number of message ids in the store");
+DEFINE_int32(lookups, 1000000, "Number of random lookups per run");
+DEFINE_string(path, "/tmp/correlation_bench.dat", "File for the memory mapped store");
+
+using std::string;
+
+namespace {
+size_t messageId(const uint32_t i, char* buffer) {
+    return snprintf(buffer, 32, "%08x-4f2e-9a1b-%08x", i, i * 2654435761u);
+}
+
+double seconds(const std::chrono::steady_clock::time_point &start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Looks up random message ids and returns the number of lookups per second.
+ */
+double lookupRate(const smpp::CorrelationStore &store, uint64_t* checksum) {
+    uint32_t x = 2463534242u;
+    char id[32];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < FLAGS_lookups; ++i) {
+        // xorshift32
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        uint64_t value = 0;
+        size_t length = messageId(x % FLAGS_entries, id);
+
+        if (store.find(id, length, &value)) {
+            *checksum += value;
+        }
+    }
+
+    return FLAGS_lookups / seconds(start);
+}
+
+/*
+ * Asks the kernel to drop the cached pages of a file, so the next lookups have to read from disk.
+ */
+void dropPageCache(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+
+    uint64_t checksum = 0;
+    char id[32];
+    std::remove(FLAGS_path.c_str());
+
+    {
+        smpp::CorrelationStore store(FLAGS_path, FLAGS_entries);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < FLAGS_entries; ++i) {
+            size_t length = messageId(i, id);
+            store.insert(id, length, i, time(0));
+        }
+
+        std::cout << "CorrelationStore, " << FLAGS_entries << " entries, " << FLAGS_lookups << " lookups" << std::endl;
+        std::cout << "  mapped insert:        " << FLAGS_entries / seconds(start) << " /s" << std::endl;
+    }
+
+    dropPageCache(FLAGS_path);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    smpp::CorrelationStore mapped(FLAGS_path, FLAGS_entries);
+    std::cout << "  mapped reopen:        " << seconds(start) * 1000 << " ms" << std::endl;
+    std::cout << "  mapped lookup, cold:  " << lookupRate(mapped, &checksum) << " /s" << std::endl;
+    std::cout << "  mapped lookup, warm:  " << lookupRate(mapped, &checksum) << " /s" << std::endl;
+
+    smpp::CorrelationStore heap(FLAGS_entries);
+
+    for (int i = 0; i < FLAGS_entries; ++i) {
+        size_t length = messageId(i, id);
+        heap.insert(id, length, i, time(0));
+    }
+
+    std::cout << "  heap lookup:          " << lookupRate(heap, &checksum) << " /s" << std::endl;
+    std::cout << "  (checksum " << checksum << ")" << std::endl;
+    std::remove(FLAGS_path.c_str());
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <iostream>
+#include <regex>
+#include <string>
+
+#include "smpp/sms.h"
+#include "smpp/timeformat.h"
+
+DEFINE_int32(iterations, 20000, "Number of delivery reports to parse per run");
+
+using std::string;
+
+namespace {
+const char* const RECEIPT = "id:dc0dc8ec67e16082483f9e8cd1b135dd sub:001 dlvrd:001 submit date:1110261646 "
+                            "done date:1110261647 stat:DELIVRD err:000 text:Hello World";
+
+/*
+ * The regex based parser DeliveryReport used to have, kept here as the baseline.
+ */
+void legacyParse(const smpp::SMS &sms, smpp::DeliveryReport* dlr) {
+    std::regex expression(
+        "^id:([^ ]+)\\s+sub:(\\d{1,3})\\s+dlvrd:(\\d{1,3})\\s+submit\\s+date:(\\d{1,10})\\s+done\\s+date:(\\d{1,10})"
+        "\\s+stat:([A-Z]{7})\\s+err:(\\d{1,3})\\s+text:(.*)$");
+    std::smatch what;
+
+    if (std::regex_match(sms.short_message, what, expression)) {
+        dlr->id = what[1];
+        dlr->sub = std::stoi(what[2]);
+        dlr->dlvrd = std::stoi(what[3]);
+        dlr->submitDate = smpp::timeformat::parseDlrTimestamp(what[4]);
+        dlr->doneDate = smpp::timeformat::parseDlrTimestamp(what[5]);
+        dlr->stat = what[6];
+        dlr->err = what[7];
+        dlr->text = what[8];
+    }
+}
+
+template<typename F>
+double nsPerOp(F f, const int iterations) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; ++i) {
+        f();
+    }
+
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(elapsed.count()) / iterations;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+
+    smpp::SMS sms;
+    sms.is_null = false;
+    sms.esm_class = smpp::ESM_DELIVER_SMSC_RECEIPT;
+    sms.short_message = RECEIPT;
+    uint32_t checksum = 0;
+
+    double legacy = nsPerOp([&]() {
+        smpp::DeliveryReport dlr;
+        legacyParse(sms, &dlr);
+        checksum += dlr.sub;
+    }, FLAGS_iterations);
+    double scanner = nsPerOp([&]() {
+        smpp::DeliveryReport dlr(sms);
+        checksum += dlr.sub;
+    }, FLAGS_iterations);
+
+    std::cout << "DeliveryReport parsing, " << FLAGS_iterations << " iterations (checksum " << checksum << ")"
+              << std::endl;
+    std::cout << "  regex:   " << legacy << " ns/op" << std::endl;
+    std::cout << "  scanner: " << scanner << " ns/op" << std::endl;
+    std::cout << "  speed-up: " << legacy / scanner << "x" << std::endl;
+    return 0;
+}
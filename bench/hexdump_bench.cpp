@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "smpp/hexdump.h"
+
+DEFINE_int32(iterations, 20000, "Number of PDUs to dump per run");
+DEFINE_int32(size, 160, "Size of the PDU dumped");
+
+using std::string;
+
+namespace {
+/*
+ * The stream based hexdump used to be, kept here as the baseline.
+ */
+string legacyHexdump(const uint8_t* bytes, const size_t length) {
+    std::stringstream out;
+
+    if (length == 0) {
+        return out.str();
+    }
+
+    size_t pos = 0;
+    char asciibytes[16];
+
+    for (; pos < length; pos++) {
+        if (pos % 16 == 0) {
+            if (pos > 0) {
+                out << " |";
+
+                for (int n = 0; n < 16; n++) {
+                    out << asciibytes[n];
+                }
+
+                out << "|" << "\n";
+            }
+
+            out << std::hex << std::setfill('0') << std::setw(8) << static_cast<uint32_t>(pos) << " ";
+        }
+
+        uint8_t curbyte = bytes[pos];
+
+        if (pos % 8 == 0) {
+            out << " ";
+        }
+
+        out << std::hex << std::setfill('0') << std::setw(2) << static_cast<unsigned int>(curbyte) << " ";
+        asciibytes[pos % 16] = (curbyte >= 0x20 && curbyte <= 0x7F) ? curbyte : '.';
+    }
+
+    int remain = (pos % 16 ? pos % 16 : 16);
+    int offset = pos % 16;
+
+    for (int n = 0; n < 16 - remain; n++) {
+        if ((n + offset) != 0 && (n + offset) % 8 == 0) {
+            out << " ";
+        }
+
+        out << "   ";
+    }
+
+    out << " |";
+
+    for (int n = 0; n < remain; n++) {
+        out << asciibytes[n];
+    }
+
+    out << "|\n";
+    out << std::hex << std::setfill('0') << std::setw(8) << static_cast<uint32_t>(length) << "\n";
+    return out.str();
+}
+
+template<typename F>
+double nsPerOp(F f, const int iterations) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; ++i) {
+        f(i);
+    }
+
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(elapsed.count()) / iterations;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+
+    std::vector<uint8_t> pdu(std::max(FLAGS_size, 1));
+
+    for (size_t i = 0; i < pdu.size(); ++i) {
+        pdu[i] = i * 31;
+    }
+
+    if (legacyHexdump(&pdu[0], pdu.size()) != oc::tools::hexdump(&pdu[0], pdu.size())) {
+        std::cerr << "Hexdumps disagree" << std::endl;
+        return 1;
+    }
+
+    int64_t checksum = 0;
+    std::vector<char> buffer(oc::tools::hexdumpSize(pdu.size()));
+    double legacy = nsPerOp([&](const int i) {
+        checksum += legacyHexdump(&pdu[0], pdu.size())[i & 7];
+    }, FLAGS_iterations);
+    double table = nsPerOp([&](const int i) {
+        checksum += oc::tools::hexdump(&pdu[0], pdu.size())[i & 7];
+    }, FLAGS_iterations);
+    double preallocated = nsPerOp([&](const int i) {
+        oc::tools::hexdump(&pdu[0], pdu.size(), &buffer[0]);
+        checksum += buffer[i & 7];
+    }, FLAGS_iterations);
+
+    std::cout << "Hexdump of " << pdu.size() << " bytes, " << FLAGS_iterations << " iterations (checksum " << checksum
+              << ")" << std::endl;
+    std::cout << "  stream: " << legacy << " ns/op" << std::endl;
+    std::cout << "  table:  " << table << " ns/op" << std::endl;
+    std::cout << "  buffer: " << preallocated << " ns/op" << std::endl;
+    std::cout << "  speed-up: " << legacy / table << "x" << std::endl;
+    return 0;
+}
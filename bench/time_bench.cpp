@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <string>
+
+#include "smpp/timeformat.h"
+
+DEFINE_int32(iterations, 200000, "Number of timestamps to parse per run");
+
+using std::string;
+
+namespace {
+const char* const TIMESTAMPS[] = {"1110261646", "110203133755", "1412312359", "140229000000"};
+
+/*
+ * The stream based parser parseDlrTimestamp used to have, kept here as the baseline.
+ */
+boost::posix_time::ptime legacyParse(const string &time) {
+    std::stringstream ss;
+    boost::posix_time::time_input_facet* fac = new boost::posix_time::time_input_facet("%y%m%d%H%M%S");
+    ss.imbue(std::locale(std::locale::classic(), fac));
+    ss << time;
+    boost::posix_time::ptime timestamp;
+    ss >> timestamp;
+    return timestamp;
+}
+
+/*
+ * The stream based relative timestamp formatting getTimeString used to have, kept here as the baseline.
+ */
+string legacyFormat(const boost::posix_time::time_duration &td) {
+    int totalHours = td.hours();
+    int yy = totalHours / 24 / 365;
+    totalHours -= (yy * 24 * 365);
+    int mon = totalHours / 24 / 30;
+    totalHours -= (mon * 24 * 30);
+    int dd = totalHours / 24;
+    totalHours -= (dd * 24);
+    std::stringstream output;
+    output << std::setfill('0') << std::setw(2) << yy << std::setw(2) << mon << std::setw(2) << dd << std::setw(2)
+           << totalHours << std::setw(2) << td.minutes() << std::setw(2) << td.seconds() << "000R";
+    return output.str();
+}
+
+template<typename F>
+double nsPerOp(F f, const int iterations) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; ++i) {
+        f(i);
+    }
+
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(elapsed.count()) / iterations;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+
+    string timestamps[4];
+    int64_t checksum = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        timestamps[i] = TIMESTAMPS[i];
+
+        if (legacyParse(timestamps[i]) != smpp::timeformat::parseDlrTimestamp(timestamps[i])) {
+            std::cerr << "Parsers disagree on " << timestamps[i] << std::endl;
+            return 1;
+        }
+    }
+
+    double legacy = nsPerOp([&](const int i) {
+        checksum += legacyParse(timestamps[i & 3]).time_of_day().minutes();
+    }, FLAGS_iterations);
+    double ptime = nsPerOp([&](const int i) {
+        checksum += smpp::timeformat::parseDlrTimestamp(timestamps[i & 3]).time_of_day().minutes();
+    }, FLAGS_iterations);
+    double epoch = nsPerOp([&](const int i) {
+        int64_t seconds = 0;
+        smpp::timeformat::parseDlrEpoch(timestamps[i & 3].data(), timestamps[i & 3].length(), &seconds);
+        checksum += seconds;
+    }, FLAGS_iterations);
+
+    std::cout << "DLR timestamp parsing, " << FLAGS_iterations << " iterations (checksum " << checksum << ")"
+              << std::endl;
+    std::cout << "  stream: " << legacy << " ns/op" << std::endl;
+    std::cout << "  ptime:  " << ptime << " ns/op" << std::endl;
+    std::cout << "  epoch:  " << epoch << " ns/op" << std::endl;
+    std::cout << "  speed-up: " << legacy / ptime << "x" << std::endl;
+
+    boost::posix_time::time_duration validity(48, 0, 0);
+    smpp::timeformat::TimeStringCache cache(validity);
+    char buffer[smpp::timeformat::TIME_STRING_SIZE];
+    double relativeStream = nsPerOp([&](const int i) {
+        checksum += legacyFormat(validity + boost::posix_time::seconds(i & 1))[11];
+    }, FLAGS_iterations);
+    double relative = nsPerOp([&](const int i) {
+        checksum += smpp::timeformat::getTimeString(validity + boost::posix_time::seconds(i & 1))[11];
+    }, FLAGS_iterations);
+    double relativeBuffer = nsPerOp([&](const int i) {
+        smpp::timeformat::formatTimeString(validity + boost::posix_time::seconds(i & 1), buffer);
+        checksum += buffer[11];
+    }, FLAGS_iterations);
+    double absoluteCached = nsPerOp([&](const int i) {
+        checksum += cache.getAbsolute(1400000000 + i / 1000)[11];
+    }, FLAGS_iterations);
+
+    std::cout << "Timestamp formatting, " << FLAGS_iterations << " iterations (checksum " << checksum << ")"
+              << std::endl;
+    std::cout << "  relative stream: " << relativeStream << " ns/op" << std::endl;
+    std::cout << "  relative string: " << relative << " ns/op" << std::endl;
+    std::cout << "  relative buffer: " << relativeBuffer << " ns/op" << std::endl;
+    std::cout << "  absolute cached: " << absoluteCached << " ns/op" << std::endl;
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_CLOCK_H_
+#define SMPP_CLOCK_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace smpp {
+/**
+ * Process wide coarse clock for timestamps on per message paths, ie. expiry times and the current time of
+ * relative SMPP timestamps.
+ * It reads CLOCK_REALTIME_COARSE where available, which the kernel updates every tick and which is read without a
+ * system call, so it costs a few nanoseconds and is accurate to a few milliseconds. Times are UTC, so no time zone
+ * computation is involved.
+ */
+class CoarseClock {
+  public:
+    /**
+     * @return Seconds since the epoch.
+     */
+    static time_t now() {
+        return read().tv_sec;
+    }
+
+    /**
+     * @return Milliseconds since the epoch.
+     */
+    static int64_t nowMillis() {
+        timespec ts = read();
+        return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    /**
+     * @return Microseconds since the epoch, with the resolution of the coarse clock.
+     */
+    static int64_t nowMicros() {
+        timespec ts = read();
+        return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    /**
+     * @return Current UTC time.
+     */
+    static boost::posix_time::ptime universalTime() {
+        timespec ts = read();
+        return boost::posix_time::from_time_t(ts.tv_sec) + boost::posix_time::microseconds(ts.tv_nsec / 1000);
+    }
+
+  private:
+    static timespec read() {
+        timespec ts;
+#ifdef CLOCK_REALTIME_COARSE
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+        clock_gettime(CLOCK_REALTIME, &ts);
+#endif  // CLOCK_REALTIME_COARSE
+        return ts;
+    }
+};
+
+/**
+ * Clock for measuring durations, which is not affected by changes to the time of day.
+ */
+class MonotonicClock {
+  public:
+    /**
+     * @return Microseconds since an arbitrary point in time.
+     */
+    static int64_t nowMicros() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    /**
+     * @return Milliseconds since an arbitrary point in time, for deadlines and timeouts.
+     */
+    static int64_t nowMillis() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+};
+}  // namespace smpp
+
+#endif  // SMPP_CLOCK_H_
@@ -0,0 +1,613 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/correlationstore.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::memory_order_release;
+using std::string;
+
+namespace smpp {
+static_assert(sizeof(std::atomic<uint32_t>) == 4, "CorrelationStore needs lock-free 32 bit atomics");
+
+namespace {
+const char MAGIC[8] = { 'S', 'M', 'P', 'P', 'D', 'L', 'R', '1' };
+}  // namespace
+
+CorrelationStore::CorrelationStore(const size_t capacity, const uint32_t _ttl, const uint32_t _bucketSeconds) :
+    slots(0), /**/
+    heapSlots(), /**/
+    readSlots(0), /**/
+    readEpoch(0), /**/
+    slotCount(16), /**/
+    mask(0), /**/
+    maxEntries(capacity), /**/
+    entries(0), /**/
+    ttl(_ttl), /**/
+    bucketSeconds(_bucketSeconds), /**/
+    links(), /**/
+    bucketCount(0), /**/
+    bucketEpochs(), /**/
+    path(), /**/
+    fd(-1), /**/
+    header(0), /**/
+    mappedSize(0), /**/
+    sweepCursor(0), /**/
+    unindexedSlots(0), /**/
+    writeMutex() {
+    readers[0].store(0);
+    readers[1].store(0);
+    initialize(capacity);
+    // value initialization zeroes the slots, which makes them empty
+    heapSlots.reset(new Slot[slotCount]());
+    slots = heapSlots.get();
+    readSlots.store(slots);
+}
+
+CorrelationStore::CorrelationStore(const string &_path, const size_t capacity, const uint32_t _ttl,
+                                   const uint32_t _bucketSeconds) :
+    slots(0), /**/
+    heapSlots(), /**/
+    readSlots(0), /**/
+    readEpoch(0), /**/
+    slotCount(16), /**/
+    mask(0), /**/
+    maxEntries(capacity), /**/
+    entries(0), /**/
+    ttl(_ttl), /**/
+    bucketSeconds(_bucketSeconds), /**/
+    links(), /**/
+    bucketCount(0), /**/
+    bucketEpochs(), /**/
+    path(_path), /**/
+    fd(-1), /**/
+    header(0), /**/
+    mappedSize(0), /**/
+    sweepCursor(0), /**/
+    unindexedSlots(0), /**/
+    writeMutex() {
+    readers[0].store(0);
+    readers[1].store(0);
+    initialize(capacity);
+    bool created = false;
+    header = map(path, &fd, &mappedSize, &created);
+    slots = reinterpret_cast<Slot*>(header + 1);
+    readSlots.store(slots);
+
+    if (created) {
+        return;
+    }
+
+    // the file keeps its own geometry
+    maxEntries = header->maxEntries;
+    ttl = header->ttl;
+    bucketSeconds = header->bucketSeconds;
+    initialize(maxEntries);
+
+    if (header->slotCount != slotCount || mappedSize != sizeof(Header) + slotCount * sizeof(Slot)) {
+        unmap();
+        throw smpp::SmppException("CorrelationStore file " + path + " has an invalid size");
+    }
+
+    size_t count = header->entries;
+
+    if (!header->clean) {
+        // drop the slots a crash left half written, and count the entries again
+        count = 0;
+
+        for (size_t i = 0; i < slotCount; ++i) {
+            Slot &slot = slots[i];
+
+            if (slot.sequence.load(memory_order_relaxed) & 1) {
+                slot.state = SLOT_DELETED;
+                slot.sequence.store(slot.sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            }
+
+            count += slot.state == SLOT_USED;
+        }
+    }
+
+    header->clean = 0;
+    setEntries(count);
+    // the entries are not in the expiry index, so they are swept instead
+    unindexedSlots = count > 0 ? slotCount : 0;
+}
+
+CorrelationStore::~CorrelationStore() {
+    unmap();
+}
+
+bool CorrelationStore::insert(const char* messageId, const size_t length, const uint64_t value, const time_t now) {
+    boost::mutex::scoped_lock lock(writeMutex);
+    uint64_t h = hash(messageId, length);
+    size_t index = locate(h, messageId, length);
+
+    if (index == slotCount) {
+        if (entries.load(memory_order_relaxed) >= maxEntries) {
+            return false;
+        }
+
+        // first free slot on the probe sequence
+        for (index = h & mask; slots[index].state == SLOT_USED; index = (index + 1) & mask) {
+        }
+
+        Slot* slot = &slots[index];
+        beginWrite(slot);
+        slot->hash = h;
+        slot->state = SLOT_USED;
+        slot->keyLength = static_cast<uint8_t>(std::min<size_t>(length, 0xff));
+        memcpy(slot->key, messageId, std::min(length, KEY_SIZE));
+        slot->value = value;
+        slot->expiry = static_cast<uint32_t>(now + ttl);
+        endWrite(slot);
+        setEntries(entries.load(memory_order_relaxed) + 1);
+    } else {
+        Slot* slot = &slots[index];
+        beginWrite(slot);
+        slot->value = value;
+        slot->expiry = static_cast<uint32_t>(now + ttl);
+        endWrite(slot);
+    }
+
+    uint32_t epoch = static_cast<uint32_t>(now / bucketSeconds);
+    size_t bucket = epoch % bucketCount;
+
+    if (bucketEpochs[bucket] != epoch) {
+        // the bucket is a full ring older, so its entries are due
+        expireBucket(bucket, now);
+        bucketEpochs[bucket] = epoch;
+    }
+
+    link(index, bucket);
+    return true;
+}
+
+bool CorrelationStore::find(const char* messageId, const size_t length, uint64_t* value) const {
+    uint32_t epoch;
+
+    // the epoch is checked again after counting this reader, so compact() either waits for it or it sees the new
+    // table
+    for (;;) {
+        epoch = readEpoch.load() & 1;
+        readers[epoch].fetch_add(1);
+
+        if ((readEpoch.load() & 1) == epoch) {
+            break;
+        }
+
+        readers[epoch].fetch_sub(1);
+    }
+
+    bool found = lookup(readSlots.load(), messageId, length, value);
+    readers[epoch].fetch_sub(1, memory_order_release);
+    return found;
+}
+
+bool CorrelationStore::lookup(const Slot* table, const char* messageId, const size_t length, uint64_t* value) const {
+    uint64_t h = hash(messageId, length);
+
+    for (size_t index = h & mask, probes = 0; probes < slotCount; index = (index + 1) & mask, ++probes) {
+        const Slot &slot = table[index];
+
+        for (;;) {
+            uint32_t sequence = slot.sequence.load(memory_order_acquire);
+
+            if (sequence & 1) {
+                continue;
+            }
+
+            uint8_t state = slot.state;
+            bool match = state == SLOT_USED && matches(slot, h, messageId, length);
+            uint64_t slotValue = slot.value;
+            std::atomic_thread_fence(memory_order_acquire);
+
+            if (slot.sequence.load(memory_order_relaxed) != sequence) {
+                continue;
+            }
+
+            if (state == SLOT_EMPTY) {
+                return false;
+            }
+
+            if (match) {
+                *value = slotValue;
+                return true;
+            }
+
+            break;
+        }
+    }
+
+    return false;
+}
+
+bool CorrelationStore::remove(const char* messageId, const size_t length, uint64_t* value) {
+    boost::mutex::scoped_lock lock(writeMutex);
+    size_t index = locate(hash(messageId, length), messageId, length);
+
+    if (index == slotCount) {
+        return false;
+    }
+
+    if (value != 0) {
+        *value = slots[index].value;
+    }
+
+    erase(index);
+    return true;
+}
+
+size_t CorrelationStore::expire(const time_t now) {
+    boost::mutex::scoped_lock lock(writeMutex);
+    size_t removed = 0;
+
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+        // every entry in the bucket was inserted before the end of its period
+        if (!isBucketEmpty(bucket) && static_cast<time_t>(bucketEpochs[bucket] + 1) * bucketSeconds + ttl <= now) {
+            removed += expireBucket(bucket, now);
+        }
+    }
+
+    if (unindexedSlots > 0) {
+        // visit every slot once per turn of the ring
+        removed += sweep(std::min(unindexedSlots, slotCount / bucketCount + 1), now);
+    }
+
+    return removed;
+}
+
+size_t CorrelationStore::compact(const time_t now) {
+    boost::mutex::scoped_lock lock(writeMutex);
+    boost::scoped_array<Slot> fresh;
+    Slot* target = 0;
+    string compactPath;
+    int compactFd = -1;
+    size_t compactSize = 0;
+    Header* compactHeader = 0;
+
+    if (header != 0) {
+        compactPath = path + ".compact";
+        ::unlink(compactPath.c_str());
+        bool created = false;
+        compactHeader = map(compactPath, &compactFd, &compactSize, &created);
+        target = reinterpret_cast<Slot*>(compactHeader + 1);
+    } else {
+        fresh.reset(new Slot[slotCount]());
+        target = fresh.get();
+    }
+
+    // the expiry index of the new table, which replaces the current one only if the new table does
+    boost::scoped_array<Link> freshLinks(new Link[slotCount + bucketCount]);
+    std::vector<uint32_t> freshEpochs(bucketEpochs);
+
+    for (size_t i = 0; i < slotCount + bucketCount; ++i) {
+        freshLinks[i].next = freshLinks[i].prev = static_cast<uint32_t>(i);
+    }
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < slotCount; ++i) {
+        const Slot &slot = slots[i];
+
+        if (slot.state != SLOT_USED || slot.expiry <= now) {
+            continue;
+        }
+
+        size_t index = slot.hash & mask;
+
+        while (target[index].state != SLOT_EMPTY) {
+            index = (index + 1) & mask;
+        }
+
+        Slot &copy = target[index];
+        copy.expiry = slot.expiry;
+        copy.hash = slot.hash;
+        copy.value = slot.value;
+        copy.state = SLOT_USED;
+        copy.keyLength = slot.keyLength;
+        memcpy(copy.key, slot.key, KEY_SIZE);
+
+        uint32_t epoch = static_cast<uint32_t>((slot.expiry - ttl) / bucketSeconds);
+        size_t bucket = epoch % bucketCount;
+        freshEpochs[bucket] = epoch;
+        append(freshLinks.get(), slotCount + bucket, index);
+        ++kept;
+    }
+
+    if (header != 0) {
+        compactHeader->entries = kept;
+
+        if (::msync(compactHeader, compactSize, MS_SYNC) != 0 || ::rename(compactPath.c_str(), path.c_str()) != 0) {
+            string error = strerror(errno);
+            ::munmap(compactHeader, compactSize);
+            ::close(compactFd);
+            ::unlink(compactPath.c_str());
+            throw smpp::SmppException("CorrelationStore failed to replace " + path + ": " + error);
+        }
+
+        publish(target);
+        ::munmap(header, mappedSize);
+        ::close(fd);
+        header = compactHeader;
+        fd = compactFd;
+        mappedSize = compactSize;
+    } else {
+        publish(target);
+        heapSlots.swap(fresh);
+    }
+
+    slots = target;
+    links.swap(freshLinks);
+    bucketEpochs.swap(freshEpochs);
+    setEntries(kept);
+    sweepCursor = 0;
+    unindexedSlots = 0;
+    return kept;
+}
+
+void CorrelationStore::sync() {
+    boost::mutex::scoped_lock lock(writeMutex);
+
+    if (header != 0 && ::msync(header, mappedSize, MS_SYNC) != 0) {
+        throw smpp::SmppException("CorrelationStore failed to sync " + path + ": " + strerror(errno));
+    }
+}
+
+bool CorrelationStore::resolve(const receipt::Receipt &receipt, uint64_t* value) {
+    if (receipt.state == STATE_ENROUTE || receipt.state == 0) {
+        return find(receipt.id, value);
+    }
+
+    return remove(receipt.id, value);
+}
+
+bool CorrelationStore::resolve(const SmsView &dlr, receipt::Receipt* receipt, uint64_t* value) {
+    return receipt::decode(dlr, receipt) && resolve(*receipt, value);
+}
+
+void CorrelationStore::initialize(const size_t capacity) {
+    if (capacity == 0 || bucketSeconds == 0) {
+        throw smpp::SmppException("CorrelationStore needs a capacity and a bucket size");
+    }
+
+    slotCount = 16;
+
+    // keep the load factor below 3/4
+    while (slotCount < capacity + capacity / 3) {
+        slotCount <<= 1;
+    }
+
+    mask = slotCount - 1;
+    bucketCount = ttl / bucketSeconds + 2;
+    links.reset(new Link[slotCount + bucketCount]);
+
+    for (size_t i = 0; i < slotCount + bucketCount; ++i) {
+        links[i].next = links[i].prev = static_cast<uint32_t>(i);
+    }
+
+    bucketEpochs.assign(bucketCount, 0);
+}
+
+CorrelationStore::Header* CorrelationStore::map(const string &file, int* fileDescriptor, size_t* size,
+                                                bool* created) {
+    static_assert(sizeof(Header) == 64, "CorrelationStore header should be 64 bytes");
+    int descriptor = ::open(file.c_str(), O_RDWR | O_CREAT, 0644);
+
+    if (descriptor < 0) {
+        throw smpp::SmppException("CorrelationStore failed to open " + file + ": " + strerror(errno));
+    }
+
+    struct stat st;
+
+    if (::fstat(descriptor, &st) != 0) {
+        string error = strerror(errno);
+        ::close(descriptor);
+        throw smpp::SmppException("CorrelationStore failed to stat " + file + ": " + error);
+    }
+
+    // an empty file was just created, or left by a crash before it was sized
+    bool create = st.st_size == 0;
+    size_t length = create ? sizeof(Header) + slotCount * sizeof(Slot) : st.st_size;
+
+    // a new file is sparse and reads as zeroes, which are empty slots
+    if (create && ::ftruncate(descriptor, length) != 0) {
+        string error = strerror(errno);
+        ::close(descriptor);
+        throw smpp::SmppException("CorrelationStore failed to size " + file + ": " + error);
+    }
+
+    void* mapping = length >= sizeof(Header) ? ::mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0)
+                    : MAP_FAILED;
+
+    if (mapping == MAP_FAILED) {
+        string error = strerror(errno);
+        ::close(descriptor);
+        throw smpp::SmppException("CorrelationStore failed to map " + file + ": " + error);
+    }
+
+    Header* mapped = static_cast<Header*>(mapping);
+
+    if (create) {
+        memcpy(mapped->magic, MAGIC, sizeof(MAGIC));
+        mapped->keySize = KEY_SIZE;
+        mapped->ttl = ttl;
+        mapped->slotCount = slotCount;
+        mapped->maxEntries = maxEntries;
+        mapped->entries = 0;
+        mapped->bucketSeconds = bucketSeconds;
+        mapped->clean = 0;
+    } else if (memcmp(mapped->magic, MAGIC, sizeof(MAGIC)) != 0 || mapped->keySize != KEY_SIZE
+               || mapped->bucketSeconds == 0) {
+        ::munmap(mapping, length);
+        ::close(descriptor);
+        throw smpp::SmppException("CorrelationStore file " + file + " is not a correlation store");
+    }
+
+    *fileDescriptor = descriptor;
+    *size = length;
+    *created = create;
+    return mapped;
+}
+
+void CorrelationStore::unmap() {
+    if (header == 0) {
+        return;
+    }
+
+    header->entries = entries.load(memory_order_relaxed);
+    ::msync(header, mappedSize, MS_SYNC);
+    header->clean = 1;
+    ::msync(header, sizeof(Header), MS_SYNC);
+    ::munmap(header, mappedSize);
+    ::close(fd);
+    header = 0;
+    slots = 0;
+    fd = -1;
+}
+
+uint64_t CorrelationStore::hash(const char* key, const size_t length) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < length; ++i) {
+        h ^= static_cast<uint8_t>(key[i]);
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+bool CorrelationStore::matches(const Slot &slot, const uint64_t h, const char* key, const size_t length) const {
+    return slot.hash == h && slot.keyLength == std::min<size_t>(length, 0xff)
+           && memcmp(slot.key, key, std::min(length, KEY_SIZE)) == 0;
+}
+
+size_t CorrelationStore::locate(const uint64_t h, const char* key, const size_t length) const {
+    for (size_t index = h & mask, probes = 0; probes < slotCount; index = (index + 1) & mask, ++probes) {
+        const Slot &slot = slots[index];
+
+        if (slot.state == SLOT_EMPTY) {
+            break;
+        }
+
+        if (slot.state == SLOT_USED && matches(slot, h, key, length)) {
+            return index;
+        }
+    }
+
+    return slotCount;
+}
+
+void CorrelationStore::beginWrite(Slot* slot) {
+    slot->sequence.store(slot->sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    std::atomic_thread_fence(memory_order_release);
+}
+
+void CorrelationStore::endWrite(Slot* slot) {
+    slot->sequence.store(slot->sequence.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+void CorrelationStore::erase(const size_t index) {
+    // a slot followed by an empty slot ends every probe sequence through it, so it can be emptied instead of
+    // leaving a tombstone, and so can the tombstones before it
+    uint8_t state = slots[(index + 1) & mask].state == SLOT_EMPTY ? SLOT_EMPTY : SLOT_DELETED;
+    Slot* slot = &slots[index];
+    beginWrite(slot);
+    slot->state = state;
+    endWrite(slot);
+    setEntries(entries.load(memory_order_relaxed) - 1);
+    unlink(index);
+
+    for (size_t i = (index - 1) & mask; state == SLOT_EMPTY && slots[i].state == SLOT_DELETED; i = (i - 1) & mask) {
+        beginWrite(&slots[i]);
+        slots[i].state = SLOT_EMPTY;
+        endWrite(&slots[i]);
+    }
+}
+
+void CorrelationStore::publish(Slot* table) {
+    readSlots.store(table);
+    uint32_t previous = readEpoch.fetch_add(1) & 1;
+
+    // lookups which counted themselves in the previous epoch may still read the old table
+    while (readers[previous].load(memory_order_acquire) != 0) {
+        boost::this_thread::yield();
+    }
+}
+
+void CorrelationStore::append(Link* list, const size_t head, const size_t index) {
+    uint32_t tail = list[head].prev;
+    list[index].next = static_cast<uint32_t>(head);
+    list[index].prev = tail;
+    list[tail].next = static_cast<uint32_t>(index);
+    list[head].prev = static_cast<uint32_t>(index);
+}
+
+void CorrelationStore::unlink(const size_t index) {
+    Link &node = links[index];
+    links[node.prev].next = node.next;
+    links[node.next].prev = node.prev;
+    node.next = node.prev = static_cast<uint32_t>(index);
+}
+
+size_t CorrelationStore::expireBucket(const size_t bucket, const time_t now) {
+    size_t head = slotCount + bucket;
+    size_t removed = 0;
+
+    for (size_t index = links[head].next; index != head;) {
+        // erasing unlinks the slot
+        size_t next = links[index].next;
+        const Slot &slot = slots[index];
+
+        if (slot.state == SLOT_USED && slot.expiry <= now) {
+            erase(index);
+            ++removed;
+        }
+
+        index = next;
+    }
+
+    return removed;
+}
+
+size_t CorrelationStore::sweep(const size_t count, const time_t now) {
+    size_t removed = 0;
+
+    for (size_t i = 0; i < count && unindexedSlots > 0; ++i, --unindexedSlots) {
+        const Slot &slot = slots[sweepCursor];
+
+        if (slot.state == SLOT_USED && slot.expiry <= now) {
+            erase(sweepCursor);
+            ++removed;
+        }
+
+        sweepCursor = (sweepCursor + 1) & mask;
+    }
+
+    return removed;
+}
+
+void CorrelationStore::setEntries(const size_t count) {
+    entries.store(count, memory_order_relaxed);
+
+    if (header != 0) {
+        header->entries = count;
+    }
+}
+}  // namespace smpp
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_CORRELATIONSTORE_H_
+#define SMPP_CORRELATIONSTORE_H_
+
+#include <stdint.h>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "smpp/clock.h"
+#include "smpp/exceptions.h"
+#include "smpp/receipt.h"
+#include "smpp/smsview.h"
+
+namespace smpp {
+/**
+ * Maps the SMSC message ids of submitted messages to a value of the caller, ie. a database key, until the delivery
+ * receipt arrives or the entry expires.
+ *
+ * The store is an open addressing hash table with linear probing and a fixed number of slots. Each slot is one cache
+ * line holding the message id inline, so an entry costs about 100 bytes including the free slots and the expiry
+ * index, and no allocations are made after construction except by compact(). Message ids longer than KEY_SIZE are
+ * stored truncated and told apart by their length and 64 bit hash.
+ *
+ * Entries expire ttl seconds after they were inserted. The expiry index is a ring of time buckets, each a linked list
+ * of the slots inserted in that period, so expiring only visits entries that are due. The links are kept in an array
+ * parallel to the slots, so moving an entry to another bucket when it is updated does not allocate.
+ *
+ * Lookups are lock-free: every slot has a sequence number which is odd while it is written, and readers retry if it
+ * changed while they read the slot. Writers (insert, remove, expire and compact) are serialized by a mutex.
+ * compact() replaces the table under the readers, so a lookup counts itself in one of two reader epochs while it
+ * reads; the old table is freed once the readers of the epoch that could still see it are done.
+ *
+ * The slots can optionally live in a memory mapped file, so the store can be larger than RAM and survives restarts.
+ * The file is a 64 byte header followed by the slots, which are updated in place; a slot with an odd sequence number
+ * was torn by a crash and is dropped when the file is opened. Opening does not scan the file, the entries found in
+ * it are expired by an incremental sweep instead. compact() rewrites the file without tombstones and expired
+ * entries and atomically replaces it.
+ */
+class CorrelationStore {
+  public:
+    // Message id octets stored inline in a slot
+    static const size_t KEY_SIZE = 38;
+
+  private:
+    enum {
+        SLOT_EMPTY, SLOT_USED, SLOT_DELETED
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t keySize;
+        uint32_t ttl;
+        uint64_t slotCount;
+        uint64_t maxEntries;
+        uint64_t entries;
+        uint32_t bucketSeconds;
+        // Set when the file was closed cleanly, otherwise it is checked for torn slots when opened
+        uint32_t clean;
+        uint8_t reserved[16];
+    };
+
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        // Time in seconds since the epoch when the entry expires
+        uint32_t expiry;
+        uint64_t hash;
+        uint64_t value;
+        uint8_t state;
+        uint8_t keyLength;
+        char key[KEY_SIZE];
+    };
+
+    // Links of a circular doubly linked list, indexes into the links array
+    struct Link {
+        uint32_t next;
+        uint32_t prev;
+    };
+
+    // Table used by writers, which hold writeMutex
+    Slot* slots;
+    boost::scoped_array<Slot> heapSlots;
+    // Table used by lookups, and the number of lookups in each epoch, which compact() advances
+    std::atomic<Slot*> readSlots;
+    std::atomic<uint32_t> readEpoch;
+    mutable std::atomic<size_t> readers[2];
+    size_t slotCount;
+    size_t mask;
+    size_t maxEntries;
+    std::atomic<size_t> entries;
+
+    uint32_t ttl;
+    uint32_t bucketSeconds;
+    // Expiry index: links[i] links slot i into the list of its bucket, and links[slotCount + b] is the head of
+    // bucket b. A slot in no bucket links to itself. bucketEpochs holds the time / bucketSeconds of each bucket.
+    boost::scoped_array<Link> links;
+    size_t bucketCount;
+    std::vector<uint32_t> bucketEpochs;
+
+    // Memory mapped file, if any
+    std::string path;
+    int fd;
+    Header* header;
+    size_t mappedSize;
+    // Next slot to visit when sweeping entries that are not in the expiry index
+    size_t sweepCursor;
+    size_t unindexedSlots;
+
+    boost::mutex writeMutex;
+
+  public:
+    /**
+     * Constructs an empty store.
+     * @param capacity Maximum number of entries.
+     * @param ttl Seconds an entry is kept, 72 hours by default.
+     * @param bucketSeconds Granularity of the expiry index.
+     */
+    explicit CorrelationStore(const size_t capacity, const uint32_t ttl = 72 * 3600,
+                              const uint32_t bucketSeconds = 600);
+
+    /**
+     * Opens or creates a store in a memory mapped file. An existing file keeps its own capacity and ttl.
+     * @param path File to map.
+     * @param capacity Maximum number of entries, if the file is created.
+     * @param ttl Seconds an entry is kept, if the file is created.
+     * @param bucketSeconds Granularity of the expiry index, if the file is created.
+     * @throw SmppException if the file cannot be mapped or is not a correlation store.
+     */
+    CorrelationStore(const std::string &path, const size_t capacity, const uint32_t ttl = 72 * 3600,
+                     const uint32_t bucketSeconds = 600);
+
+    ~CorrelationStore();
+
+    /**
+     * Inserts or updates the value of a message id.
+     * @param messageId SMSC message id, as returned by sendSms.
+     * @param length Length of the message id.
+     * @param value Value to correlate with the message id.
+     * @param now Current time in seconds since the epoch.
+     * @return False if the store is full.
+     */
+    bool insert(const char* messageId, const size_t length, const uint64_t value, const time_t now);
+
+    bool insert(const std::string &messageId, const uint64_t value) {
+        return insert(messageId.data(), messageId.length(), value, CoarseClock::now());
+    }
+
+    /**
+     * Looks up a message id without locking.
+     * @param value Set to the value of the message id, if found.
+     * @return True if the message id was found.
+     */
+    bool find(const char* messageId, const size_t length, uint64_t* value) const;
+
+    bool find(const std::string &messageId, uint64_t* value) const {
+        return find(messageId.data(), messageId.length(), value);
+    }
+
+    /**
+     * Removes a message id.
+     * @param value Set to the value of the message id, if found and not null.
+     * @return True if the message id was found.
+     */
+    bool remove(const char* messageId, const size_t length, uint64_t* value);
+
+    bool remove(const std::string &messageId, uint64_t* value) {
+        return remove(messageId.data(), messageId.length(), value);
+    }
+
+    /**
+     * Removes the entries which have expired.
+     * @param now Current time in seconds since the epoch.
+     * @return Number of entries removed.
+     */
+    size_t expire(const time_t now);
+
+    /**
+     * Rebuilds the table without tombstones and expired entries. A mapped store is written to a new file which
+     * replaces the old one when complete, so a crash leaves either the old or the new file. Lookups may run
+     * concurrently, compact() waits for those reading the old table before freeing it.
+     * @param now Current time in seconds since the epoch.
+     * @return Number of entries kept.
+     * @throw SmppException if the new file cannot be written, in which case the store is left unchanged.
+     */
+    size_t compact(const time_t now);
+
+    /**
+     * Writes the mapped file to disk. Does nothing for a store in memory.
+     */
+    void sync();
+
+    bool isMapped() const {
+        return header != 0;
+    }
+
+    /**
+     * Finds the value of the message a delivery receipt belongs to. The entry is removed if the receipt has a final
+     * state, so later receipts of the same message are not matched.
+     * @param receipt Decoded receipt.
+     * @param value Set to the value of the message id, if found.
+     * @return True if the message id was found.
+     */
+    bool resolve(const receipt::Receipt &receipt, uint64_t* value);
+
+    /**
+     * Decodes a delivery receipt and finds the value of the message it belongs to, see resolve(const Receipt&).
+     * @param dlr Delivery receipt.
+     * @param receipt Decoded receipt.
+     * @param value Set to the value of the message id, if found.
+     * @return True if the receipt could be decoded and the message id was found.
+     */
+    bool resolve(const SmsView &dlr, receipt::Receipt* receipt, uint64_t* value);
+
+    size_t size() const {
+        return entries.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {
+        return maxEntries;
+    }
+
+  private:
+    CorrelationStore(const CorrelationStore &);
+    CorrelationStore &operator=(const CorrelationStore &);
+
+    /**
+     * Sizes the table and the expiry index for a capacity.
+     */
+    void initialize(const size_t capacity);
+
+    /**
+     * Opens a mapped file and returns its header. A file which does not exist or is empty, ie. after a crash before
+     * it was sized, is created with slotCount slots.
+     * @param created Set to true if the file was created.
+     */
+    Header* map(const std::string &file, int* fileDescriptor, size_t* size, bool* created);
+    void unmap();
+
+    /**
+     * Makes a new table visible to lookups, and waits until no lookup can be reading the previous one.
+     */
+    void publish(Slot* table);
+
+    static uint64_t hash(const char* key, const size_t length);
+
+    bool matches(const Slot &slot, const uint64_t h, const char* key, const size_t length) const;
+
+    /**
+     * Looks up a message id in a table without locking.
+     */
+    bool lookup(const Slot* table, const char* messageId, const size_t length, uint64_t* value) const;
+
+    /**
+     * Returns the index of the slot holding a key, or slotCount if it is not found. Must hold writeMutex.
+     */
+    size_t locate(const uint64_t h, const char* key, const size_t length) const;
+
+    void beginWrite(Slot* slot);
+    void endWrite(Slot* slot);
+
+    /**
+     * Removes the entry in a slot. Must hold writeMutex.
+     */
+    void erase(const size_t index);
+
+    /**
+     * Moves a slot to the end of the list of a bucket. Must hold writeMutex.
+     */
+    void link(const size_t index, const size_t bucket) {
+        unlink(index);
+        append(links.get(), slotCount + bucket, index);
+    }
+
+    /**
+     * Adds a node which is in no list to the end of the list of a head.
+     */
+    static void append(Link* list, const size_t head, const size_t index);
+
+    /**
+     * Removes a slot from the list of its bucket, if any. Must hold writeMutex.
+     */
+    void unlink(const size_t index);
+
+    bool isBucketEmpty(const size_t bucket) const {
+        return links[slotCount + bucket].next == slotCount + bucket;
+    }
+
+    /**
+     * Removes the entries of a bucket which have expired. Must hold writeMutex.
+     */
+    size_t expireBucket(const size_t bucket, const time_t now);
+
+    /**
+     * Removes the expired entries in the next slots not covered by the expiry index. Must hold writeMutex.
+     */
+    size_t sweep(const size_t count, const time_t now);
+
+    void setEntries(const size_t count);
+};
+}  // namespace smpp
+
+#endif  // SMPP_CORRELATIONSTORE_H_
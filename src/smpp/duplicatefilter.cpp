@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/duplicatefilter.h"
+#include <algorithm>
+#include <string>
+
+#include "smpp/receipt.h"
+#include "smpp/tlv.h"
+
+using std::string;
+
+namespace smpp {
+namespace {
+// FNV-1a, continuing from h
+uint64_t hashBytes(uint64_t h, const uint8_t* data, const size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        h ^= data[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+uint64_t hashString(const uint64_t h, const string &s) {
+    // the terminator separates the fields
+    return hashBytes(h, reinterpret_cast<const uint8_t*>(s.c_str()), s.length() + 1);
+}
+
+size_t powerOfTwo(const size_t n) {
+    size_t size = 1;
+
+    while (size < n) {
+        size <<= 1;
+    }
+
+    return size;
+}
+}  // namespace
+
+DuplicateFilter::DuplicateFilter(const size_t capacity, const uint32_t _window) :
+    current(0), /**/
+    slotMask(powerOfTwo(std::max<size_t>(capacity, 1) * 2) - 1), /**/
+    bloomMask(powerOfTwo((std::max<size_t>(capacity, 1) + 3) / 4) - 1), /**/
+    maxEntries(std::max<size_t>(capacity, 1)), /**/
+    window(_window), /**/
+    duplicates(0) {
+    for (int i = 0; i < 2; ++i) {
+        generations[i].bloom.reset(new uint64_t[bloomMask + 1]());
+        generations[i].fingerprints.reset(new uint64_t[slotMask + 1]());
+        generations[i].entries = 0;
+        generations[i].start = 0;
+    }
+}
+
+bool DuplicateFilter::check(uint64_t fingerprint, const time_t now) {
+    if (contains(fingerprint, now)) {
+        return true;
+    }
+
+    remember(fingerprint, now);
+    return false;
+}
+
+bool DuplicateFilter::contains(uint64_t fingerprint, const time_t now) {
+    if (fingerprint == 0) {
+        fingerprint = 1;
+    }
+
+    if (now - generations[current].start >= window) {
+        rotate(now);
+    }
+
+    uint64_t bits = bloomBits(fingerprint);
+    size_t word = fingerprint & bloomMask;
+
+    for (int i = 0; i < 2; ++i) {
+        const Generation &generation = generations[(current + i) & 1];
+
+        if ((generation.bloom[word] & bits) == bits && contains(generation, fingerprint)) {
+            ++duplicates;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DuplicateFilter::remember(uint64_t fingerprint, const time_t now) {
+    if (fingerprint == 0) {
+        fingerprint = 1;
+    }
+
+    if (now - generations[current].start >= window) {
+        rotate(now);
+    }
+
+    // an SMS may be acknowledged more than once, ie. if the SMSC sent it again before the first response
+    if (contains(generations[current], fingerprint)) {
+        return;
+    }
+
+    if (generations[current].entries >= maxEntries) {
+        rotate(now);
+    }
+
+    add(&generations[current], fingerprint);
+}
+
+uint64_t DuplicateFilter::fingerprintOf(const SmsView &sms) {
+    uint64_t h = 14695981039346656037ULL;
+    h = hashString(h, sms.getSourceAddr());
+    h = hashString(h, sms.getDestAddr());
+    uint16_t length = 0;
+    const uint8_t* id = sms.findTlv(tags::RECEIPTED_MESSAGE_ID, &length);
+
+    if (id != 0) {
+        h = hashBytes(h, id, length);
+
+        // intermediate receipts, ie. ENROUTE, must not hide the final one for the same message
+        const uint8_t* state = sms.findTlv(tags::MESSAGE_STATE, &length);
+
+        if (state != 0) {
+            return hashBytes(h, state, length);
+        }
+
+        receipt::ReceiptText fields;
+        receipt::scanText(reinterpret_cast<const char*>(sms.getShortMessageData()), sms.getSmLength(), &fields);
+        return hashBytes(h, reinterpret_cast<const uint8_t*>(fields.stat.data), fields.stat.length);
+    }
+
+    h = hashBytes(h, sms.getShortMessageData(), sms.getSmLength());
+    const uint8_t* payload = sms.findTlv(tags::MESSAGE_PAYLOAD, &length);
+
+    if (payload != 0) {
+        h = hashBytes(h, payload, length);
+    }
+
+    return h;
+}
+
+uint64_t DuplicateFilter::bloomBits(const uint64_t fingerprint) const {
+    // three bits in one word, from bits of the fingerprint not used to pick the word
+    return (1ULL << ((fingerprint >> 40) & 63)) | (1ULL << ((fingerprint >> 46) & 63))
+           | (1ULL << ((fingerprint >> 52) & 63));
+}
+
+bool DuplicateFilter::contains(const Generation &generation, const uint64_t fingerprint) const {
+    // the slot is taken from the high bits, which are independent of the bloom filter word
+    for (size_t i = (fingerprint >> 20) & slotMask; generation.fingerprints[i] != 0; i = (i + 1) & slotMask) {
+        if (generation.fingerprints[i] == fingerprint) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DuplicateFilter::add(Generation* generation, const uint64_t fingerprint) {
+    generation->bloom[fingerprint & bloomMask] |= bloomBits(fingerprint);
+    size_t i = (fingerprint >> 20) & slotMask;
+
+    while (generation->fingerprints[i] != 0) {
+        i = (i + 1) & slotMask;
+    }
+
+    generation->fingerprints[i] = fingerprint;
+    ++generation->entries;
+}
+
+void DuplicateFilter::rotate(const time_t now) {
+    current = (current + 1) & 1;
+    Generation &generation = generations[current];
+    std::fill(generation.bloom.get(), generation.bloom.get() + bloomMask + 1, 0);
+    std::fill(generation.fingerprints.get(), generation.fingerprints.get() + slotMask + 1, 0);
+    generation.entries = 0;
+    generation.start = now;
+
+    // nothing arrived for more than a window, so the other generation has expired as well
+    Generation &previous = generations[(current + 1) & 1];
+
+    if (now - previous.start >= 2 * static_cast<time_t>(window) && previous.entries != 0) {
+        std::fill(previous.bloom.get(), previous.bloom.get() + bloomMask + 1, 0);
+        std::fill(previous.fingerprints.get(), previous.fingerprints.get() + slotMask + 1, 0);
+        previous.entries = 0;
+    }
+}
+}  // namespace smpp
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_DUPLICATEFILTER_H_
+#define SMPP_DUPLICATEFILTER_H_
+
+#include <stdint.h>
+#include <boost/scoped_array.hpp>
+
+#include <cstddef>
+#include <ctime>
+
+#include "smpp/smsview.h"
+
+namespace smpp {
+/**
+ * Detects deliver_sm the SMSC sends again, ie. because our response was late.
+ *
+ * Messages are identified by a 64 bit fingerprint of their source and destination address and either the receipted
+ * message id of a delivery receipt or the content of other messages. The fingerprints are remembered in two
+ * generations, each covering window seconds or capacity messages, whichever comes first, so a message is recognized
+ * for at least one window unless more than capacity messages arrive within it.
+ *
+ * Each generation is an exact set of fingerprints in an open addressing table, in front of which is a blocked bloom
+ * filter of one 64 bit word per four messages. Most messages are new, and are told apart by the bloom filters
+ * without touching the larger tables. Memory is allocated once, about 40 bytes per message of capacity.
+ *
+ * The filter is not thread safe.
+ */
+class DuplicateFilter {
+  private:
+    struct Generation {
+        boost::scoped_array<uint64_t> bloom;
+        // Fingerprints, zero marks a free slot
+        boost::scoped_array<uint64_t> fingerprints;
+        size_t entries;
+        // Time the generation was started
+        time_t start;
+    };
+
+    Generation generations[2];
+    size_t current;
+    size_t slotMask;
+    size_t bloomMask;
+    size_t maxEntries;
+    uint32_t window;
+    uint64_t duplicates;
+
+  public:
+    /**
+     * @param capacity Number of messages remembered in each generation.
+     * @param window Seconds each generation covers, 10 minutes by default.
+     */
+    explicit DuplicateFilter(const size_t capacity, const uint32_t window = 600);
+
+    /**
+     * Checks if a message was seen within the window, and remembers it if it was not.
+     * @param fingerprint Fingerprint of the message.
+     * @param now Current time in seconds since the epoch.
+     * @return True if the message is a duplicate.
+     */
+    bool check(uint64_t fingerprint, const time_t now);
+
+    /**
+     * Checks if a message was remembered within the window, without remembering it.
+     * @param fingerprint Fingerprint of the message.
+     * @param now Current time in seconds since the epoch.
+     * @return True if the message is a duplicate.
+     */
+    bool contains(uint64_t fingerprint, const time_t now);
+
+    /**
+     * Remembers a message, ie. once it has been acknowledged, unless it is remembered already.
+     * @param fingerprint Fingerprint of the message.
+     * @param now Current time in seconds since the epoch.
+     */
+    void remember(uint64_t fingerprint, const time_t now);
+
+    bool check(const SmsView &sms, const time_t now) {
+        return check(fingerprintOf(sms), now);
+    }
+
+    /**
+     * @return Fingerprint of the source and destination address and the content of a message, or of a receipt the
+     * receipted message id and message state.
+     */
+    static uint64_t fingerprintOf(const SmsView &sms);
+
+    /**
+     * @return Number of duplicates found.
+     */
+    uint64_t getDuplicates() const {
+        return duplicates;
+    }
+
+    /**
+     * @return Number of messages remembered.
+     */
+    size_t size() const {
+        return generations[0].entries + generations[1].entries;
+    }
+
+  private:
+    DuplicateFilter(const DuplicateFilter &);
+    DuplicateFilter &operator=(const DuplicateFilter &);
+
+    /**
+     * Word of the bloom filter and the bits in it of a fingerprint.
+     */
+    uint64_t bloomBits(const uint64_t fingerprint) const;
+
+    bool contains(const Generation &generation, const uint64_t fingerprint) const;
+
+    void add(Generation* generation, const uint64_t fingerprint);
+
+    /**
+     * Makes the oldest generation the current one and clears it.
+     */
+    void rotate(const time_t now);
+};
+}  // namespace smpp
+
+#endif  // SMPP_DUPLICATEFILTER_H_
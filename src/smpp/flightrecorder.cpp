@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/flightrecorder.h"
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "smpp/clock.h"
+#include "smpp/hexdump.h"
+#include "smpp/smpp.h"
+
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::memory_order_release;
+using std::vector;
+
+namespace smpp {
+namespace {
+size_t powerOfTwo(const size_t n) {
+    size_t size = 1;
+
+    while (size < n) {
+        size <<= 1;
+    }
+
+    return size;
+}
+
+uint32_t readUint32(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16)
+           | (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+}  // namespace
+
+FlightRecorder::FlightRecorder(const size_t records, const size_t _recordSize) :
+    slots(new Slot[powerOfTwo(std::max<size_t>(records, 1))]), /**/
+    data(new uint8_t[powerOfTwo(std::max<size_t>(records, 1)) * std::min<size_t>(_recordSize, 0xFFFF)]), /**/
+    mask(powerOfTwo(std::max<size_t>(records, 1)) - 1), /**/
+    recordSize(std::min<size_t>(_recordSize, 0xFFFF)), /**/
+    position(0) {
+    for (size_t i = 0; i <= mask; ++i) {
+        slots[i].sequence.store(0, memory_order_relaxed);
+    }
+}
+
+void FlightRecorder::record(const bool sent, const uint8_t* head, const size_t headLength, const uint8_t* tail,
+                            const size_t tailLength) {
+    uint64_t pos = position.fetch_add(1, memory_order_relaxed);
+    size_t index = pos & mask;
+    Slot &slot = slots[index];
+    uint64_t sequence = slot.sequence.load(memory_order_relaxed);
+
+    // the slot is claimed, so a writer which the ring wrapped around during its write cannot publish mixed bytes
+    do {
+        if ((sequence & 1) || sequence > 2 * pos) {
+            return;  // being written by a lapped writer, or already taken by a newer record
+        }
+    } while (!slot.sequence.compare_exchange_weak(sequence, 2 * pos + 1, memory_order_relaxed));
+
+    std::atomic_thread_fence(memory_order_release);
+
+    uint8_t* bytes = data.get() + index * recordSize;
+    size_t headBytes = std::min(headLength, recordSize);
+    size_t tailBytes = std::min(tailLength, recordSize - headBytes);
+    memcpy(bytes, head, headBytes);
+
+    if (tailBytes != 0) {
+        memcpy(bytes + headBytes, tail, tailBytes);
+    }
+
+    slot.timestamp = CoarseClock::nowMicros();
+    slot.length = headLength + tailLength;
+    slot.recorded = headBytes + tailBytes;
+    slot.sent = sent;
+    slot.sequence.store(2 * pos + 2, memory_order_release);
+}
+
+vector<FlightRecord> FlightRecorder::getRecords() const {
+    vector<FlightRecord> records;
+    // position of each record, and its index in records
+    vector<std::pair<uint64_t, size_t> > order;
+
+    for (size_t i = 0; i <= mask; ++i) {
+        const Slot &slot = slots[i];
+        uint64_t sequence = slot.sequence.load(memory_order_acquire);
+
+        if (sequence == 0 || (sequence & 1)) {
+            continue;
+        }
+
+        FlightRecord record;
+        record.timestamp = slot.timestamp;
+        record.sent = slot.sent;
+        record.length = slot.length;
+        const uint8_t* bytes = data.get() + i * recordSize;
+        record.data.assign(bytes, bytes + std::min<size_t>(slot.recorded, recordSize));
+        std::atomic_thread_fence(memory_order_acquire);
+
+        if (slot.sequence.load(memory_order_relaxed) != sequence) {
+            continue;  // overwritten while it was copied
+        }
+
+        order.push_back(std::make_pair(sequence / 2 - 1, records.size()));
+        records.push_back(record);
+    }
+
+    std::sort(order.begin(), order.end());
+    vector<FlightRecord> sorted;
+    sorted.reserve(records.size());
+
+    for (vector<std::pair<uint64_t, size_t> >::iterator it = order.begin(); it != order.end(); ++it) {
+        sorted.push_back(records[it->second]);
+    }
+
+    return sorted;
+}
+
+void FlightRecorder::dump(std::ostream &out) const {
+    vector<FlightRecord> records = getRecords();
+
+    for (vector<FlightRecord>::iterator it = records.begin(); it != records.end(); ++it) {
+        boost::posix_time::ptime time = boost::posix_time::from_time_t(it->timestamp / 1000000)
+                                        + boost::posix_time::microseconds(it->timestamp % 1000000);
+        out << boost::posix_time::to_iso_extended_string(time) << (it->sent ? " sent " : " received ");
+
+        if (it->data.size() >= 8) {
+            out << getCommandName(readUint32(&it->data[4])) << " ";
+        }
+
+        out << std::dec << it->length << " bytes";
+
+        if (it->data.size() < it->length) {
+            out << ", " << it->data.size() << " recorded";
+        }
+
+        out << "\n";
+
+        if (!it->data.empty()) {
+            oc::tools::hexdump(out, &it->data[0], it->data.size());
+        }
+    }
+}
+}  // namespace smpp
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_FLIGHTRECORDER_H_
+#define SMPP_FLIGHTRECORDER_H_
+
+#include <stdint.h>
+#include <boost/scoped_array.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+namespace smpp {
+/**
+ * A PDU recorded by a FlightRecorder.
+ */
+struct FlightRecord {
+    // Microseconds since the epoch
+    int64_t timestamp;
+    bool sent;
+    // Length of the PDU, which may be more than the bytes recorded
+    uint32_t length;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * Ring of the last PDUs sent and received, kept as raw bytes so recording costs a copy and no formatting. The
+ * records are formatted only when they are dumped, ie. after an error.
+ *
+ * The ring has a fixed number of slots, each holding the first bytes of one PDU, and allocates no memory after it is
+ * constructed. Records are written without locks from any number of threads, and can be read while they are
+ * written; a record overwritten while it is read is left out. A writer claims its slot before writing it, and drops
+ * its record if the slot is still being written by a writer the ring wrapped around, or was taken by a newer record.
+ */
+class FlightRecorder {
+  private:
+    struct Slot {
+        // Twice the position of the record plus two once written, odd while it is written, zero if never written
+        std::atomic<uint64_t> sequence;
+        int64_t timestamp;
+        uint32_t length;
+        uint16_t recorded;
+        bool sent;
+    };
+
+    boost::scoped_array<Slot> slots;
+    boost::scoped_array<uint8_t> data;
+    size_t mask;
+    size_t recordSize;
+    std::atomic<uint64_t> position;
+
+  public:
+    /**
+     * @param records Number of PDUs kept, rounded up to a power of two.
+     * @param recordSize Bytes kept of each PDU, at most 65535.
+     */
+    explicit FlightRecorder(const size_t records = 1024, const size_t recordSize = 256);
+
+    /**
+     * Records a PDU given in two parts, ie. its length field and the rest.
+     * Under contention from more writers than there are slots, the record may be dropped.
+     */
+    void record(const bool sent, const uint8_t* head, const size_t headLength, const uint8_t* tail,
+                const size_t tailLength);
+
+    void record(const bool sent, const uint8_t* pdu, const size_t length) {
+        record(sent, pdu, length, 0, 0);
+    }
+
+    /**
+     * @return The records in the ring, oldest first.
+     */
+    std::vector<FlightRecord> getRecords() const;
+
+    /**
+     * Writes the records in the ring, oldest first, with the time, direction and command of each followed by a
+     * hexdump of its bytes.
+     */
+    void dump(std::ostream &out) const;
+
+    /**
+     * @return Number of PDUs recorded, including those overwritten.
+     */
+    uint64_t getRecorded() const {
+        return position.load(std::memory_order_relaxed);
+    }
+
+  private:
+    FlightRecorder(const FlightRecorder &);
+    FlightRecorder &operator=(const FlightRecorder &);
+};
+}  // namespace smpp
+
+#endif  // SMPP_FLIGHTRECORDER_H_
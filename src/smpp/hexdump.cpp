@@ -5,76 +5,133 @@
  */
 
 #include "smpp/hexdump.h"
+#include <algorithm>
+#include <cstring>
 #include <string>
 
-using std::stringstream;
-using std::hex;
-using std::setfill;
-using std::setw;
+namespace oc {
+namespace tools {
+namespace {
+// Two hex digits of every byte value
+const char HEX_PAIRS[] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+// Characters of a line: position, bytes in hex, ascii chars, ie.
+// "00000000  00 01 02 03 04 05 06 07  08 09 0a 0b 0c 0d 0e 0f  |................|\n"
+const size_t POSITION_SIZE = 9;
+const size_t HEX_SIZE = 2 + 16 * 3;
+const size_t LINE_SIZE = POSITION_SIZE + HEX_SIZE + 2 + 16 + 2;
+// Lines written to a stream at a time
+const size_t STREAM_LINES = 64;
+
+char* writePosition(char* out, const uint32_t position) {
+    for (int i = 0; i < 4; ++i) {
+        memcpy(out + i * 2, HEX_PAIRS + ((position >> (24 - i * 8)) & 0xFF) * 2, 2);
+    }
 
-std::string oc::tools::hexdump(uint8_t* bytes, size_t length) {
-    stringstream out;
+    return out + 8;
+}
 
-    if (length == 0) {
-        return out.str();
+/**
+ * Writes the line of up to 16 bytes at an offset.
+ */
+char* writeLine(char* out, const uint8_t* bytes, const size_t offset, const size_t count) {
+    out = writePosition(out, offset);
+    *out++ = ' ';
+    // the hex columns are padded with spaces, so the ascii chars always start at the same column
+    char* hex = out;
+    memset(hex, ' ', HEX_SIZE);
+
+    for (size_t i = 0; i < count; ++i) {
+        // 1 extra space after 8 bytes
+        memcpy(hex + 1 + i * 3 + (i >= 8), HEX_PAIRS + bytes[offset + i] * 2, 2);
     }
 
-    // Print bytes
-    size_t pos = 0;
-    char asciibytes[16];
+    out += HEX_SIZE;
+    *out++ = ' ';
+    *out++ = '|';
 
-    for (; pos < length; pos++) {
-        if (pos % 16 == 0) {
-            // Print ascii chars + endl
-            if (pos > 0) {
-                out << " |";
+    for (size_t i = 0; i < count; ++i) {
+        // If byte is within printable range of ascii (0x20-0x7F) add it as is, otherwise add a . char.
+        uint8_t c = bytes[offset + i];
+        *out++ = (c >= 0x20 && c <= 0x7F) ? c : '.';
+    }
 
-                for (int n = 0; n < 16; n++) {
-                    out << asciibytes[n];
-                }
+    *out++ = '|';
+    *out++ = '\n';
+    return out;
+}
 
-                out << "|" << "\n";
-            }
+char* writeEnd(char* out, const size_t length) {
+    out = writePosition(out, length);
+    *out++ = '\n';
+    return out;
+}
+}  // namespace
 
-            // Print position and 1 space
-            out << hex << setfill('0') << setw(8) << static_cast<uint32_t>(pos) << " ";
-        }
+std::string hexdump(const uint8_t* bytes, size_t length) {
+    std::string out(hexdumpSize(length), ' ');
 
-        uint8_t curbyte = bytes[pos];
+    if (length != 0) {
+        hexdump(bytes, length, &out[0]);
+    }
 
-        // print 1 extra space after 8 bytes
-        if (pos % 8 == 0) {
-            out << " ";
-        }
+    return out;
+}
 
-        // Print current byte in hex
-        out << hex << setfill('0') << setw(2) << static_cast<unsigned int>(curbyte) << " ";
-        // If byte is within printable range of ascii (0x20-0x7F) add it as is, otherwise add a . char.
-        asciibytes[pos % 16] = (curbyte >= 0x20 && curbyte <= 0x7F) ? curbyte : '.';
+size_t hexdumpSize(size_t length) {
+    if (length == 0) {
+        return 0;
     }
 
-    // Print padding + ascii chars + endl
-    int remain = (pos % 16 ? pos % 16 : 16);
-    int offset = pos % 16;
+    // the last line has only the ascii chars of the bytes it holds
+    size_t lines = (length + 15) / 16;
+    return lines * LINE_SIZE - (lines * 16 - length) + POSITION_SIZE;
+}
 
-    for (int n = 0; n < 16 - remain; n++) {
-        // print 1 extra space after 8 bytes
-        if ((n + offset) != 0 && (n + offset) % 8 == 0) {  // print a extra separator after 8 bytes
-            out << " ";
-        }
+size_t hexdump(const uint8_t* bytes, size_t length, char* buffer) {
+    if (length == 0) {
+        return 0;
+    }
 
-        // print empty hex value + space
-        out << "   ";
+    char* out = buffer;
+
+    for (size_t offset = 0; offset < length; offset += 16) {
+        out = writeLine(out, bytes, offset, std::min<size_t>(16, length - offset));
     }
 
-    out << " |";
+    out = writeEnd(out, length);
+    return out - buffer;
+}
 
-    for (int n = 0; n < remain; n++) {
-        out << asciibytes[n];
+void hexdump(std::ostream &out, const uint8_t* bytes, size_t length) {
+    if (length == 0) {
+        return;
     }
 
-    out << "|\n";
-    // Print last position
-    out << hex << setfill('0') << setw(8) << static_cast<uint32_t>(length) << "\n";
-    return out.str();
+    char buffer[STREAM_LINES * LINE_SIZE + POSITION_SIZE];
+    size_t offset = 0;
+
+    while (offset < length) {
+        char* end = buffer;
+
+        for (size_t i = 0; i < STREAM_LINES && offset < length; ++i, offset += 16) {
+            end = writeLine(end, bytes, offset, std::min<size_t>(16, length - offset));
+        }
+
+        if (offset >= length) {
+            end = writeEnd(end, length);
+        }
+
+        out.write(buffer, end - buffer);
+    }
 }
+}  // namespace tools
+}  // namespace oc
@@ -8,9 +8,9 @@
 #define SMPP_HEXDUMP_H_
 
 #include <stdint.h>
+#include <cstddef>
+#include <ostream>
 #include <string>
-#include <sstream>
-#include <iomanip>
 
 namespace oc {
 namespace tools {
@@ -20,8 +20,27 @@ namespace tools {
  * @param length Length of the byte array.
  * @return
  */
-std::string hexdump(uint8_t* bytes, size_t length);
+std::string hexdump(const uint8_t* bytes, size_t length);
 
+/**
+ * @return Number of characters the hexdump of length bytes has.
+ */
+size_t hexdumpSize(size_t length);
+
+/**
+ * Writes the hexdump of a byte array into a buffer, which is not terminated.
+ * @param bytes Byte array to be printed.
+ * @param length Length of the byte array.
+ * @param buffer Buffer of at least hexdumpSize(length) characters.
+ * @return Number of characters written.
+ */
+size_t hexdump(const uint8_t* bytes, size_t length, char* buffer);
+
+/**
+ * Writes the hexdump of a byte array to a stream, a few lines at a time, so large PDUs are not formatted into one
+ * string first.
+ */
+void hexdump(std::ostream &out, const uint8_t* bytes, size_t length);
 }  // namespace tools
 }  // namespace oc
 
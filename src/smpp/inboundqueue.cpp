@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/inboundqueue.h"
+#include <algorithm>
+
+#include "smpp/clock.h"
+#include "smpp/smpp.h"
+
+namespace smpp {
+InboundQueue::InboundQueue(const size_t capacity) :
+    stats(), /**/
+    pausedSince(-1), /**/
+    metrics(0), /**/
+    reportedDepth(0) {
+    std::fill(capacities, capacities + KINDS, capacity);
+}
+
+InboundQueue::~InboundQueue() {
+    setMetrics(0);
+}
+
+InboundQueue::Kind InboundQueue::kindOf(const uint32_t commandId) {
+    if (commandId & GENERIC_NACK) {
+        return RESPONSES;
+    }
+
+    switch (commandId) {
+    case DELIVER_SM:
+    case DATA_SM:
+    case ALERT_NOTIFICATION:
+        return MESSAGES;
+
+    default:
+        return REQUESTS;
+    }
+}
+
+bool InboundQueue::push(const PDU &pdu) {
+    Kind kind = kindOf(pdu.getCommandId());
+    std::list<PDU> &queue = queues[kind];
+
+    if (queue.size() >= capacities[kind]) {
+        ++stats.overflows;
+
+        if (kind != RESPONSES || queue.empty()) {
+            return false;
+        }
+
+        queue.pop_front();
+    }
+
+    queue.push_back(pdu);
+    stats.peakDepth[kind] = std::max(stats.peakDepth[kind], queue.size());
+    update();
+    return true;
+}
+
+PDU InboundQueue::pop(const Kind kind) {
+    if (queues[kind].empty()) {
+        return PDU();
+    }
+
+    PDU pdu = queues[kind].front();
+    queues[kind].pop_front();
+    update();
+    return pdu;
+}
+
+InboundQueue::iterator InboundQueue::erase(const Kind kind, iterator it) {
+    iterator next = queues[kind].erase(it);
+    update();
+    return next;
+}
+
+void InboundQueue::setCapacity(const Kind kind, const size_t capacity) {
+    capacities[kind] = capacity;
+    update();
+}
+
+InboundQueueStats InboundQueue::getStats() const {
+    InboundQueueStats s = stats;
+
+    for (int i = 0; i < KINDS; ++i) {
+        s.depth[i] = queues[i].size();
+    }
+
+    if (isPaused()) {
+        s.pausedMicroseconds += MonotonicClock::nowMicros() - pausedSince;
+    }
+
+    return s;
+}
+
+void InboundQueue::setMetrics(Metrics* _metrics) {
+    if (metrics != 0) {
+        metrics->addInboundQueueDepth(-static_cast<int64_t>(reportedDepth));
+    }
+
+    metrics = _metrics;
+    reportedDepth = 0;
+    update();
+}
+
+void InboundQueue::update() {
+    if (metrics != 0) {
+        size_t depth = queues[RESPONSES].size() + queues[MESSAGES].size() + queues[REQUESTS].size();
+        metrics->addInboundQueueDepth(static_cast<int64_t>(depth) - static_cast<int64_t>(reportedDepth));
+        reportedDepth = depth;
+    }
+
+    bool full = queues[MESSAGES].size() >= capacities[MESSAGES] || queues[REQUESTS].size() >= capacities[REQUESTS];
+
+    if (full && !isPaused()) {
+        pausedSince = MonotonicClock::nowMicros();
+        ++stats.pauses;
+    } else if (!full && isPaused()) {
+        stats.pausedMicroseconds += MonotonicClock::nowMicros() - pausedSince;
+        pausedSince = -1;
+    }
+}
+}  // namespace smpp
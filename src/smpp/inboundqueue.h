@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_INBOUNDQUEUE_H_
+#define SMPP_INBOUNDQUEUE_H_
+
+#include <stdint.h>
+
+#include <list>
+
+#include "smpp/metrics.h"
+#include "smpp/pdu.h"
+
+namespace smpp {
+/**
+ * Counters of an InboundQueue.
+ */
+struct InboundQueueStats {
+    // Current and highest number of PDUs queued, by InboundQueue::Kind
+    size_t depth[3];
+    size_t peakDepth[3];
+    // PDUs which arrived while their queue was full
+    uint64_t overflows;
+    // Number of times the queue was paused, and the total time it was paused
+    uint64_t pauses;
+    uint64_t pausedMicroseconds;
+};
+
+/**
+ * Bounded queue of PDUs received from the SMSC, which have not been handled yet.
+ * PDUs are kept in a separate queue for each kind, so responses can be matched without walking past a backlog of
+ * messages. A queue is full when it holds its capacity of PDUs; while the queue of messages or requests is full the
+ * queue is paused, and the client should stop reading the socket, so TCP flow control makes the SMSC hold back
+ * further PDUs. Responses never pause the queue, as old ones are discarded to make room for new.
+ */
+class InboundQueue {
+  public:
+    enum Kind {
+        // Responses to our requests, and generic_nack
+        RESPONSES,
+        // deliver_sm, data_sm and alert_notification
+        MESSAGES,
+        // Other requests from the SMSC, ie. enquire_link and unbind
+        REQUESTS
+    };
+
+    typedef std::list<PDU>::iterator iterator;
+
+  private:
+    static const int KINDS = 3;
+
+    std::list<PDU> queues[KINDS];
+    size_t capacities[KINDS];
+    InboundQueueStats stats;
+    // Time the queue was paused as given by MonotonicClock, or -1 if it is not paused
+    int64_t pausedSince;
+    Metrics* metrics;
+    // Depth last added to the gauge of the metrics
+    size_t reportedDepth;
+
+  public:
+    /**
+     * @param capacity Maximum number of PDUs of each kind.
+     */
+    explicit InboundQueue(const size_t capacity = 1000);
+
+    /**
+     * Removes the PDUs still queued from the depth gauge of the metrics.
+     */
+    ~InboundQueue();
+
+    /**
+     * @return The kind of queue a PDU belongs in.
+     */
+    static Kind kindOf(const uint32_t commandId);
+
+    /**
+     * Appends a PDU to the queue of its kind. A response which does not fit replaces the oldest response, which
+     * is most likely one we stopped waiting for.
+     * @return False if the queue of the PDU is full and the PDU was not added.
+     */
+    bool push(const PDU &pdu);
+
+    /**
+     * Removes the first PDU of a kind.
+     * @return The PDU, or a null PDU if there was none.
+     */
+    PDU pop(const Kind kind);
+
+    iterator begin(const Kind kind) {
+        return queues[kind].begin();
+    }
+
+    iterator end(const Kind kind) {
+        return queues[kind].end();
+    }
+
+    /**
+     * Removes a PDU.
+     * @return Iterator to the next PDU of the same kind.
+     */
+    iterator erase(const Kind kind, iterator it);
+
+    size_t size(const Kind kind) const {
+        return queues[kind].size();
+    }
+
+    bool empty(const Kind kind) const {
+        return queues[kind].empty();
+    }
+
+    bool empty() const {
+        return queues[RESPONSES].empty() && queues[MESSAGES].empty() && queues[REQUESTS].empty();
+    }
+
+    /**
+     * @return True while the queue of messages or requests is full.
+     */
+    bool isPaused() const {
+        return pausedSince >= 0;
+    }
+
+    void setCapacity(const Kind kind, const size_t capacity);
+
+    size_t getCapacity(const Kind kind) const {
+        return capacities[kind];
+    }
+
+    /**
+     * @return The counters, with the time of the current pause included.
+     */
+    InboundQueueStats getStats() const;
+
+    /**
+     * Sets metrics whose inbound queue depth gauge the number of queued PDUs is added to. The metrics are not owned
+     * by the queue.
+     * @param metrics Metrics, or null to stop updating the gauge.
+     */
+    void setMetrics(Metrics* metrics);
+
+  private:
+    /**
+     * Starts or ends a pause when a queue becomes full or is no longer full, and updates the depth gauge.
+     */
+    void update();
+};
+}  // namespace smpp
+
+#endif  // SMPP_INBOUNDQUEUE_H_
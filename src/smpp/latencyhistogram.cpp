@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/latencyhistogram.h"
+#include <algorithm>
+#include <cmath>
+
+using std::memory_order_relaxed;
+
+namespace smpp {
+namespace {
+const uint64_t SUB_BUCKETS = 1 << LatencyHistogram::SUB_BUCKET_BITS;
+const uint64_t MAX_LATENCY = (1ULL << LatencyHistogram::MAX_BITS) - 1;
+}  // namespace
+
+LatencySnapshot::LatencySnapshot() :
+    counts(LatencyHistogram::BUCKETS), /**/
+    count(0), /**/
+    sum(0), /**/
+    max(0) {
+}
+
+void LatencySnapshot::merge(const LatencySnapshot &other) {
+    for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        counts[i] += other.counts[i];
+    }
+
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+uint64_t LatencySnapshot::getPercentile(const double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    // rank of the latency, counted from one
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::min(std::max(percentile, 0.0), 100.0) / 100 * count));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+
+    for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        seen += counts[i];
+
+        if (seen >= rank) {
+            return std::min(LatencyHistogram::upperBound(i) - 1, max);
+        }
+    }
+
+    // the counts were copied while latencies were recorded
+    return max;
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::record(const uint64_t micros) {
+    counts[bucketOf(micros)].fetch_add(1, memory_order_relaxed);
+    count.fetch_add(1, memory_order_relaxed);
+    sum.fetch_add(micros, memory_order_relaxed);
+    uint64_t highest = max.load(memory_order_relaxed);
+
+    while (micros > highest && !max.compare_exchange_weak(highest, micros, memory_order_relaxed)) {
+    }
+}
+
+LatencySnapshot LatencyHistogram::getSnapshot() const {
+    LatencySnapshot snapshot;
+
+    for (int i = 0; i < BUCKETS; ++i) {
+        snapshot.counts[i] = counts[i].load(memory_order_relaxed);
+    }
+
+    snapshot.count = count.load(memory_order_relaxed);
+    snapshot.sum = sum.load(memory_order_relaxed);
+    snapshot.max = max.load(memory_order_relaxed);
+    return snapshot;
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < BUCKETS; ++i) {
+        counts[i].store(0, memory_order_relaxed);
+    }
+
+    count.store(0, memory_order_relaxed);
+    sum.store(0, memory_order_relaxed);
+    max.store(0, memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketOf(uint64_t micros) {
+    if (micros < SUB_BUCKETS) {
+        return static_cast<int>(micros);
+    }
+
+    micros = std::min(micros, MAX_LATENCY);
+    // position of the highest bit, at least SUB_BUCKET_BITS
+    int bits = 63 - __builtin_clzll(micros);
+    int shift = bits - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) + static_cast<int>((micros >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::lowerBound(const int bucket) {
+    if (bucket < static_cast<int>(SUB_BUCKETS)) {
+        return bucket;
+    }
+
+    int shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    return (SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+}
+
+uint64_t LatencyHistogram::upperBound(const int bucket) {
+    if (bucket < static_cast<int>(SUB_BUCKETS)) {
+        return bucket + 1;
+    }
+
+    return lowerBound(bucket) + (1ULL << ((bucket >> SUB_BUCKET_BITS) - 1));
+}
+}  // namespace smpp
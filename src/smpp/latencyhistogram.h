@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_LATENCYHISTOGRAM_H_
+#define SMPP_LATENCYHISTOGRAM_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace smpp {
+/**
+ * Copy of the counts of a LatencyHistogram, which can be merged with snapshots of other histograms, ie. of other
+ * sessions, and read percentiles from.
+ */
+class LatencySnapshot {
+  private:
+    std::vector<uint64_t> counts;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+
+    friend class LatencyHistogram;
+
+  public:
+    LatencySnapshot();
+
+    /**
+     * Adds the counts of another snapshot to this one.
+     */
+    void merge(const LatencySnapshot &other);
+
+    /**
+     * @param percentile Percentile between 0 and 100, ie. 99.9.
+     * @return Microseconds which at least percentile percent of the latencies are at or below, within the precision
+     * of the histogram, or 0 if nothing was recorded.
+     */
+    uint64_t getPercentile(const double percentile) const;
+
+    /**
+     * @return Number of latencies recorded.
+     */
+    uint64_t getCount() const {
+        return count;
+    }
+
+    /**
+     * @return Mean latency in microseconds.
+     */
+    double getMean() const {
+        return count == 0 ? 0 : static_cast<double>(sum) / count;
+    }
+
+    /**
+     * @return Highest latency in microseconds.
+     */
+    uint64_t getMax() const {
+        return max;
+    }
+};
+
+/**
+ * Histogram of latencies in microseconds with log-linear buckets, as in HdrHistogram: latencies below 16 have a
+ * bucket each, above that every power of two is divided into 16 buckets, so a latency is known within 1/16th.
+ * Latencies up to 2^40 microseconds (about 12 days) are counted, longer ones in the last bucket.
+ *
+ * Latencies are recorded with a few relaxed atomic increments and without locks, so a histogram can be read from
+ * another thread than the one recording into it.
+ */
+class LatencyHistogram {
+  public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int MAX_BITS = 40;
+    static const int BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+  private:
+    std::atomic<uint64_t> counts[BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+  public:
+    LatencyHistogram();
+
+    /**
+     * Records a latency.
+     * @param micros Latency in microseconds.
+     */
+    void record(const uint64_t micros);
+
+    /**
+     * @return Copy of the counts. Latencies recorded while the copy is taken may be left out of some of the totals.
+     */
+    LatencySnapshot getSnapshot() const;
+
+    /**
+     * Clears the counts, ie. at the start of an interval.
+     */
+    void reset();
+
+    /**
+     * @return Index of the bucket of a latency.
+     */
+    static int bucketOf(uint64_t micros);
+
+    /**
+     * @return Lowest latency counted in a bucket.
+     */
+    static uint64_t lowerBound(const int bucket);
+
+    /**
+     * @return Latency just above the highest counted in a bucket.
+     */
+    static uint64_t upperBound(const int bucket);
+
+  private:
+    LatencyHistogram(const LatencyHistogram &);
+    LatencyHistogram &operator=(const LatencyHistogram &);
+};
+}  // namespace smpp
+
+#endif  // SMPP_LATENCYHISTOGRAM_H_
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/metrics.h"
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "smpp/smpp.h"
+
+using std::map;
+using std::memory_order_relaxed;
+using std::string;
+
+namespace smpp {
+namespace {
+// Commands in the counters above the contiguous range of 0x00 to 0x21
+const uint32_t HIGHEST_LOW_COMMAND = SUBMIT_MULTI;
+const int HIGH_COMMANDS_INDEX = HIGHEST_LOW_COMMAND + 1;
+const int RESPONSES_INDEX = Metrics::COMMANDS / 2;
+
+void addTo(map<uint32_t, uint64_t>* values, const map<uint32_t, uint64_t> &other) {
+    for (map<uint32_t, uint64_t>::const_iterator it = other.begin(); it != other.end(); ++it) {
+        (*values)[it->first] += it->second;
+    }
+}
+
+string hex(const uint32_t value) {
+    char s[11];
+    snprintf(s, sizeof(s), "0x%08x", value);
+    return s;
+}
+
+void formatHeader(std::ostream &out, const char* name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+}
+
+void formatSample(std::ostream &out, const char* name, const string &labels, const string &label, const int64_t value) {
+    out << name;
+
+    if (!labels.empty() || !label.empty()) {
+        out << "{" << labels << (!labels.empty() && !label.empty() ? "," : "") << label << "}";
+    }
+
+    out << " " << value << "\n";
+}
+
+void formatByCommand(std::ostream &out, const char* name, const char* help, const string &labels,
+                     const map<uint32_t, uint64_t> &values) {
+    formatHeader(out, name, "counter", help);
+
+    for (map<uint32_t, uint64_t>::const_iterator it = values.begin(); it != values.end(); ++it) {
+        formatSample(out, name, labels, "command=\"" + getCommandName(it->first) + "\"", it->second);
+    }
+}
+}  // namespace
+
+const uint32_t MetricsSnapshot::OTHER_STATUSES;
+
+MetricsSnapshot::MetricsSnapshot() :
+    pdusSent(), /**/
+    bytesSent(), /**/
+    pdusReceived(), /**/
+    bytesReceived(), /**/
+    responses(), /**/
+    reconnects(0), /**/
+    timeouts(0), /**/
+    windowOccupancy(0), /**/
+    inboundQueueDepth(0) {
+}
+
+void MetricsSnapshot::merge(const MetricsSnapshot &other) {
+    addTo(&pdusSent, other.pdusSent);
+    addTo(&bytesSent, other.bytesSent);
+    addTo(&pdusReceived, other.pdusReceived);
+    addTo(&bytesReceived, other.bytesReceived);
+    addTo(&responses, other.responses);
+    reconnects += other.reconnects;
+    timeouts += other.timeouts;
+    windowOccupancy += other.windowOccupancy;
+    inboundQueueDepth += other.inboundQueueDepth;
+}
+
+Metrics::Metrics() :
+    windowOccupancy(0), /**/
+    inboundQueueDepth(0) {
+    for (int i = 0; i < SHARDS; ++i) {
+        for (int j = 0; j < COUNTERS; ++j) {
+            shards[i].counters[j].store(0, memory_order_relaxed);
+        }
+    }
+}
+
+void Metrics::pduReceived(const uint32_t commandId, const uint32_t commandStatus, const size_t octets) {
+    add(PDUS_RECEIVED, BYTES_RECEIVED, commandId, octets);
+
+    if (commandId & GENERIC_NACK) {
+        increment(RESPONSES + (commandStatus < STATUSES - 1 ? commandStatus : STATUSES - 1), 1);
+    }
+}
+
+MetricsSnapshot Metrics::getSnapshot() const {
+    uint64_t totals[COUNTERS] = {};
+
+    for (int i = 0; i < SHARDS; ++i) {
+        for (int j = 0; j < COUNTERS; ++j) {
+            totals[j] += shards[i].counters[j].load(memory_order_relaxed);
+        }
+    }
+
+    MetricsSnapshot snapshot;
+
+    for (int i = 0; i < COMMANDS; ++i) {
+        uint32_t commandId = commandOf(i);
+
+        if (totals[PDUS_SENT + i] != 0) {
+            snapshot.pdusSent[commandId] = totals[PDUS_SENT + i];
+            snapshot.bytesSent[commandId] = totals[BYTES_SENT + i];
+        }
+
+        if (totals[PDUS_RECEIVED + i] != 0) {
+            snapshot.pdusReceived[commandId] = totals[PDUS_RECEIVED + i];
+            snapshot.bytesReceived[commandId] = totals[BYTES_RECEIVED + i];
+        }
+    }
+
+    for (int i = 0; i < STATUSES; ++i) {
+        if (totals[RESPONSES + i] != 0) {
+            snapshot.responses[i] = totals[RESPONSES + i];
+        }
+    }
+
+    snapshot.reconnects = totals[RECONNECTS];
+    snapshot.timeouts = totals[TIMEOUTS];
+    snapshot.windowOccupancy = windowOccupancy.load(memory_order_relaxed);
+    snapshot.inboundQueueDepth = inboundQueueDepth.load(memory_order_relaxed);
+    return snapshot;
+}
+
+int Metrics::commandIndex(const uint32_t commandId) {
+    uint32_t request = commandId & ~GENERIC_NACK;
+    int index;
+
+    if (request <= HIGHEST_LOW_COMMAND) {
+        index = request;
+    } else if (request == ALERT_NOTIFICATION || request == DATA_SM) {
+        index = HIGH_COMMANDS_INDEX + request - ALERT_NOTIFICATION;
+    } else {
+        return -1;
+    }
+
+    return commandId & GENERIC_NACK ? RESPONSES_INDEX + index : index;
+}
+
+uint32_t Metrics::commandOf(const int index) {
+    int request = index % RESPONSES_INDEX;
+    uint32_t commandId = request < HIGH_COMMANDS_INDEX ? request : ALERT_NOTIFICATION + request - HIGH_COMMANDS_INDEX;
+    return index >= RESPONSES_INDEX ? commandId | GENERIC_NACK : commandId;
+}
+
+int Metrics::shardIndex() {
+    static std::atomic<unsigned> threads(0);
+    static thread_local int index = threads.fetch_add(1, memory_order_relaxed) % SHARDS;
+    return index;
+}
+
+void Metrics::add(const int pdus, const int bytes, const uint32_t commandId, const size_t octets) {
+    int index = commandIndex(commandId);
+
+    if (index >= 0) {
+        Shard &shard = shards[shardIndex()];
+        shard.counters[pdus + index].fetch_add(1, memory_order_relaxed);
+        shard.counters[bytes + index].fetch_add(octets, memory_order_relaxed);
+    }
+}
+
+string formatPrometheus(const MetricsSnapshot &snapshot, const string &labels) {
+    std::ostringstream out;
+    formatByCommand(out, "smpp_pdus_sent_total", "PDUs sent by command.", labels, snapshot.pdusSent);
+    formatByCommand(out, "smpp_bytes_sent_total", "Octets sent by command.", labels, snapshot.bytesSent);
+    formatByCommand(out, "smpp_pdus_received_total", "PDUs received by command.", labels, snapshot.pdusReceived);
+    formatByCommand(out, "smpp_bytes_received_total", "Octets received by command.", labels,
+                    snapshot.bytesReceived);
+
+    formatHeader(out, "smpp_responses_total", "counter", "Responses received by command status.");
+
+    for (map<uint32_t, uint64_t>::const_iterator it = snapshot.responses.begin(); it != snapshot.responses.end();
+            ++it) {
+        // not a status of its own, so it is not labeled as one
+        string status = it->first == MetricsSnapshot::OTHER_STATUSES ? "other" : hex(it->first);
+        formatSample(out, "smpp_responses_total", labels, "status=\"" + status + "\"", it->second);
+    }
+
+    formatHeader(out, "smpp_reconnects_total", "counter", "Binds of a session which was bound before.");
+    formatSample(out, "smpp_reconnects_total", labels, "", snapshot.reconnects);
+    formatHeader(out, "smpp_timeouts_total", "counter", "Reads and writes which timed out.");
+    formatSample(out, "smpp_timeouts_total", labels, "", snapshot.timeouts);
+    formatHeader(out, "smpp_window_occupancy", "gauge", "Requests awaiting a response.");
+    formatSample(out, "smpp_window_occupancy", labels, "", snapshot.windowOccupancy);
+    formatHeader(out, "smpp_inbound_queue_depth", "gauge", "PDUs received and not yet handled.");
+    formatSample(out, "smpp_inbound_queue_depth", labels, "", snapshot.inboundQueueDepth);
+    return out.str();
+}
+}  // namespace smpp
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_METRICS_H_
+#define SMPP_METRICS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace smpp {
+/**
+ * Values of Metrics at one point in time. Only command ids and statuses which were counted are included.
+ */
+struct MetricsSnapshot {
+    // Key in responses of all statuses from 0x100, which includes the vendor specific ones
+    static const uint32_t OTHER_STATUSES = 0x100;
+
+    // PDUs and octets sent and received, by command id
+    std::map<uint32_t, uint64_t> pdusSent;
+    std::map<uint32_t, uint64_t> bytesSent;
+    std::map<uint32_t, uint64_t> pdusReceived;
+    std::map<uint32_t, uint64_t> bytesReceived;
+    // Responses received, by command status up to 0xFF and OTHER_STATUSES for the rest
+    std::map<uint32_t, uint64_t> responses;
+    // Binds of a session which was bound before
+    uint64_t reconnects;
+    // Reads and writes which timed out
+    uint64_t timeouts;
+    // Requests awaiting a response
+    int64_t windowOccupancy;
+    // PDUs received and not yet handled
+    int64_t inboundQueueDepth;
+
+    MetricsSnapshot();
+
+    /**
+     * Adds the values of another snapshot to this one, ie. to get the totals of a pool of sessions.
+     */
+    void merge(const MetricsSnapshot &other);
+};
+
+/**
+ * Counters and gauges of one or more sessions, which can share a Metrics object.
+ *
+ * Counters are incremented from any thread without locks. Each thread increments its own shard of the counters,
+ * so threads recording at the same time do not contend for cache lines, and the shards are summed when a snapshot
+ * is taken.
+ */
+class Metrics {
+  public:
+    static const int SHARDS = 8;
+    // Command ids 0x00 to 0x21, alert_notification and data_sm, and the responses to them
+    static const int COMMANDS = 72;
+    // Command statuses 0x00 to 0xFF, and MetricsSnapshot::OTHER_STATUSES
+    static const int STATUSES = MetricsSnapshot::OTHER_STATUSES + 1;
+
+  private:
+    enum {
+        PDUS_SENT = 0,
+        BYTES_SENT = PDUS_SENT + COMMANDS,
+        PDUS_RECEIVED = BYTES_SENT + COMMANDS,
+        BYTES_RECEIVED = PDUS_RECEIVED + COMMANDS,
+        RESPONSES = BYTES_RECEIVED + COMMANDS,
+        RECONNECTS = RESPONSES + STATUSES,
+        TIMEOUTS,
+        COUNTERS
+    };
+
+    struct Shard {
+        std::atomic<uint64_t> counters[COUNTERS];
+        // keeps the next shard off the last cache line of this one
+        char padding[64];
+    };
+
+    Shard shards[SHARDS];
+    std::atomic<int64_t> windowOccupancy;
+    std::atomic<int64_t> inboundQueueDepth;
+
+  public:
+    Metrics();
+
+    void pduSent(const uint32_t commandId, const size_t octets) {
+        add(PDUS_SENT, BYTES_SENT, commandId, octets);
+    }
+
+    /**
+     * Counts a received PDU, and its command status if it is a response.
+     */
+    void pduReceived(const uint32_t commandId, const uint32_t commandStatus, const size_t octets);
+
+    void reconnect() {
+        increment(RECONNECTS, 1);
+    }
+
+    void timeout() {
+        increment(TIMEOUTS, 1);
+    }
+
+    /**
+     * Changes the number of requests awaiting a response.
+     */
+    void addWindowOccupancy(const int64_t delta) {
+        windowOccupancy.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    /**
+     * Changes the number of PDUs received and not yet handled.
+     */
+    void addInboundQueueDepth(const int64_t delta) {
+        inboundQueueDepth.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    MetricsSnapshot getSnapshot() const;
+
+    /**
+     * @return Index of the counters of a command id, or -1 if it is not counted.
+     */
+    static int commandIndex(const uint32_t commandId);
+
+    /**
+     * @return Command id of an index of the counters.
+     */
+    static uint32_t commandOf(const int index);
+
+  private:
+    Metrics(const Metrics &);
+    Metrics &operator=(const Metrics &);
+
+    /**
+     * @return Shard of the calling thread.
+     */
+    static int shardIndex();
+
+    void increment(const int counter, const uint64_t n) {
+        shards[shardIndex()].counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void add(const int pdus, const int bytes, const uint32_t commandId, const size_t octets);
+};
+
+/**
+ * Formats a snapshot in the Prometheus text exposition format.
+ * @param snapshot Values to format.
+ * @param labels Labels added to every sample, ie. session="smsc1", or empty for none.
+ */
+std::string formatPrometheus(const MetricsSnapshot &snapshot, const std::string &labels = "");
+}  // namespace smpp
+
+#endif  // SMPP_METRICS_H_
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/multiparttracker.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace smpp {
+MultipartTracker::MultipartTracker(const size_t capacity, const uint32_t _ttl) :
+    segments(capacity, _ttl), /**/
+    ttl(_ttl), /**/
+    nextGroup(1), /**/
+    groups(), /**/
+    created(), /**/
+    mutex() {
+}
+
+bool MultipartTracker::track(const vector<string> &messageIds, const time_t now) {
+    if (messageIds.empty() || messageIds.size() > 0xff) {
+        return false;
+    }
+
+    boost::mutex::scoped_lock lock(mutex);
+
+    if (segments.size() + messageIds.size() > segments.capacity()) {
+        return false;
+    }
+
+    // an id which is already tracked would be taken from its group, which could then only expire
+    std::unordered_set<string> unique(messageIds.begin(), messageIds.end());
+    uint64_t value = 0;
+
+    if (unique.size() != messageIds.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < messageIds.size(); ++i) {
+        if (segments.find(messageIds[i], &value)) {
+            return false;
+        }
+    }
+
+    uint64_t group = nextGroup++;
+
+    // the value of a segment is the group in the upper bits and the segment number in the lower 8 bits
+    for (size_t i = 0; i < messageIds.size(); ++i) {
+        const string &id = messageIds[i];
+
+        if (!segments.insert(id.data(), id.length(), (group << 8) | i, now)) {
+            while (i-- > 0) {
+                segments.remove(messageIds[i], 0);
+            }
+
+            return false;
+        }
+    }
+
+    Group &g = groups[group];
+    g.messageId = messageIds.back();
+    g.segments = static_cast<uint8_t>(messageIds.size());
+    g.delivered = 0;
+    g.failed = 0;
+    g.error = 0;
+    created.push_back(std::make_pair(now, group));
+    return true;
+}
+
+bool MultipartTracker::onReceipt(const receipt::Receipt &receipt, MultipartOutcome* outcome) {
+    if (receipt.state == STATE_ENROUTE || receipt.state == 0) {
+        return false;
+    }
+
+    boost::mutex::scoped_lock lock(mutex);
+    uint64_t value = 0;
+
+    // removes the segment, so a repeated receipt is not counted twice
+    if (!segments.resolve(receipt, &value)) {
+        return false;
+    }
+
+    std::unordered_map<uint64_t, Group>::iterator it = groups.find(value >> 8);
+
+    if (it == groups.end()) {
+        return false;
+    }
+
+    Group &group = it->second;
+
+    if (receipt.state == STATE_DELIVERED || receipt.state == STATE_ACCEPTED) {
+        ++group.delivered;
+    } else {
+        if (group.failed++ == 0) {
+            group.error = receipt.error;
+        }
+    }
+
+    if (group.delivered + group.failed < group.segments) {
+        return false;
+    }
+
+    *outcome = outcomeOf(group, false);
+    groups.erase(it);
+    return true;
+}
+
+vector<MultipartOutcome> MultipartTracker::expire(const time_t now) {
+    boost::mutex::scoped_lock lock(mutex);
+    vector<MultipartOutcome> outcomes;
+    segments.expire(now);
+
+    while (!created.empty() && created.front().first + ttl <= now) {
+        std::unordered_map<uint64_t, Group>::iterator it = groups.find(created.front().second);
+        created.pop_front();
+
+        // groups which completed are already gone
+        if (it != groups.end()) {
+            outcomes.push_back(outcomeOf(it->second, true));
+            groups.erase(it);
+        }
+    }
+
+    return outcomes;
+}
+
+MultipartOutcome MultipartTracker::outcomeOf(const Group &group, const bool expired) {
+    MultipartOutcome outcome;
+    outcome.messageId = group.messageId;
+    outcome.segments = group.segments;
+    outcome.delivered = group.delivered;
+    outcome.failed = group.failed;
+    outcome.error = group.error;
+    outcome.expired = expired;
+
+    if (group.delivered == group.segments) {
+        outcome.status = MultipartOutcome::DELIVERED;
+    } else if (group.delivered == 0) {
+        outcome.status = MultipartOutcome::FAILED;
+    } else {
+        outcome.status = MultipartOutcome::PARTIAL;
+    }
+
+    return outcome;
+}
+}  // namespace smpp
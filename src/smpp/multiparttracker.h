@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_MULTIPARTTRACKER_H_
+#define SMPP_MULTIPARTTRACKER_H_
+
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
+
+#include <ctime>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "smpp/clock.h"
+#include "smpp/correlationstore.h"
+#include "smpp/receipt.h"
+
+namespace smpp {
+/**
+ * Aggregated outcome of all segments of a message.
+ */
+struct MultipartOutcome {
+    enum {
+        DELIVERED, PARTIAL, FAILED
+    };
+
+    // Message id returned by sendSms, which is the id of the last segment
+    std::string messageId;
+    uint8_t segments;
+    uint8_t delivered;
+    uint8_t failed;
+    // DELIVERED if all segments were delivered, FAILED if none were, otherwise PARTIAL
+    int status;
+    // Error of the first failed segment
+    uint16_t error;
+    // True if the outcome was emitted because the message expired before all receipts arrived
+    bool expired;
+
+    MultipartOutcome() :
+        messageId(), segments(0), delivered(0), failed(0), status(FAILED), error(0), expired(false) {
+    }
+};
+
+/**
+ * Tracks the message ids of all segments of concatenated messages and aggregates their delivery receipts, so one
+ * outcome is emitted per message when the receipt of its last segment arrives. Single part messages are tracked as
+ * well, so every message produces exactly one outcome.
+ *
+ * Segment ids are kept in a CorrelationStore; the tracker is thread safe, so segments can be tracked from the
+ * sending thread while receipts are processed on another.
+ */
+class MultipartTracker {
+  private:
+    struct Group {
+        std::string messageId;
+        uint8_t segments;
+        uint8_t delivered;
+        uint8_t failed;
+        uint16_t error;
+    };
+
+    CorrelationStore segments;
+    uint32_t ttl;
+    uint64_t nextGroup;
+    std::unordered_map<uint64_t, Group> groups;
+    // Groups by creation time, for expiry
+    std::deque<std::pair<time_t, uint64_t> > created;
+    boost::mutex mutex;
+
+  public:
+    /**
+     * @param capacity Maximum number of segments being tracked.
+     * @param ttl Seconds to wait for receipts, 72 hours by default.
+     */
+    explicit MultipartTracker(const size_t capacity, const uint32_t ttl = 72 * 3600);
+
+    /**
+     * Starts tracking a message.
+     * @param messageIds Message ids of the segments, in order.
+     * @param now Current time in seconds since the epoch.
+     * @return False if the message has no or more than 255 segments, a message id is repeated or already tracked,
+     * or there is no room for it.
+     */
+    bool track(const std::vector<std::string> &messageIds, const time_t now);
+
+    bool track(const std::vector<std::string> &messageIds) {
+        return track(messageIds, CoarseClock::now());
+    }
+
+    /**
+     * Processes the receipt of a segment.
+     * @param receipt Decoded receipt.
+     * @param outcome Set to the outcome of the message, if this was the last segment.
+     * @return True if all segments of the message have a final state and outcome was set.
+     */
+    bool onReceipt(const receipt::Receipt &receipt, MultipartOutcome* outcome);
+
+    /**
+     * Emits the outcome of the messages which did not get all receipts within the ttl.
+     * @param now Current time in seconds since the epoch.
+     * @return Outcomes of the expired messages.
+     */
+    std::vector<MultipartOutcome> expire(const time_t now);
+
+    size_t size() {
+        boost::mutex::scoped_lock lock(mutex);
+        return groups.size();
+    }
+
+  private:
+    static MultipartOutcome outcomeOf(const Group &group, const bool expired);
+};
+}  // namespace smpp
+
+#endif  // SMPP_MULTIPARTTRACKER_H_
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/pcapwriter.h"
+#include <errno.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "smpp/clock.h"
+#include "smpp/exceptions.h"
+
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::memory_order_release;
+using std::string;
+
+namespace smpp {
+namespace {
+// Link type of packets starting with an IPv4 or IPv6 header
+const uint32_t LINKTYPE_RAW = 101;
+const uint32_t SNAPLEN = 65535;
+// Largest PDU carried in one TCP segment, larger ones are split
+const size_t MAX_SEGMENT = 65000;
+const size_t TCP_HEADER_SIZE = 20;
+const uint8_t PROTOCOL_TCP = 6;
+
+struct FileHeader {
+    uint32_t magic;
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    int32_t zone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct RecordHeader {
+    int64_t timestamp;
+    uint32_t length;
+    uint32_t sent;
+};
+
+size_t powerOfTwo(const size_t n) {
+    size_t size = 1;
+
+    while (size < n) {
+        size <<= 1;
+    }
+
+    return size;
+}
+
+void put16(uint8_t* p, const uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+void put32(uint8_t* p, const uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+// Ones' complement sum of big endian 16 bit words, as used by the IP and TCP checksums
+uint32_t sum16(const uint8_t* data, const size_t length, uint32_t sum) {
+    for (size_t i = 0; i + 1 < length; i += 2) {
+        sum += (data[i] << 8) | data[i + 1];
+    }
+
+    if (length & 1) {
+        sum += data[length - 1] << 8;
+    }
+
+    return sum;
+}
+
+uint16_t checksum(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return ~sum;
+}
+
+// Copies an address in network order, and returns its length
+size_t addressBytes(const boost::asio::ip::address &address, uint8_t* bytes) {
+    if (address.is_v4()) {
+        boost::asio::ip::address_v4::bytes_type b = address.to_v4().to_bytes();
+        std::copy(b.begin(), b.end(), bytes);
+        return b.size();
+    }
+
+    boost::asio::ip::address_v6::bytes_type b = address.to_v6().to_bytes();
+    std::copy(b.begin(), b.end(), bytes);
+    return b.size();
+}
+}  // namespace
+
+PcapWriter::PcapWriter(const string &path, const boost::asio::ip::tcp::endpoint &_local,
+                       const boost::asio::ip::tcp::endpoint &_remote, const size_t bufferSize) :
+    local(_local), /**/
+    remote(_remote), /**/
+    file(0), /**/
+    ring(new uint8_t[powerOfTwo(std::max<size_t>(bufferSize, 4096))]), /**/
+    mask(powerOfTwo(std::max<size_t>(bufferSize, 4096)) - 1), /**/
+    produced(0), /**/
+    consumed(0), /**/
+    dropped(0), /**/
+    running(true), /**/
+    epochOffset(0), /**/
+    localSequence(1), /**/
+    remoteSequence(1), /**/
+    ipId(0), /**/
+    writer() {
+    if (local.address().is_v4() != remote.address().is_v4()) {
+        throw SmppException("PcapWriter needs endpoints of the same address family");
+    }
+
+    file = fopen(path.c_str(), "wb");
+
+    if (file == 0) {
+        throw SmppException("PcapWriter failed to create " + path + ": " + strerror(errno));
+    }
+
+    // written in host byte order, which readers tell from the magic number
+    FileHeader header = {0xA1B2C3D4, 2, 4, 0, 0, SNAPLEN, LINKTYPE_RAW};
+    fwrite(&header, sizeof(header), 1, file);
+
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    epochOffset = static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000 - MonotonicClock::nowMicros();
+    writer = boost::thread(&PcapWriter::run, this);
+}
+
+PcapWriter::~PcapWriter() {
+    running.store(false, memory_order_release);
+    writer.join();
+    fclose(file);
+}
+
+void PcapWriter::record(const bool sent, const uint8_t* first, const size_t firstLength, const uint8_t* second,
+                        const size_t secondLength) {
+    RecordHeader header = {MonotonicClock::nowMicros(), static_cast<uint32_t>(firstLength + secondLength), sent};
+    uint64_t position = produced.load(memory_order_relaxed);
+    size_t size = sizeof(header) + header.length;
+
+    if (position + size - consumed.load(memory_order_acquire) > mask + 1) {
+        dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    copyIn(position, reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    copyIn(position + sizeof(header), first, firstLength);
+    copyIn(position + sizeof(header) + firstLength, second, secondLength);
+    produced.store(position + size, memory_order_release);
+}
+
+void PcapWriter::copyIn(uint64_t position, const uint8_t* data, size_t length) {
+    while (length != 0) {
+        size_t offset = position & mask;
+        size_t n = std::min(length, mask + 1 - offset);
+        memcpy(ring.get() + offset, data, n);
+        position += n;
+        data += n;
+        length -= n;
+    }
+}
+
+void PcapWriter::copyOut(uint64_t position, uint8_t* data, size_t length) const {
+    while (length != 0) {
+        size_t offset = position & mask;
+        size_t n = std::min(length, mask + 1 - offset);
+        memcpy(data, ring.get() + offset, n);
+        position += n;
+        data += n;
+        length -= n;
+    }
+}
+
+void PcapWriter::run() {
+    uint64_t position = consumed.load(memory_order_relaxed);
+
+    for (;;) {
+        // the flag is read first, so records made before it was cleared are seen below
+        bool stopping = !running.load(memory_order_acquire);
+        uint64_t end = produced.load(memory_order_acquire);
+
+        if (position != end) {
+            position = drain(position, end);
+            continue;
+        }
+
+        fflush(file);
+
+        if (stopping) {
+            break;
+        }
+
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+}
+
+uint64_t PcapWriter::drain(uint64_t from, const uint64_t to) {
+    std::vector<uint8_t> pdu;
+
+    while (from < to) {
+        RecordHeader header;
+        copyOut(from, reinterpret_cast<uint8_t*>(&header), sizeof(header));
+        pdu.resize(std::max<size_t>(header.length, 1));
+        copyOut(from + sizeof(header), &pdu[0], header.length);
+        from += sizeof(header) + header.length;
+        // the space is free as soon as the record is copied
+        consumed.store(from, memory_order_release);
+        writePackets(header.sent != 0, header.timestamp + epochOffset, &pdu[0], header.length);
+    }
+
+    return from;
+}
+
+void PcapWriter::writePackets(const bool sent, const int64_t timestamp, const uint8_t* data, size_t length) {
+    const boost::asio::ip::tcp::endpoint &source = sent ? local : remote;
+    const boost::asio::ip::tcp::endpoint &destination = sent ? remote : local;
+    uint32_t &sequence = sent ? localSequence : remoteSequence;
+    uint32_t acknowledged = sent ? remoteSequence : localSequence;
+    bool v4 = source.address().is_v4();
+    size_t ipHeaderSize = v4 ? 20 : 40;
+
+    do {
+        size_t segment = std::min(length, MAX_SEGMENT);
+        uint8_t headers[40 + TCP_HEADER_SIZE] = {};
+        uint8_t* ip = headers;
+        uint8_t* tcp = headers + ipHeaderSize;
+        uint8_t addresses[32];
+        size_t addressSize = addressBytes(source.address(), addresses);
+        addressBytes(destination.address(), addresses + addressSize);
+
+        if (v4) {
+            ip[0] = 0x45;
+            put16(ip + 2, ipHeaderSize + TCP_HEADER_SIZE + segment);
+            put16(ip + 4, ipId++);
+            ip[6] = 0x40;  // don't fragment
+            ip[8] = 64;
+            ip[9] = PROTOCOL_TCP;
+            memcpy(ip + 12, addresses, 8);
+            put16(ip + 10, checksum(sum16(ip, ipHeaderSize, 0)));
+        } else {
+            ip[0] = 0x60;
+            put16(ip + 4, TCP_HEADER_SIZE + segment);
+            ip[6] = PROTOCOL_TCP;
+            ip[7] = 64;
+            memcpy(ip + 8, addresses, 32);
+        }
+
+        put16(tcp, source.port());
+        put16(tcp + 2, destination.port());
+        put32(tcp + 4, sequence);
+        put32(tcp + 8, acknowledged);
+        tcp[12] = (TCP_HEADER_SIZE / 4) << 4;
+        tcp[13] = 0x18;  // PSH, ACK
+        put16(tcp + 14, 0xFFFF);
+
+        // pseudo header of source and destination address, protocol and TCP length, then the segment
+        uint32_t sum = sum16(addresses, 2 * addressSize, PROTOCOL_TCP + TCP_HEADER_SIZE + segment);
+        sum = sum16(tcp, TCP_HEADER_SIZE, sum);
+        put16(tcp + 16, checksum(sum16(data, segment, sum)));
+
+        // segments are small enough for the whole packet to be within the snaplen
+        uint32_t packetSize = ipHeaderSize + TCP_HEADER_SIZE + segment;
+        uint32_t record[4] = {static_cast<uint32_t>(timestamp / 1000000), static_cast<uint32_t>(timestamp % 1000000),
+                              packetSize, packetSize};
+        fwrite(record, sizeof(record), 1, file);
+        fwrite(headers, ipHeaderSize + TCP_HEADER_SIZE, 1, file);
+        fwrite(data, segment, 1, file);
+
+        sequence += segment;
+        data += segment;
+        length -= segment;
+    } while (length != 0);
+}
+}  // namespace smpp
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_PCAPWRITER_H_
+#define SMPP_PCAPWRITER_H_
+
+#include <stdint.h>
+#include <boost/asio.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+namespace smpp {
+/**
+ * Writes the traffic of a session to a pcap file, which can be opened in Wireshark or tcpdump.
+ *
+ * Each PDU becomes a TCP segment between the endpoints of the session, with IPv4 or IPv6 and TCP headers made up
+ * to match, sequence numbers counting the bytes sent each way, and the time it was recorded on the monotonic clock.
+ * There is no handshake, so Wireshark needs "Decode As SMPP" unless the SMSC uses port 2775.
+ *
+ * PDUs are copied into a ring buffer without locks, and a background thread writes them to the file. If the thread
+ * falls behind and the ring is full, PDUs are dropped rather than the session being slowed down. Only one thread at
+ * a time may record, which the client ensures by recording from the thread doing I/O.
+ */
+class PcapWriter {
+  private:
+    boost::asio::ip::tcp::endpoint local;
+    boost::asio::ip::tcp::endpoint remote;
+    FILE* file;
+
+    // Ring of records: the monotonic time, length and direction of a PDU followed by its bytes
+    boost::scoped_array<uint8_t> ring;
+    size_t mask;
+    // Bytes written to and read from the ring, only ever increasing
+    std::atomic<uint64_t> produced;
+    std::atomic<uint64_t> consumed;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> running;
+
+    // Wall clock time of the monotonic time zero, in microseconds
+    int64_t epochOffset;
+    // Next TCP sequence number each way
+    uint32_t localSequence;
+    uint32_t remoteSequence;
+    uint16_t ipId;
+
+    boost::thread writer;
+
+  public:
+    /**
+     * Creates the file and starts the writer thread.
+     * @param path File to write, which is truncated if it exists.
+     * @param local Local endpoint of the session, ie. socket->local_endpoint().
+     * @param remote Endpoint of the SMSC, ie. socket->remote_endpoint().
+     * @param bufferSize Size of the ring buffer in bytes, rounded up to a power of two.
+     * @throw SmppException if the file cannot be created.
+     */
+    PcapWriter(const std::string &path, const boost::asio::ip::tcp::endpoint &local,
+               const boost::asio::ip::tcp::endpoint &remote, const size_t bufferSize = 4 << 20);
+
+    /**
+     * Writes the PDUs still in the ring and closes the file.
+     */
+    ~PcapWriter();
+
+    /**
+     * Records a PDU given in two parts, ie. its length field and the rest.
+     * @param sent True if the PDU was sent to the SMSC, false if it was received.
+     */
+    void record(const bool sent, const uint8_t* first, const size_t firstLength, const uint8_t* second,
+                const size_t secondLength);
+
+    void record(const bool sent, const uint8_t* pdu, const size_t length) {
+        record(sent, pdu, length, 0, 0);
+    }
+
+    /**
+     * @return Number of PDUs dropped because the ring was full.
+     */
+    uint64_t getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    PcapWriter(const PcapWriter &);
+    PcapWriter &operator=(const PcapWriter &);
+
+    void copyIn(uint64_t position, const uint8_t* data, size_t length);
+
+    void copyOut(uint64_t position, uint8_t* data, size_t length) const;
+
+    /**
+     * Body of the writer thread.
+     */
+    void run();
+
+    /**
+     * Writes the records between two positions of the ring.
+     * @return Position after the last record written.
+     */
+    uint64_t drain(uint64_t from, const uint64_t to);
+
+    /**
+     * Writes one or more packets carrying a PDU.
+     */
+    void writePackets(const bool sent, const int64_t timestamp, const uint8_t* data, size_t length);
+};
+}  // namespace smpp
+
+#endif  // SMPP_PCAPWRITER_H_
@@ -7,6 +7,8 @@
 #include "smpp/pdu.h"
 #include <string>
 
+#include "smpp/tagregistry.h"
+
 using std::ios;
 using std::ios_base;
 using std::ends;
@@ -19,12 +21,12 @@ using boost::shared_array;
 namespace smpp {
 
 PDU::PDU() :
-    sb(""), buf(&sb), cmdId(0), cmdStatus(0), seqNo(0), nullTerminateOctetStrings(true), null(true) {
+    sb(""), buf(&sb), cmdId(0), cmdStatus(0), seqNo(0), nullTerminateOctetStrings(true), raw(), null(true) {
 }
 
 PDU::PDU(const uint32_t &_cmdId, const uint32_t &_cmdStatus, const uint32_t &_seqNo) :
-    sb(""), buf(&sb), cmdId(_cmdId), cmdStatus(_cmdStatus), seqNo(_seqNo), nullTerminateOctetStrings(true), null(
-        false) {
+    sb(""), buf(&sb), cmdId(_cmdId), cmdStatus(_cmdStatus), seqNo(_seqNo), nullTerminateOctetStrings(true), raw(),
+    null(false) {
     (*this) << uint32_t(0);
     (*this) << cmdId;
     (*this) << cmdStatus;
@@ -32,7 +34,8 @@ PDU::PDU(const uint32_t &_cmdId, const uint32_t &_cmdStatus, const uint32_t &_se
 }
 
 PDU::PDU(const shared_array<uint8_t> &pduLength, const shared_array<uint8_t> &pduBuffer) :
-    sb(""), buf(&sb), cmdId(0), cmdStatus(0), seqNo(0), nullTerminateOctetStrings(true), null(false) {
+    sb(""), buf(&sb), cmdId(0), cmdStatus(0), seqNo(0), nullTerminateOctetStrings(true), raw(pduBuffer),
+    null(false) {
     uint32_t bufSize = PDU::getPduLength(pduLength);
     buf.write(reinterpret_cast<char*>(pduLength.get()), HEADERFIELD_SIZE);
 
@@ -64,6 +67,7 @@ PDU::PDU(const PDU &rhs) :
     cmdStatus(rhs.cmdStatus), /**/
     seqNo(rhs.seqNo), /**/
     nullTerminateOctetStrings(rhs.nullTerminateOctetStrings), /**/
+    raw(rhs.raw), /**/
     null(rhs.null) {
     resetMarker();  // remember to reset the marker after copying.
 }
@@ -92,6 +96,10 @@ const shared_array<uint8_t> PDU::getOctets() {
     return octets;
 }
 
+const shared_array<uint8_t> &PDU::getRawBuffer() const {
+    return raw;
+}
+
 int PDU::getSize() {
     buf.seekp(0, ios_base::end);
     int s = buf.tellp();
@@ -183,19 +191,23 @@ PDU &PDU::operator <<(const smpp::SmppAddress s) {
     return *this;
 }
 
-PDU &PDU::operator <<(smpp::TLV tlv) {
+PDU &PDU::operator <<(const smpp::TLV &tlv) {
     (*this) << tlv.getTag();
     (*this) << tlv.getLen();
 
     if (tlv.getLen() != 0) {
-        (*this).addOctets(tlv.getOctets(), (uint32_t) tlv.getLen());
+        (*this).addOctets(tlv.getData(), (uint32_t) tlv.getLen());
     }
 
     return *this;
 }
 
 PDU &PDU::addOctets(const shared_array<uint8_t> &octets, const streamsize &len) {
-    buf.write(reinterpret_cast<char*>(octets.get()), len);
+    return addOctets(octets.get(), len);
+}
+
+PDU &PDU::addOctets(const uint8_t* octets, const streamsize &len) {
+    buf.write(reinterpret_cast<const char*>(octets), len);
 
     if (buf.fail()) {
         throw smpp::SmppException("PDU failed to write octets");
@@ -270,8 +282,49 @@ PDU &PDU::operator>>(std::basic_string<char> &s) {
     return *this;
 }
 
+PDU &PDU::operator>>(smpp::TLV &tlv) {
+    uint16_t tag;
+    uint16_t len;
+    (*this) >> tag;
+    (*this) >> len;
+
+    // a zero tag is padding at the end of the PDU
+    if (tag != 0) {
+        validateTlv(tag, len);
+    }
+
+    if (len <= TLV::INLINE_SIZE) {
+        tlv = TLV(tag);
+        tlv.len = len;
+        readOctets(tlv.inlineOctets, len);
+        return *this;
+    }
+
+    if (!raw) {
+        shared_array<uint8_t> value(new uint8_t[len]);
+        readOctets(value, len);
+        tlv = TLV(tag, len, value);
+        return *this;
+    }
+
+    // refer to the received buffer, which starts after the command length
+    streamsize pos = buf.tellg();
+
+    if (pos < 0 || pos + len > getSize()) {
+        throw smpp::SmppException("PDU reached EOF");
+    }
+
+    tlv = TLV(tag, len, raw, static_cast<uint32_t>(pos - HEADERFIELD_SIZE));
+    skip(len);
+    return *this;
+}
+
 void PDU::readOctets(shared_array<uint8_t> &octets, const streamsize &len) {
-    buf.readsome(reinterpret_cast<char*>(octets.get()), len);
+    readOctets(octets.get(), len);
+}
+
+void PDU::readOctets(uint8_t* octets, const streamsize &len) {
+    buf.readsome(reinterpret_cast<char*>(octets), len);
 
     if (buf.fail()) {
         throw smpp::SmppException(buf.eof() ? "PDU reached EOF" : "Last PDU IO operation failed");
@@ -300,7 +353,7 @@ std::ostream &smpp::operator<<(std::ostream &out, smpp::PDU &pdu) {
     out << "size      :" << pdu.getSize() << endl << "sequence  :" << pdu.getSequenceNo() << endl << "cmd id    :0x"
         << hex << pdu.getCommandId() << dec << endl << "cmd status:0x" << hex << pdu.getCommandStatus() << dec << " : "
         << smpp::getEsmeStatus(pdu.getCommandStatus()) << endl;
-    out << oc::tools::hexdump(pdu.getOctets().get(), static_cast<size_t>(size));
+    oc::tools::hexdump(out, pdu.getOctets().get(), static_cast<size_t>(size));
     return out;
 }
 
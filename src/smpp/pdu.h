@@ -37,6 +37,7 @@ class PDU {
     uint32_t cmdStatus;
     uint32_t seqNo;
     bool nullTerminateOctetStrings;
+    boost::shared_array<uint8_t> raw;
 
   public:
     bool null;
@@ -72,6 +73,13 @@ class PDU {
      */
     const boost::shared_array<uint8_t> getOctets();
 
+    /**
+     * Returns the buffer the PDU was received in, which starts at the command id (after the command length).
+     * The buffer is shared, not copied, so views on the PDU can be created without copying it.
+     * @return Received octets, or a null array if the PDU was not constructed from binary data.
+     */
+    const boost::shared_array<uint8_t> &getRawBuffer() const;
+
     /**
      * @return PDU size in octets.
      */
@@ -111,8 +119,9 @@ class PDU {
     PDU &operator<<(const std::basic_string<char> &s);
 
     PDU &operator<<(const smpp::SmppAddress);
-    PDU &operator<<(const smpp::TLV);
+    PDU &operator<<(const smpp::TLV &);
     PDU &addOctets(const boost::shared_array<uint8_t> &octets, const std::streamsize &len);
+    PDU &addOctets(const uint8_t* octets, const std::streamsize &len);
 
     /**
      * Skips n octets.
@@ -131,12 +140,20 @@ class PDU {
     PDU &operator>>(uint32_t &i);
     PDU &operator>>(std::basic_string<char> &s);
 
+    /**
+     * Reads a TLV. Values too large to be stored inside the TLV refer to the received buffer instead of being
+     * copied, if the PDU was constructed from binary data.
+     * @throw SmppException if the length is invalid for a known tag, see validateTlv.
+     */
+    PDU &operator>>(smpp::TLV &tlv);
+
     /**
      * Copy n octet into an array.
      * @param array Target array.
      * @param n Octets to copy.
      */
     void readOctets(boost::shared_array<uint8_t> &octets, const std::streamsize &n);
+    void readOctets(uint8_t* octets, const std::streamsize &n);
 
     /**
      * @return True if the read marker is not at the end of the PDU.
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/receipt.h"
+#include <cstring>
+#include <string>
+
+using std::string;
+
+namespace smpp {
+namespace receipt {
+namespace {
+inline bool isSpace(const char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline char toLower(const char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+/*
+ * Matches a lower case key followed by a colon at pos. A space in the key matches any run of spaces and
+ * underscores, including none. Returns the position after the colon, or null if the key does not match.
+ */
+const char* matchKey(const char* pos, const char* end, const char* key) {
+    while (*key != '\0') {
+        if (*key == ' ') {
+            while (pos < end && (*pos == ' ' || *pos == '_')) {
+                ++pos;
+            }
+
+            ++key;
+            continue;
+        }
+
+        if (pos == end || toLower(*pos) != *key) {
+            return 0;
+        }
+
+        ++pos;
+        ++key;
+    }
+
+    if (pos == end || *pos != ':') {
+        return 0;
+    }
+
+    return pos + 1;
+}
+
+inline bool isFailure(const uint8_t state) {
+    return state == STATE_EXPIRED || state == STATE_DELETED || state == STATE_UNDELIVERABLE
+           || state == STATE_UNKNOWN || state == STATE_REJECTED;
+}
+
+inline TextRange valueOf(const TLV* tlv) {
+    return tlv != 0 ? TextRange(reinterpret_cast<const char*>(tlv->getData()), tlv->getLen()) : TextRange();
+}
+
+/*
+ * Decodes a receipt from the values of its TLVs, which are empty if not present, and falls back to the text.
+ */
+bool decode(const TextRange &id, const TextRange &state, const TextRange &networkError, const TextRange &text,
+            Receipt* receipt) {
+    *receipt = Receipt();
+    // C-Octet string, the null terminator is optional in practice
+    receipt->id.assign(id.data, id.empty() ? 0 : strnlen(id.data, id.length));
+
+    if (state.length == 1) {
+        receipt->state = static_cast<uint8_t>(state.data[0]);
+    }
+
+    bool hasError = networkError.length == 3;
+
+    if (hasError) {
+        const uint8_t* octets = reinterpret_cast<const uint8_t*>(networkError.data);
+        receipt->networkType = octets[0];
+        receipt->error = static_cast<uint16_t>((octets[1] << 8) | octets[2]);
+    }
+
+    if (receipt->id.empty() || receipt->state == 0 || (!hasError && isFailure(receipt->state))) {
+        ReceiptText fields;
+
+        if (scanText(text.data, text.length, &fields)) {
+            if (receipt->id.empty()) {
+                receipt->id = fields.id.str();
+            }
+
+            if (receipt->state == 0) {
+                receipt->state = parseStat(fields.stat);
+            }
+
+            if (!hasError) {
+                receipt->error = static_cast<uint16_t>(parseDecimal(fields.err));
+            }
+        }
+    }
+
+    return !receipt->id.empty() && receipt->state != 0;
+}
+}  // namespace
+
+bool scanText(const char* data, const size_t length, ReceiptText* fields) {
+    *fields = ReceiptText();
+    const char* pos = data;
+    const char* end = data + length;
+
+    while (pos < end) {
+        if (isSpace(*pos)) {
+            ++pos;
+            continue;
+        }
+
+        TextRange* field = 0;
+        const char* value = 0;
+
+        switch (toLower(*pos)) {
+        case 'i':
+            if ((value = matchKey(pos, end, "id")) != 0) {
+                field = &fields->id;
+            }
+
+            break;
+
+        case 's':
+            // "submit date" must be tried before "sub"
+            if ((value = matchKey(pos, end, "submit date")) != 0) {
+                field = &fields->submitDate;
+            } else if ((value = matchKey(pos, end, "sub")) != 0) {
+                field = &fields->sub;
+            } else if ((value = matchKey(pos, end, "stat")) != 0) {
+                field = &fields->stat;
+            }
+
+            break;
+
+        case 'd':
+            if ((value = matchKey(pos, end, "dlvrd")) != 0) {
+                field = &fields->dlvrd;
+            } else if ((value = matchKey(pos, end, "done date")) != 0) {
+                field = &fields->doneDate;
+            }
+
+            break;
+
+        case 'e':
+            if ((value = matchKey(pos, end, "err")) != 0) {
+                field = &fields->err;
+            }
+
+            break;
+
+        case 't':
+            // the text runs to the end of the receipt
+            if ((value = matchKey(pos, end, "text")) != 0) {
+                fields->text = TextRange(value, end - value);
+                pos = end;
+                continue;
+            }
+
+            break;
+        }
+
+        const char* start = (field != 0) ? value : pos;
+
+        for (pos = start; pos < end && !isSpace(*pos); ++pos) {
+        }
+
+        if (field != 0) {
+            *field = TextRange(start, pos - start);
+        }
+    }
+
+    return !fields->id.empty() && !fields->stat.empty();
+}
+
+uint32_t parseDecimal(const TextRange &range) {
+    uint32_t value = 0;
+
+    for (size_t i = 0; i < range.length; ++i) {
+        unsigned int digit = static_cast<unsigned char>(range.data[i]) - '0';
+
+        if (digit > 9) {
+            break;
+        }
+
+        value = value * 10 + digit;
+    }
+
+    return value;
+}
+
+uint8_t parseStat(const TextRange &stat) {
+    static const struct {
+        const char* stat;
+        uint8_t state;
+    } stats[] = {
+        { "DELIVRD", STATE_DELIVERED }, { "EXPIRED", STATE_EXPIRED }, { "DELETED", STATE_DELETED },
+        { "UNDELIV", STATE_UNDELIVERABLE }, { "ACCEPTD", STATE_ACCEPTED }, { "UNKNOWN", STATE_UNKNOWN },
+        { "REJECTD", STATE_REJECTED }, { "ENROUTE", STATE_ENROUTE }
+    };
+
+    if (stat.length != 7) {
+        return 0;
+    }
+
+    char upper[7];
+
+    for (size_t i = 0; i < 7; ++i) {
+        char c = stat.data[i];
+        upper[i] = (c >= 'a' && c <= 'z') ? static_cast<char>(c - ('a' - 'A')) : c;
+    }
+
+    for (size_t i = 0; i < sizeof(stats) / sizeof(stats[0]); ++i) {
+        if (memcmp(upper, stats[i].stat, 7) == 0) {
+            return stats[i].state;
+        }
+    }
+
+    return 0;
+}
+
+bool decode(const SMS &sms, Receipt* receipt) {
+    TextRange id = valueOf(sms.tlvs.find(tags::RECEIPTED_MESSAGE_ID));
+    TextRange state = valueOf(sms.tlvs.find(tags::MESSAGE_STATE));
+    TextRange networkError = valueOf(sms.tlvs.find(tags::NETWORK_ERROR_CODE));
+    return decode(id, state, networkError, TextRange(sms.short_message.data(), sms.short_message.length()), receipt);
+}
+
+bool decode(const SmsView &sms, Receipt* receipt) {
+    if (sms.isNull()) {
+        *receipt = Receipt();
+        return false;
+    }
+
+    uint16_t len = 0;
+    const char* data = reinterpret_cast<const char*>(sms.findTlv(tags::RECEIPTED_MESSAGE_ID, &len));
+    TextRange id(data, data != 0 ? len : 0);
+    data = reinterpret_cast<const char*>(sms.findTlv(tags::MESSAGE_STATE, &len));
+    TextRange state(data, data != 0 ? len : 0);
+    data = reinterpret_cast<const char*>(sms.findTlv(tags::NETWORK_ERROR_CODE, &len));
+    TextRange networkError(data, data != 0 ? len : 0);
+    TextRange text(reinterpret_cast<const char*>(sms.getShortMessageData()), sms.getSmLength());
+    return decode(id, state, networkError, text, receipt);
+}
+
+}  // namespace receipt
+}  // namespace smpp
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_RECEIPT_H_
+#define SMPP_RECEIPT_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+#include "smpp/sms.h"
+#include "smpp/smsview.h"
+
+namespace smpp {
+namespace receipt {
+
+/**
+ * A run of characters inside a delivery receipt. It does not own the characters.
+ */
+struct TextRange {
+    const char* data;
+    size_t length;
+
+    TextRange() :
+        data(0), length(0) {
+    }
+
+    TextRange(const char* _data, const size_t _length) :
+        data(_data), length(_length) {
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    std::string str() const {
+        return std::string(data, length);
+    }
+};
+
+/**
+ * The fields of a delivery receipt text, as found by scanText.
+ * Fields which are missing from the text are left empty.
+ */
+struct ReceiptText {
+    TextRange id;
+    TextRange sub;
+    TextRange dlvrd;
+    TextRange submitDate;
+    TextRange doneDate;
+    TextRange stat;
+    TextRange err;
+    TextRange text;
+};
+
+/**
+ * Scans the text of a delivery receipt in a single pass. The format is described in appendix B of the SMPP v3.4
+ * specification: "id:IIIIIIIIII sub:SSS dlvrd:DDD submit date:YYMMDDhhmm done date:YYMMDDhhmm stat:DDDDDDD err:E
+ * text:...".
+ *
+ * Since SMSCs rarely follow it to the letter, keys are matched case insensitive, fields can be separated by any
+ * amount of whitespace, "submit_date" and "submitdate" are accepted for "submit date" (likewise for "done date"),
+ * and fields can be reordered or left out. Unknown fields are skipped. Everything after "text:" is the text.
+ *
+ * @param data Receipt text.
+ * @param length Length of the receipt text.
+ * @param fields Fields found in the text, pointing into data.
+ * @return True if the text has at least an id and a stat field.
+ */
+bool scanText(const char* data, const size_t length, ReceiptText* fields);
+
+/**
+ * Parses the leading decimal digits of a range, ie. "003" is 3 and "12ab" is 12.
+ * @param range Range to parse.
+ * @return The parsed value, or 0 if the range does not start with a digit.
+ */
+uint32_t parseDecimal(const TextRange &range);
+
+/**
+ * The outcome of a delivery receipt.
+ */
+struct Receipt {
+    std::string id;
+    // One of the smpp::STATE_* constants, or 0 if the state is unknown.
+    uint8_t state;
+    // Network type of the error code, 0 if the SMSC did not include NETWORK_ERROR_CODE.
+    uint8_t networkType;
+    uint16_t error;
+
+    Receipt() :
+        id(), state(0), networkType(0), error(0) {
+    }
+};
+
+/**
+ * Maps the stat field of a receipt text, ie. "DELIVRD", to the matching smpp::STATE_* constant.
+ * @param stat Stat field.
+ * @return smpp::STATE_* constant, or 0 if the stat is not recognised.
+ */
+uint8_t parseStat(const TextRange &stat);
+
+/**
+ * Decodes the outcome of a delivery receipt.
+ * The RECEIPTED_MESSAGE_ID, MESSAGE_STATE and NETWORK_ERROR_CODE tags are used when the SMSC includes them, which
+ * takes a few instructions. The text in short_message is only scanned if the id or state is missing, or if the
+ * state is a failure without a NETWORK_ERROR_CODE tag, in which case the err field is used as error.
+ *
+ * @param sms Delivery receipt.
+ * @param receipt Decoded outcome.
+ * @return True if both an id and a state was found.
+ */
+bool decode(const SMS &sms, Receipt* receipt);
+
+/**
+ * Decodes the outcome of a delivery receipt directly from the PDU buffer, as decode(const SMS&, Receipt*) does.
+ * Only the receipt id is copied out of the buffer.
+ * @param sms Delivery receipt.
+ * @param receipt Decoded outcome.
+ * @return True if both an id and a state was found.
+ */
+bool decode(const SmsView &sms, Receipt* receipt);
+
+}  // namespace receipt
+}  // namespace smpp
+
+#endif  // SMPP_RECEIPT_H_
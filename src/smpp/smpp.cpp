@@ -5,6 +5,7 @@
  */
 
 #include "smpp/smpp.h"
+#include <cstdio>
 #include <string>
 
 using std::string;
@@ -160,4 +161,66 @@ string getEsmeStatus(uint32_t i) {
         return "Unknown";
     }
 }
+
+string getCommandName(uint32_t i) {
+    if (i != GENERIC_NACK && (i & GENERIC_NACK)) {
+        string request = getCommandName(i & ~GENERIC_NACK);
+
+        if (request[0] != '0') {
+            return request + "_resp";
+        }
+    }
+
+    switch (i) {
+    case GENERIC_NACK:
+        return "generic_nack";
+
+    case BIND_RECEIVER:
+        return "bind_receiver";
+
+    case BIND_TRANSMITTER:
+        return "bind_transmitter";
+
+    case QUERY_SM:
+        return "query_sm";
+
+    case SUBMIT_SM:
+        return "submit_sm";
+
+    case DELIVER_SM:
+        return "deliver_sm";
+
+    case UNBIND:
+        return "unbind";
+
+    case REPLACE_SM:
+        return "replace_sm";
+
+    case CANCEL_SM:
+        return "cancel_sm";
+
+    case BIND_TRANSCEIVER:
+        return "bind_transceiver";
+
+    case OUTBIND:
+        return "outbind";
+
+    case ENQUIRE_LINK:
+        return "enquire_link";
+
+    case SUBMIT_MULTI:
+        return "submit_multi";
+
+    case ALERT_NOTIFICATION:
+        return "alert_notification";
+
+    case DATA_SM:
+        return "data_sm";
+
+    default:
+        char hex[11];
+        snprintf(hex, sizeof(hex), "0x%08x", i);
+        return hex;
+    }
+}
 }  // namespace smpp
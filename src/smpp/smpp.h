@@ -190,6 +190,11 @@ const uint8_t STATE_REJECTED = 8;
 
 std::string getEsmeStatus(uint32_t);
 
+/**
+ * @return Name of a command id as in the specification, ie. submit_sm_resp, or its hex value if it is unknown.
+ */
+std::string getCommandName(uint32_t);
+
 class SmppAddress {
   public:
     std::string value;
@@ -8,6 +8,8 @@
 #include <algorithm>
 #include <list>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <utility>
 
@@ -26,10 +28,37 @@ using boost::asio::ip::tcp;
 using boost::asio::deadline_timer;
 using boost::asio::async_write;
 using boost::asio::buffer;
-using boost::local_time::local_date_time;
-using boost::local_time::not_a_date_time;
 
 namespace smpp {
+namespace {
+/**
+ * Counts requests in the window occupancy of metrics while it is in scope.
+ */
+class WindowGuard {
+  private:
+    Metrics* metrics;
+    int64_t requests;
+
+  public:
+    explicit WindowGuard(Metrics* _metrics) :
+        metrics(_metrics), /**/
+        requests(0) {
+    }
+
+    ~WindowGuard() {
+        add(-requests);
+    }
+
+    void add(const int64_t n) {
+        if (metrics != 0) {
+            metrics->addWindowOccupancy(n);
+        }
+
+        requests += n;
+    }
+};
+}  // namespace
+
 SmppClient::SmppClient(shared_ptr<tcp::socket> _socket) :
     systemType("WWW"), /**/
     interfaceVersion(0x34), /**/
@@ -45,10 +74,29 @@ SmppClient::SmppClient(shared_ptr<tcp::socket> _socket) :
     nullTerminateOctetStrings(true), /**/
     csmsMethod(SmppClient::CSMS_16BIT_TAGS), /**/
     msgRefCallback(&SmppClient::defaultMessageRef), /**/
+    lastMessageIds(), /**/
+    multipartTracker(0), /**/
+    duplicateFilter(0), /**/
+    metrics(0), /**/
+    flightRecorder(0), /**/
+    pcapWriter(0), /**/
+    wasBound(false), /**/
+    deferredAck(false), /**/
+    maxUnacked(1000), /**/
+    nextAckHandle(1), /**/
+    unacked(), /**/
+    dispatchAckHandle(0), /**/
+    pendingAcks(), /**/
+    ackMutex(), /**/
+    ackCondition(), /**/
+    handlers(), /**/
+    handlerError(), /**/
     state(OPEN), /**/
     socket(_socket), /**/
     seqNo(0), /**/
     pdu_queue(), /**/
+    receivedLength(), /**/
+    receivedBuffer(), /**/
     socketWriteTimeout(5000), /**/
     socketReadTimeout(30000), /**/
     verbose(false) {
@@ -77,6 +125,12 @@ void SmppClient::bind(uint32_t mode, const string &login, const string &password
     PDU pdu = setupBindPdu(mode, login, password);
     sendCommand(pdu);
 
+    if (wasBound && metrics != 0) {
+        metrics->reconnect();
+    }
+
+    wasBound = true;
+
     switch (mode) {
     case smpp::BIND_RECEIVER:
         state = BOUND_RX;
@@ -102,6 +156,12 @@ PDU SmppClient::setupBindPdu(uint32_t mode, const string &login, const string &p
 
 void SmppClient::unbind() {
     checkConnection();
+
+    // the responses cannot be sent after unbinding
+    if (deferredAck) {
+        flushAcks();
+    }
+
     PDU pdu(smpp::UNBIND, 0, nextSequenceNumber());
     PDU resp = sendCommand(pdu);
     uint32_t pduStatus = resp.getCommandStatus();
@@ -121,6 +181,7 @@ pair<string, int> SmppClient::sendSms(const SmppAddress &sender, const SmppAddre
                            const string &validity_period, const int dataCoding) {
     int messageLen = shortMessage.length();
     int singleSmsOctetLimit = 254;  // Default SMPP standard
+    lastMessageIds.clear();
     int csmsSplit = -1;  // where to split
 
     switch (dataCoding) {
@@ -139,6 +200,8 @@ pair<string, int> SmppClient::sendSms(const SmppAddress &sender, const SmppAddre
     if (messageLen <= singleSmsOctetLimit || csmsMethod == CSMS_PAYLOAD) {
         string smscId = submitSm(sender, receiver, shortMessage, tags, priority_flag, schedule_delivery_time, validity_period,
                         esmClass, dataCoding);
+        lastMessageIds.push_back(smscId);
+        trackLastMessage();
         return std::make_pair(smscId, 1);
     }
 
@@ -169,45 +232,259 @@ pair<string, int> SmppClient::sendSms(const SmppAddress &sender, const SmppAddre
             string message(reinterpret_cast<char*>(udh.get()), size);
             smsId = submitSm(sender, receiver, message, tags, priority_flag, schedule_delivery_time, validity_period,
                              esmClass | 0x40, dataCoding);
+            lastMessageIds.push_back(smsId);
         }
 
+        trackLastMessage();
         return std::make_pair(smsId, segments);
     } else {  // csmsMethod == CSMS_16BIT_TAGS)
         tags.push_back(TLV(smpp::tags::SAR_MSG_REF_NUM, static_cast<uint16_t>(msgRefCallback())));
         tags.push_back(TLV(smpp::tags::SAR_TOTAL_SEGMENTS, boost::numeric_cast<uint8_t>(parts.size())));
+        tags.push_back(TLV(smpp::tags::SAR_SEGMENT_SEQNUM));
         int segment = 0;
         string smsId;
 
         for (; itr < parts.end(); itr++) {
-            tags.push_back(TLV(smpp::tags::SAR_SEGMENT_SEQNUM, ++segment));
+            // the TLVs are stored inline, so updating the sequence number does not allocate
+            tags.back() = TLV(smpp::tags::SAR_SEGMENT_SEQNUM, ++segment);
             smsId = submitSm(sender, receiver, (*itr), tags, priority_flag, schedule_delivery_time, validity_period,
                              esmClass, dataCoding);
-            // pop SAR_SEGMENT_SEQNUM tag
-            tags.pop_back();
+            lastMessageIds.push_back(smsId);
         }
 
+        // pop SAR_SEGMENT_SEQNUM tag
+        tags.pop_back();
+
         // pop SAR_TOTAL_SEGMENTS tag
         tags.pop_back();
         // pop SAR_MSG_REF_NUM tag
         tags.pop_back();
+        trackLastMessage();
         return std::make_pair(smsId, segment);
     }
 }
 
+void SmppClient::trackLastMessage() {
+    if (multipartTracker != 0 && !multipartTracker->track(lastMessageIds)) {
+        LOG(WARNING) << "Could not track the segments of message " << lastMessageIds.back();
+    }
+}
+
 SMS SmppClient::readSms() {
+    if (deferredAck) {
+        throw SmppException("Deferred acknowledgement requires an ack handle");
+    }
+
+    PDU pdu = readDeliverSm();
+    return pdu.null ? SMS() : SMS(pdu);
+}
+
+SMS SmppClient::readSms(uint32_t* ackHandle) {
+    PDU pdu = readDeliverSm();
+
+    if (pdu.null) {
+        return SMS();
+    }
+
+    SMS sms(pdu);
+    *ackHandle = addUnacked(pdu.getSequenceNo(), fingerprintOf(pdu));
+    return sms;
+}
+
+SmsView SmppClient::readSmsView() {
+    if (deferredAck) {
+        throw SmppException("Deferred acknowledgement requires an ack handle");
+    }
+
+    PDU pdu = readDeliverSm();
+    return pdu.null ? SmsView() : SmsView(pdu);
+}
+
+SmsView SmppClient::readSmsView(uint32_t* ackHandle) {
+    PDU pdu = readDeliverSm();
+
+    if (pdu.null) {
+        return SmsView();
+    }
+
+    SmsView view(pdu);
+    *ackHandle = addUnacked(pdu.getSequenceNo(), fingerprintOf(pdu));
+    return view;
+}
+
+vector<SMS> SmppClient::readSmsBatch(const size_t max, const int timeout, vector<uint32_t>* ackHandles) {
+    checkState(BOUND_RX);
+    vector<SMS> batch;
+    vector<PDU> responses;
+    size_t limit = max;
+
+    if (deferredAck) {
+        if (ackHandles == 0) {
+            throw SmppException("Deferred acknowledgement requires an ack handle");
+        }
+
+        limit = std::min(max, waitForAckWindow(timeout));
+
+        if (limit == 0) {
+            return batch;
+        }
+    }
+
+    try {
+        parseDeliverSmBatch(limit, &batch, &responses, ackHandles);
+
+        // wait for the first SMS if none were buffered
+        int64_t deadline = MonotonicClock::nowMillis() + timeout;
+
+        while (batch.empty()) {
+            int remaining = static_cast<int>(deadline - MonotonicClock::nowMillis());
+
+            if (remaining <= 0) {
+                break;
+            }
+
+            PDU pdu = readPduBlocking(remaining);
+
+            if (pdu.null) {
+                break;  // timed out
+            }
+
+            enqueue(pdu);
+            parseDeliverSmBatch(limit, &batch, &responses, ackHandles);
+        }
+
+        // take whatever else is already on the wire
+        while (batch.size() < limit) {
+            PDU pdu = readPdu(false);
+
+            if (pdu.null) {
+                break;
+            }
+
+            enqueue(pdu);
+            parseDeliverSmBatch(limit, &batch, &responses, ackHandles);
+        }
+    } catch (std::exception &e) {
+        // the SMSes read so far are answered and returned, the next read fails again
+        if (batch.empty()) {
+            sendPdus(responses);
+            throw smpp::TransportException(e.what());
+        }
+
+        LOG(WARNING) << "Returning a partial batch after a read failure: " << e.what();
+    }
+
+    sendPdus(responses);
+    return batch;
+}
+
+void SmppClient::ack(const uint32_t ackHandle, const uint32_t status) {
+    boost::mutex::scoped_lock lock(ackMutex);
+    std::unordered_map<uint32_t, UnackedSms>::iterator it = unacked.find(ackHandle);
+
+    if (it == unacked.end()) {
+        throw SmppException("Unknown ack handle");
+    }
+
+    pendingAcks.push_back(std::make_pair(it->second, status));
+    unacked.erase(it);
+    ackCondition.notify_one();
+}
+
+void SmppClient::ack(const vector<uint32_t> &ackHandles, const uint32_t status) {
+    boost::mutex::scoped_lock lock(ackMutex);
+    std::unordered_set<uint32_t> seen;
+
+    // all handles are checked first, so none are acknowledged if one is invalid
+    for (vector<uint32_t>::const_iterator it = ackHandles.begin(); it != ackHandles.end(); ++it) {
+        if (unacked.count(*it) == 0 || !seen.insert(*it).second) {
+            throw SmppException("Unknown ack handle");
+        }
+    }
+
+    for (vector<uint32_t>::const_iterator it = ackHandles.begin(); it != ackHandles.end(); ++it) {
+        std::unordered_map<uint32_t, UnackedSms>::iterator entry = unacked.find(*it);
+        pendingAcks.push_back(std::make_pair(entry->second, status));
+        unacked.erase(entry);
+    }
+
+    ackCondition.notify_one();
+}
+
+void SmppClient::flushAcks() {
+    vector<pair<UnackedSms, uint32_t> > acks;
+    {
+        boost::mutex::scoped_lock lock(ackMutex);
+        acks.swap(pendingAcks);
+    }
+
+    vector<PDU> responses;
+    responses.reserve(acks.size());
+
+    for (vector<pair<UnackedSms, uint32_t> >::iterator it = acks.begin(); it != acks.end(); ++it) {
+        PDU resp = PDU(DELIVER_SM_RESP, it->second, it->first.sequence);
+        resp << 0x0;
+        responses.push_back(resp);
+    }
+
+    sendPdus(responses);
+
+    for (vector<pair<UnackedSms, uint32_t> >::iterator it = acks.begin(); it != acks.end(); ++it) {
+        if (it->second == ESME_ROK) {
+            rememberAcked(it->first.fingerprint);
+        }
+    }
+}
+
+size_t SmppClient::waitForAckWindow(const int timeout) {
+    {
+        boost::mutex::scoped_lock lock(ackMutex);
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout);
+
+        // not reading the socket while at the limit makes the SMSC stop sending
+        while (unacked.size() >= maxUnacked) {
+            if (!ackCondition.timed_wait(lock, deadline)) {
+                break;
+            }
+        }
+    }
+
+    flushAcks();
+    boost::mutex::scoped_lock lock(ackMutex);
+    return unacked.size() < maxUnacked ? maxUnacked - unacked.size() : 0;
+}
+
+uint32_t SmppClient::addUnacked(const uint32_t sequence, const uint64_t fingerprint) {
+    boost::mutex::scoped_lock lock(ackMutex);
+    uint32_t handle;
+
+    do {
+        handle = nextAckHandle++;
+    } while (handle == 0 || unacked.count(handle) != 0);
+
+    UnackedSms sms = { sequence, fingerprint };
+    unacked[handle] = sms;
+    return handle;
+}
+
+PDU SmppClient::readDeliverSm() {
     // see if we're bound correct.
     checkState(BOUND_RX);
 
+    if (deferredAck && waitForAckWindow(socketReadTimeout) == 0) {
+        return PDU();
+    }
+
     // if  there are any messages in the queue pop the first usable one off and return it
-    if (!pdu_queue.empty()) {
-        return parseSms();
+    PDU queued = parseDeliverSm();
+
+    if (!queued.null) {
+        return queued;
     }
 
-    // fill queue until we get a DELIVER_SM command
+    // fill queue until we get a DELIVER_SM command which can be decoded
     try {
-        bool b = false;
-
-        while (!b) {
+        for (;;) {
             PDU pdu = readPdu(true);
 
             if (pdu.getCommandId() == ENQUIRE_LINK) {
@@ -220,17 +497,21 @@ SMS SmppClient::readSms() {
                 break;
             }
 
-            if (!pdu.null) {
-                pdu_queue.push_back(pdu);    // save pdu for reading later
-            }
+            enqueue(pdu);    // save pdu for reading later
 
-            b = pdu.getCommandId() == DELIVER_SM;
+            if (pdu.getCommandId() == DELIVER_SM) {
+                PDU parsed = parseDeliverSm();
+
+                if (!parsed.null) {
+                    return parsed;
+                }
+            }
         }
     } catch (std::exception &e) {
         throw smpp::TransportException(e.what());
     }
 
-    return parseSms();
+    return parseDeliverSm();
 }
 
 QuerySmResult SmppClient::querySm(std::string messageid, SmppAddress source) {
@@ -240,22 +521,136 @@ QuerySmResult SmppClient::querySm(std::string messageid, SmppAddress source) {
     pdu << source.npi;
     pdu << source.value;
     PDU reply = sendCommand(pdu);
-    string msgid;
-    string final_date;
-    uint8_t message_state;
-    uint8_t error_code;
-    reply >> msgid;
-    reply >> final_date;
-    reply >> message_state;
-    reply >> error_code;
-    local_date_time ldt(not_a_date_time);
+    return parseQuerySmResp(reply);
+}
+
+vector<QuerySmResult> SmppClient::querySmBatch(const vector<pair<string, SmppAddress> > &queries,
+        const size_t window, const uint32_t rate) {
+    vector<QuerySmResult> results(queries.size());
+    size_t limit = std::max<size_t>(window, 1);
+    // index of the query of each sequence number awaiting a response, and the time it was sent
+    std::unordered_map<uint32_t, pair<size_t, int64_t> > inFlight;
+    size_t next = 0;
+    size_t answered = 0;
+    int64_t start = MonotonicClock::nowMillis();
+    // time of the last query sent or response received
+    int64_t lastActivity = start;
+    WindowGuard windowGuard(metrics);
+
+    while (answered < queries.size()) {
+        int64_t now = MonotonicClock::nowMillis();
+        // time the rate limit allows the next query to be sent
+        int64_t due = now;
+        vector<PDU> pdus;
+        int64_t sent = MonotonicClock::nowMicros();
+
+        while (next < queries.size() && inFlight.size() < limit) {
+            if (rate != 0) {
+                due = start + static_cast<int64_t>(next) * 1000 / rate;
+
+                if (due > now) {
+                    break;
+                }
+            }
+
+            const pair<string, SmppAddress> &query = queries[next];
+            PDU pdu = PDU(QUERY_SM, 0, nextSequenceNumber());
+            pdu << query.first;
+            pdu << query.second.ton;
+            pdu << query.second.npi;
+            pdu << query.second.value;
+            inFlight[pdu.getSequenceNo()] = std::make_pair(next++, sent);
+            pdus.push_back(pdu);
+        }
+
+        if (!pdus.empty()) {
+            sendPdus(pdus);
+            windowGuard.add(pdus.size());
+            lastActivity = now;
+        }
+
+        if (inFlight.empty()) {
+            // waiting for the rate limit only
+            boost::this_thread::sleep(boost::posix_time::milliseconds(due - now));
+            continue;
+        }
+
+        int timeout = static_cast<int>(lastActivity + socketReadTimeout - now);
+
+        if (timeout <= 0) {
+            if (metrics != 0) {
+                metrics->timeout();
+            }
+
+            throw TransportException("Timed out waiting for query_sm responses");
+        }
+
+        if (due > now && next < queries.size() && inFlight.size() < limit) {
+            timeout = std::min(timeout, static_cast<int>(due - now));
+        }
+
+        PDU pdu = readPduBlocking(timeout);
 
-    if (final_date.length() > 1) {
-        smpp::timeformat::DatePair p = smpp::timeformat::parseSmppTimestamp(final_date);
-        ldt = p.first;
+        if (pdu.null) {
+            continue;
+        }
+
+        uint32_t commandId = pdu.getCommandId();
+
+        if (commandId == QUERY_SM_RESP || commandId == GENERIC_NACK) {
+            std::unordered_map<uint32_t, pair<size_t, int64_t> >::iterator it = inFlight.find(pdu.getSequenceNo());
+
+            if (it != inFlight.end()) {
+                recordLatency(QUERY_SM, it->second.second);
+                QuerySmResult &result = results[it->second.first];
+
+                if (commandId == QUERY_SM_RESP && pdu.getCommandStatus() == ESME_ROK) {
+                    result = parseQuerySmResp(pdu);
+                } else {
+                    result.messageId = queries[it->second.first].first;
+                    result.commandStatus = pdu.getCommandStatus();
+                }
+
+                inFlight.erase(it);
+                windowGuard.add(-1);
+                ++answered;
+                lastActivity = MonotonicClock::nowMillis();
+                continue;
+            }
+
+            if (commandId == GENERIC_NACK && pdu.getSequenceNo() == 0) {
+                throw SmppException(getEsmeStatus(pdu.getCommandStatus()));
+            }
+        }
+
+        if (commandId == ENQUIRE_LINK) {
+            PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
+            sendPdu(resp);
+            continue;
+        }
+
+        enqueue(pdu);
     }
 
-    return QuerySmResult(msgid, ldt, message_state, error_code);
+    return results;
+}
+
+QuerySmResult SmppClient::parseQuerySmResp(PDU &reply) {
+    QuerySmResult result;
+    string finalDate;
+    reply >> result.messageId;
+    reply >> finalDate;
+    reply >> result.messageState;
+    reply >> result.errorCode;
+    result.finalDate = 0;
+    result.commandStatus = reply.getCommandStatus();
+
+    if (finalDate.length() > 1) {
+        smpp::timeformat::DatePair p = smpp::timeformat::parseSmppTimestamp(finalDate);
+        result.finalDate = (p.first.utc_time() - boost::posix_time::from_time_t(0)).total_seconds();
+    }
+
+    return result;
 }
 
 void SmppClient::enquireLink() {
@@ -263,27 +658,48 @@ void SmppClient::enquireLink() {
     sendCommand(pdu);
 }
 
-SMS SmppClient::parseSms() {
-    if (pdu_queue.empty()) {
-        return SMS();
-    }
-
-    list<PDU>::iterator it = pdu_queue.begin();
+PDU SmppClient::parseDeliverSm() {
+    InboundQueue::iterator it = pdu_queue.begin(InboundQueue::MESSAGES);
 
-    while (it != pdu_queue.end()) {
+    while (it != pdu_queue.end(InboundQueue::MESSAGES)) {
         if ((*it).getCommandId() == DELIVER_SM) {
-            SMS sms(*it);
-            // send response to smsc
-            PDU resp = PDU(DELIVER_SM_RESP, 0x0, (*it).getSequenceNo());
-            resp << 0x0;
-            sendPdu(resp);
+            PDU pdu = *it;
+            uint64_t fingerprint = fingerprintOf(pdu);
+
+            if (isDuplicate(fingerprint)) {
+                // acknowledged again, so the SMSC stops sending it
+                PDU resp = PDU(DELIVER_SM_RESP, 0x0, pdu.getSequenceNo());
+                resp << 0x0;
+                sendPdu(resp);
+                it = pdu_queue.erase(InboundQueue::MESSAGES, it);
+                continue;
+            }
+
+            uint32_t status = checkDeliverSm(pdu);
+
+            if (status != ESME_ROK) {
+                PDU resp = PDU(DELIVER_SM_RESP, status, pdu.getSequenceNo());
+                resp << 0x0;
+                sendPdu(resp);
+                it = pdu_queue.erase(InboundQueue::MESSAGES, it);
+                continue;
+            }
+
+            // with deferred acknowledgement the response is sent when the application acknowledges it
+            if (!deferredAck) {
+                PDU resp = PDU(DELIVER_SM_RESP, 0x0, pdu.getSequenceNo());
+                resp << 0x0;
+                sendPdu(resp);
+                rememberAcked(fingerprint);
+            }
+
             // remove sms from queue
-            pdu_queue.erase(it);
-            return sms;
+            pdu_queue.erase(InboundQueue::MESSAGES, it);
+            return pdu;
         }
 
         if ((*it).getCommandId() == ALERT_NOTIFICATION) {
-            it = pdu_queue.erase(it);
+            it = pdu_queue.erase(InboundQueue::MESSAGES, it);
             continue;
         }
 
@@ -291,14 +707,397 @@ SMS SmppClient::parseSms() {
             PDU resp = PDU(DATA_SM_RESP, 0x0, (*it).getSequenceNo());
             resp << 0x0;
             sendPdu(resp);
-            it = pdu_queue.erase(it);
+            it = pdu_queue.erase(InboundQueue::MESSAGES, it);
             continue;
         }
 
         ++it;
     }
 
-    return SMS();
+    return PDU();
+}
+
+void SmppClient::parseDeliverSmBatch(const size_t max, vector<SMS>* batch, vector<PDU>* responses,
+                                     vector<uint32_t>* ackHandles) {
+    InboundQueue::iterator it = pdu_queue.begin(InboundQueue::MESSAGES);
+
+    while (it != pdu_queue.end(InboundQueue::MESSAGES) && batch->size() < max) {
+        uint32_t commandId = (*it).getCommandId();
+
+        if (commandId == DELIVER_SM) {
+            uint64_t fingerprint = fingerprintOf(*it);
+            bool duplicate = isDuplicate(fingerprint);
+            uint32_t status = duplicate ? ESME_ROK : checkDeliverSm(*it);
+            bool accepted = !duplicate && status == ESME_ROK;
+
+            // decoded before it is registered, so a malformed PDU is answered and removed like any other
+            if (accepted) {
+                batch->push_back(SMS(*it));
+            }
+
+            if (accepted && deferredAck) {
+                ackHandles->push_back(addUnacked((*it).getSequenceNo(), fingerprint));
+            } else {
+                PDU resp = PDU(DELIVER_SM_RESP, status, (*it).getSequenceNo());
+                resp << 0x0;
+                responses->push_back(resp);
+            }
+
+            if (accepted && !deferredAck) {
+                rememberAcked(fingerprint);
+            }
+
+            it = pdu_queue.erase(InboundQueue::MESSAGES, it);
+            continue;
+        }
+
+        if (commandId == DATA_SM) {
+            PDU resp = PDU(DATA_SM_RESP, 0x0, (*it).getSequenceNo());
+            resp << 0x0;
+            responses->push_back(resp);
+            it = pdu_queue.erase(InboundQueue::MESSAGES, it);
+            continue;
+        }
+
+        if (commandId == ALERT_NOTIFICATION) {
+            it = pdu_queue.erase(InboundQueue::MESSAGES, it);
+            continue;
+        }
+
+        ++it;
+    }
+
+    it = pdu_queue.begin(InboundQueue::REQUESTS);
+
+    while (it != pdu_queue.end(InboundQueue::REQUESTS)) {
+        if ((*it).getCommandId() == ENQUIRE_LINK) {
+            responses->push_back(PDU(ENQUIRE_LINK_RESP, 0, (*it).getSequenceNo()));
+            it = pdu_queue.erase(InboundQueue::REQUESTS, it);
+            continue;
+        }
+
+        ++it;
+    }
+}
+
+void SmppClient::setPduHandler(const uint32_t commandId, const PduHandler &handler) {
+    int index = handlerIndex(commandId);
+
+    if (index < 0) {
+        throw SmppException("PDUs of this command id cannot have a handler");
+    }
+
+    handlers[index] = handler;
+}
+
+size_t SmppClient::dispatchPdus(const int timeout) {
+    if (handlerError) {
+        std::exception_ptr error = handlerError;
+        handlerError = std::exception_ptr();
+        std::rethrow_exception(error);
+    }
+
+    checkConnection();
+    size_t dispatched = 0;
+
+    // PDUs queued before their handler was registered
+    for (int kind = InboundQueue::RESPONSES; kind <= InboundQueue::REQUESTS; ++kind) {
+        InboundQueue::Kind k = static_cast<InboundQueue::Kind>(kind);
+        InboundQueue::iterator it = pdu_queue.begin(k);
+
+        while (it != pdu_queue.end(k)) {
+            int index = handlerIndex((*it).getCommandId());
+
+            if (index < 0 || !handlers[index]
+                    || (deferredAck && (*it).getCommandId() == DELIVER_SM && waitForAckWindow(0) == 0)) {
+                ++it;
+                continue;
+            }
+
+            PDU pdu = *it;
+            it = pdu_queue.erase(k, it);
+            dispatch(pdu);
+            ++dispatched;
+        }
+    }
+
+    int64_t deadline = MonotonicClock::nowMillis() + timeout;
+
+    while (state != OPEN) {
+        int remaining = static_cast<int>(deadline - MonotonicClock::nowMillis());
+
+        if (remaining <= 0) {
+            break;
+        }
+
+        // not reading the socket while at the limit makes the SMSC stop sending
+        if (deferredAck && waitForAckWindow(remaining) == 0) {
+            continue;
+        }
+
+        PDU pdu = readPduBlocking(remaining);
+
+        if (pdu.null) {
+            break;  // timed out
+        }
+
+        if (pdu.getCommandId() == ENQUIRE_LINK) {
+            PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
+            sendPdu(resp);
+            continue;
+        }
+
+        if (dispatch(pdu)) {
+            ++dispatched;
+        } else {
+            enqueue(pdu);
+        }
+    }
+
+    return dispatched;
+}
+
+int SmppClient::handlerIndex(const uint32_t commandId) {
+    switch (commandId) {
+    case DELIVER_SM:
+        return 0;
+
+    case DATA_SM:
+        return 1;
+
+    case ALERT_NOTIFICATION:
+        return 2;
+
+    case OUTBIND:
+        return 3;
+
+    case UNBIND:
+        return 4;
+
+    case GENERIC_NACK:
+        return 5;
+
+    default:
+        return -1;
+    }
+}
+
+int SmppClient::latencyIndex(const uint32_t commandId) {
+    switch (commandId) {
+    case BIND_TRANSMITTER:
+    case BIND_RECEIVER:
+    case BIND_TRANSCEIVER:
+        return 0;
+
+    case SUBMIT_SM:
+        return 1;
+
+    case QUERY_SM:
+        return 2;
+
+    case ENQUIRE_LINK:
+        return 3;
+
+    case UNBIND:
+        return 4;
+
+    default:
+        return -1;
+    }
+}
+
+LatencySnapshot SmppClient::getLatency(const uint32_t commandId) const {
+    int index = latencyIndex(commandId);
+
+    if (index < 0) {
+        throw SmppException("Latencies are not recorded for this command id");
+    }
+
+    return latencies[index].getSnapshot();
+}
+
+void SmppClient::resetLatencies() {
+    for (int i = 0; i < LATENCY_COMMANDS; ++i) {
+        latencies[i].reset();
+    }
+}
+
+void SmppClient::recordLatency(const uint32_t commandId, const int64_t start) {
+    int index = latencyIndex(commandId);
+
+    if (index >= 0) {
+        latencies[index].record(std::max<int64_t>(MonotonicClock::nowMicros() - start, 0));
+    }
+}
+
+bool SmppClient::dispatch(const PDU &pdu) {
+    int index = handlerIndex(pdu.getCommandId());
+
+    if (index < 0 || !handlers[index]) {
+        return false;
+    }
+
+    PDU request(pdu);
+    uint64_t fingerprint = pdu.getCommandId() == DELIVER_SM ? fingerprintOf(request) : 0;
+
+    if (isDuplicate(fingerprint)) {
+        PDU resp = PDU(DELIVER_SM_RESP, 0x0, pdu.getSequenceNo());
+        resp << 0x0;
+        sendPdu(resp);
+        return true;
+    }
+
+    if (pdu.getCommandId() == DELIVER_SM) {
+        uint32_t status = checkDeliverSm(request);
+
+        if (status != ESME_ROK) {
+            PDU resp = PDU(DELIVER_SM_RESP, status, pdu.getSequenceNo());
+            resp << 0x0;
+            sendPdu(resp);
+            return true;
+        }
+    }
+
+    bool deferred = deferredAck && pdu.getCommandId() == DELIVER_SM;
+
+    // registered before the handler is called, as it may acknowledge it at once
+    if (deferred) {
+        dispatchAckHandle = addUnacked(pdu.getSequenceNo(), fingerprint);
+    }
+
+    uint32_t status;
+
+    try {
+        status = handlers[index](request);
+    } catch (...) {
+        // answered with a temporary error, so the SMSC delivers it again rather than waiting for a response
+        bool answered = false;
+
+        if (deferred) {
+            // the handler may have acknowledged it before throwing
+            boost::mutex::scoped_lock lock(ackMutex);
+            answered = unacked.erase(dispatchAckHandle) == 0;
+        }
+
+        if ((pdu.getCommandId() == DELIVER_SM || pdu.getCommandId() == DATA_SM) && !answered) {
+            PDU resp = PDU(pdu.getCommandId() | GENERIC_NACK, ESME_RX_T_APPN, pdu.getSequenceNo());
+            resp << 0x0;
+            sendPdu(resp);
+        }
+
+        throw;
+    }
+
+    switch (pdu.getCommandId()) {
+    case DELIVER_SM:
+    case DATA_SM:
+        if (!deferred) {
+            PDU resp = PDU(pdu.getCommandId() | GENERIC_NACK, status, pdu.getSequenceNo());
+            resp << 0x0;
+            sendPdu(resp);
+
+            if (status == ESME_ROK) {
+                rememberAcked(fingerprint);
+            }
+        }
+
+        break;
+
+    case UNBIND: {
+        PDU resp = PDU(UNBIND_RESP, status, pdu.getSequenceNo());
+        sendPdu(resp);
+
+        if (status == ESME_ROK) {
+            state = OPEN;
+        }
+
+        break;
+    }
+    }
+
+    return true;
+}
+
+uint64_t SmppClient::fingerprintOf(PDU &pdu) {
+    if (duplicateFilter == 0) {
+        return 0;
+    }
+
+    try {
+        return DuplicateFilter::fingerprintOf(SmsView(pdu));
+    } catch (SmppException &e) {
+        // a malformed PDU is passed on to fail where it is decoded
+        return 0;
+    }
+}
+
+bool SmppClient::isDuplicate(const uint64_t fingerprint) {
+    return fingerprint != 0 && duplicateFilter != 0 && duplicateFilter->contains(fingerprint, CoarseClock::now());
+}
+
+void SmppClient::rememberAcked(const uint64_t fingerprint) {
+    if (fingerprint != 0 && duplicateFilter != 0) {
+        duplicateFilter->remember(fingerprint, CoarseClock::now());
+    }
+}
+
+uint32_t SmppClient::checkDeliverSm(PDU &pdu) {
+    uint32_t status = ESME_RINVCMDLEN;
+
+    try {
+        SmsView view(pdu);
+        status = ESME_RINVOPTPARSTREAM;
+        view.validateTlvs();
+        return ESME_ROK;
+    } catch (SmppException &e) {
+        LOG(WARNING) << "Rejected deliver_sm " << pdu.getSequenceNo() << ": " << e.what();
+        return status;
+    }
+}
+
+void SmppClient::enqueue(const PDU &pdu) {
+    bool dispatched = false;
+
+    try {
+        dispatched = !pdu.null && dispatch(pdu);
+    } catch (TransportException &e) {
+        throw;
+    } catch (std::exception &e) {
+        // the command being waited for must not fail, the PDU has been answered already
+        LOG(ERROR) << "Handler of PDU with command id 0x" << std::hex << pdu.getCommandId() << " failed: " << e.what();
+        handlerError = std::current_exception();
+        return;
+    } catch (...) {
+        LOG(ERROR) << "Handler of PDU with command id 0x" << std::hex << pdu.getCommandId() << " failed";
+        handlerError = std::current_exception();
+        return;
+    }
+
+    if (pdu.null || dispatched || pdu_queue.push(pdu)) {
+        return;
+    }
+
+    // the queue is full, so the PDU is turned away rather than buffered
+    switch (pdu.getCommandId()) {
+    case DELIVER_SM:
+    case DATA_SM: {
+        // a temporary error makes the SMSC retry it later
+        PDU resp = PDU(pdu.getCommandId() | GENERIC_NACK, ESME_RX_T_APPN, pdu.getSequenceNo());
+        resp << 0x0;
+        sendPdu(resp);
+        break;
+    }
+
+    case ENQUIRE_LINK: {
+        PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
+        sendPdu(resp);
+        break;
+    }
+
+    default:
+        LOG(WARNING) << "Inbound queue is full, dropped PDU with command id 0x" << std::hex << pdu.getCommandId();
+        break;
+    }
 }
 
 vector<string> SmppClient::split(const string &shortMessage, const int split) {
@@ -325,7 +1124,7 @@ vector<string> SmppClient::split(const string &shortMessage, const int split) {
 }
 
 string SmppClient::submitSm(const SmppAddress &sender, const SmppAddress &receiver, const string &shortMessage,
-                            list<TLV> tags, const uint8_t priority_flag, const string &schedule_delivery_time,
+                            const list<TLV> &tags, const uint8_t priority_flag, const string &schedule_delivery_time,
                             const string &validity_period, const int esmClassOpt, const int dataCoding) {
     checkState(BOUND_TX);
     PDU pdu(smpp::SUBMIT_SM, 0, nextSequenceNumber());
@@ -353,7 +1152,7 @@ string SmppClient::submitSm(const SmppAddress &sender, const SmppAddress &receiv
     }
 
     // add  optional tags.
-    for (list<TLV>::iterator itr = tags.begin(); itr != tags.end(); itr++) {
+    for (list<TLV>::const_iterator itr = tags.begin(); itr != tags.end(); itr++) {
         pdu << *itr;
     }
 
@@ -373,32 +1172,91 @@ uint32_t SmppClient::nextSequenceNumber() {
 
 void SmppClient::sendPdu(PDU &pdu) {
     checkConnection();
-    optional<error_code> ioResult;
-    optional<error_code> timerResult;
 
     if (verbose) {
         LOG(INFO) << pdu;
     }
 
+    shared_array<uint8_t> octets = pdu.getOctets();
+    int size = pdu.getSize();
+
+    if (flightRecorder != 0) {
+        flightRecorder->record(true, octets.get(), size);
+    }
+
+    if (pcapWriter != 0) {
+        pcapWriter->record(true, octets.get(), size);
+    }
+
+    socketWrite(octets.get(), size);
+
+    if (metrics != 0) {
+        metrics->pduSent(pdu.getCommandId(), size);
+    }
+}
+
+void SmppClient::sendPdus(vector<PDU> &pdus) {
+    if (pdus.empty()) {
+        return;
+    }
+
+    checkConnection();
+    vector<uint8_t> octets;
+
+    for (vector<PDU>::iterator it = pdus.begin(); it != pdus.end(); ++it) {
+        if (verbose) {
+            LOG(INFO) << *it;
+        }
+
+        shared_array<uint8_t> pduOctets = it->getOctets();
+        int size = it->getSize();
+        octets.insert(octets.end(), pduOctets.get(), pduOctets.get() + size);
+
+        if (flightRecorder != 0) {
+            flightRecorder->record(true, pduOctets.get(), size);
+        }
+
+        if (pcapWriter != 0) {
+            pcapWriter->record(true, pduOctets.get(), size);
+        }
+
+        if (metrics != 0) {
+            metrics->pduSent(it->getCommandId(), size);
+        }
+    }
+
+    socketWrite(&octets[0], octets.size());
+}
+
+void SmppClient::socketWrite(const uint8_t* data, const size_t length) {
+    optional<error_code> ioResult;
+    optional<error_code> timerResult;
     deadline_timer timer(getIoService());
     timer.expires_from_now(boost::posix_time::milliseconds(socketWriteTimeout));
     timer.async_wait(boost::bind(&SmppClient::handleTimeout, this, &timerResult, _1));
-    async_write(*socket, buffer(pdu.getOctets().get(), pdu.getSize()),
-                boost::bind(&SmppClient::writeHandler, this, &ioResult, _1));
-    socketExecute();
+    async_write(*socket, buffer(data, length), boost::bind(&SmppClient::writeHandler, this, &ioResult, _1));
+    awaitFirst(ioResult, timerResult);
 
     if (ioResult) {
         timer.cancel();
-    } else if (timerResult) {
+    } else {
         socket->cancel();
+
+        if (metrics != 0) {
+            metrics->timeout();
+        }
     }
 
-    socketExecute();
+    awaitBoth(ioResult, timerResult);
 }
 
 PDU SmppClient::sendCommand(PDU &pdu) {
+    int64_t start = MonotonicClock::nowMicros();
+    WindowGuard windowGuard(metrics);
+    windowGuard.add(1);
     sendPdu(pdu);
     PDU resp = readPduResponse(pdu.getSequenceNo(), pdu.getCommandId());
+    recordLatency(pdu.getCommandId(), start);
 
     switch (resp.getCommandStatus()) {
     case smpp::ESME_RINVPASWD:
@@ -426,21 +1284,41 @@ PDU SmppClient::sendCommand(PDU &pdu) {
 }
 
 PDU SmppClient::readPdu(const bool &isBlocking) {
-    // return NULL pdu if there is nothing on the wire for us.
-    if (!isBlocking && !socketPeek()) {
+    if (isBlocking) {
+        return readPduBlocking(socketReadTimeout);
+    }
+
+    // return NULL pdu if there is nothing on the wire for us, or we may not buffer more.
+    if (pdu_queue.isPaused() || !socketPeek()) {
         return PDU();
     }
 
-    readPduBlocking();
+    return takeReceivedPdu();
+}
 
+PDU SmppClient::takeReceivedPdu() {
     // There are no pdus to be read return a null pdu.
-    if (pdu_queue.empty()) {
+    if (!receivedBuffer) {
         return PDU();
     }
 
-    // Return last the pdu inserted into the queue.
-    PDU pdu = pdu_queue.back();
-    pdu_queue.pop_back();
+    PDU pdu(receivedLength, receivedBuffer);
+    uint32_t length = PDU::getPduLength(receivedLength);
+
+    if (flightRecorder != 0) {
+        flightRecorder->record(false, receivedLength.get(), 4, receivedBuffer.get(), length - 4);
+    }
+
+    if (pcapWriter != 0) {
+        pcapWriter->record(false, receivedLength.get(), 4, receivedBuffer.get(), length - 4);
+    }
+
+    if (metrics != 0) {
+        metrics->pduReceived(pdu.getCommandId(), pdu.getCommandStatus(), length);
+    }
+
+    receivedLength.reset();
+    receivedBuffer.reset();
 
     if (verbose) {
         LOG(INFO) << pdu;
@@ -461,24 +1339,25 @@ bool SmppClient::socketPeek() {
     return handlersCalled != 0;
 }
 
-void SmppClient::readPduBlocking() {
+PDU SmppClient::readPduBlocking(const int timeout) {
     optional<error_code> ioResult;
     optional<error_code> timerResult;
     shared_array<uint8_t> pduHeader(new uint8_t[4]);
     async_read(*socket, boost::asio::buffer(pduHeader.get(), 4),
                boost::bind(&SmppClient::readPduHeaderHandlerBlocking, this, &ioResult, _1, _2, pduHeader));
     deadline_timer timer(getIoService());
-    timer.expires_from_now(boost::posix_time::milliseconds(socketReadTimeout));
+    timer.expires_from_now(boost::posix_time::milliseconds(timeout));
     timer.async_wait(boost::bind(&SmppClient::handleTimeout, this, &timerResult, _1));
-    socketExecute();
+    awaitFirst(ioResult, timerResult);
 
     if (ioResult) {
         timer.cancel();
-    } else if (timerResult) {
+    } else {
         socket->cancel();
     }
 
-    socketExecute();
+    awaitBoth(ioResult, timerResult);
+    return takeReceivedPdu();
 }
 
 void SmppClient::handleTimeout(optional<error_code>* opt, const error_code &error) {
@@ -489,15 +1368,37 @@ void SmppClient::writeHandler(optional<error_code>* opt, const error_code &error
     opt->reset(error);
 
     if (error) {
+        dumpFlightRecorder(system_error(error).what());
         throw TransportException(system_error(error).what());
     }
 }
 
+void SmppClient::dumpFlightRecorder(const string &reason) {
+    if (flightRecorder != 0) {
+        std::ostringstream out;
+        flightRecorder->dump(out);
+        LOG(ERROR) << reason << ", last PDUs:\n" << out.str();
+    }
+}
+
 void SmppClient::socketExecute() {
     getIoService().run_one();
     getIoService().reset();
 }
 
+void SmppClient::awaitFirst(const optional<error_code> &ioResult, const optional<error_code> &timerResult) {
+    while (!ioResult && !timerResult) {
+        socketExecute();
+    }
+}
+
+void SmppClient::awaitBoth(const optional<error_code> &ioResult, const optional<error_code> &timerResult) {
+    // the handlers refer to the results on the stack of the caller, so both must have run before it returns
+    while (!ioResult || !timerResult) {
+        socketExecute();
+    }
+}
+
 void SmppClient::readPduHeaderHandler(const error_code &error, size_t len, const shared_array<uint8_t> &pduLength) {
     if (error) {
         if (error == boost::asio::error::operation_aborted) {
@@ -505,6 +1406,7 @@ void SmppClient::readPduHeaderHandler(const error_code &error, size_t len, const
             return;
         }
 
+        dumpFlightRecorder(system_error(error).what());
         throw TransportException(system_error(error).what());
     }
 
@@ -518,59 +1420,83 @@ void SmppClient::readPduHeaderHandler(const error_code &error, size_t len, const
 
 void SmppClient::readPduHeaderHandlerBlocking(optional<error_code>* opt, const error_code &error, size_t read,
         shared_array<uint8_t> pduLength) {
+    opt->reset(error);
+
     if (error) {
         if (error == boost::asio::error::operation_aborted) {
             // Not treated as an error
             return;
         }
 
+        dumpFlightRecorder(system_error(error).what());
         throw TransportException(system_error(error).what());
     }
 
-    opt->reset(error);
     uint32_t i = PDU::getPduLength(pduLength);
     shared_array<uint8_t> pduBuffer(new uint8_t[i - 4]);
     // start reading after the size mark of the pdu
     async_read(*socket, buffer(pduBuffer.get(), i - 4),
                boost::bind(&smpp::SmppClient::readPduBodyHandler, this, _1, _2, pduLength, pduBuffer));
-    socketExecute();
+
+    // the timer may expire first, but the body is read in full to keep the stream in sync
+    while (!receivedBuffer) {
+        socketExecute();
+    }
 }
 
 void SmppClient::readPduBodyHandler(const error_code &error, size_t len, shared_array<uint8_t> pduLength,
                                     shared_array<uint8_t> pduBuffer) {
     if (error) {
+        dumpFlightRecorder(system_error(error).what());
         throw TransportException(system_error(error).what());
     }
 
-    PDU pdu(pduLength, pduBuffer);
-    pdu_queue.push_back(pdu);
+    receivedLength = pduLength;
+    receivedBuffer = pduBuffer;
 }
 
 // blocks until response is read
 PDU SmppClient::readPduResponse(const uint32_t &sequence, const uint32_t &commandId) {
     uint32_t response = GENERIC_NACK | commandId;
-    list<PDU>::iterator it = pdu_queue.begin();
+    InboundQueue::iterator it = pdu_queue.begin(InboundQueue::RESPONSES);
 
-    while (it != pdu_queue.end()) {
+    while (it != pdu_queue.end(InboundQueue::RESPONSES)) {
         PDU pdu = (*it);
 
         if (pdu.getSequenceNo() == sequence && pdu.getCommandId() == response) {
-            it = pdu_queue.erase(it);
+            it = pdu_queue.erase(InboundQueue::RESPONSES, it);
             return pdu;
         }
 
         it++;
     }
 
+    // the response may be behind other PDUs, so the socket is read even if the inbound queue is full
     while (true) {
         PDU pdu = readPdu(true);
 
+        if (pdu.null && metrics != 0) {
+            metrics->timeout();
+        }
+
         if (!pdu.null) {
             if ((pdu.getSequenceNo() == sequence && (pdu.getCommandId() == response
                     || pdu.getCommandId() == GENERIC_NACK))
                     || (pdu.getSequenceNo() == 0 && pdu.getCommandId() == GENERIC_NACK)) {
+                if (pdu.getCommandId() == GENERIC_NACK) {
+                    dumpFlightRecorder("Received generic_nack");
+                }
+
                 return pdu;
             }
+
+            if (pdu.getCommandId() == ENQUIRE_LINK) {
+                PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
+                sendPdu(resp);
+                continue;
+            }
+
+            enqueue(pdu);
         }
     }
 
@@ -579,14 +1505,16 @@ PDU SmppClient::readPduResponse(const uint32_t &sequence, const uint32_t &comman
 }
 
 void smpp::SmppClient::enquireLinkRespond() {
-    list<PDU>::iterator it = pdu_queue.begin();
+    InboundQueue::iterator it = pdu_queue.begin(InboundQueue::REQUESTS);
 
-    while (it != pdu_queue.end()) {
+    while (it != pdu_queue.end(InboundQueue::REQUESTS)) {
         PDU pdu = (*it);
 
         if (pdu.getCommandId() == ENQUIRE_LINK) {
             PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
-            sendCommand(resp);
+            sendPdu(resp);
+            it = pdu_queue.erase(InboundQueue::REQUESTS, it);
+            continue;
         }
 
         it++;
@@ -597,6 +1525,8 @@ void smpp::SmppClient::enquireLinkRespond() {
     if (!pdu.null && pdu.getCommandId() == ENQUIRE_LINK) {
         PDU resp = PDU(ENQUIRE_LINK_RESP, 0, pdu.getSequenceNo());
         sendPdu(resp);
+    } else {
+        enqueue(pdu);
     }
 }
 
@@ -23,23 +23,53 @@
 
 #include <glog/logging.h>
 
+#include <exception>
 #include <list>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "smpp/clock.h"
+#include "smpp/duplicatefilter.h"
 #include "smpp/exceptions.h"
+#include "smpp/flightrecorder.h"
+#include "smpp/inboundqueue.h"
+#include "smpp/latencyhistogram.h"
+#include "smpp/metrics.h"
+#include "smpp/multiparttracker.h"
+#include "smpp/pcapwriter.h"
 #include "smpp/pdu.h"
 #include "smpp/smpp.h"
 #include "smpp/sms.h"
+#include "smpp/smsview.h"
 #include "smpp/timeformat.h"
 #include "smpp/tlv.h"
 
 namespace smpp {
 
-typedef boost::tuple<std::string, boost::local_time::local_date_time, int, int> QuerySmResult;
+/**
+ * State of a message sent earlier, as returned by the SMSC in a QUERY_SM_RESP.
+ */
+struct QuerySmResult {
+    std::string messageId;
+    // Time the message reached its final state in seconds since the epoch, 0 if it has not
+    time_t finalDate;
+    // One of the STATE_* constants
+    uint8_t messageState;
+    // Network specific error code
+    uint8_t errorCode;
+    // Command status of the response, which is not ESME_ROK if a query of a batch failed
+    uint32_t commandStatus;
+};
+
+/**
+ * Handler of a PDU sent by the SMSC. Returns the command status of the response to the PDU, if it needs one.
+ */
+typedef boost::function<uint32_t(PDU &pdu)> PduHandler;
 
 /**
  * Class for sending and receiving SMSes through the SMPP protocol.
@@ -59,6 +89,11 @@ class SmppClient {
         OPEN, BOUND_TX, BOUND_RX, BOUND_TRX
     };
 
+    // Number of command ids which can have a handler, see handlerIndex()
+    static const int HANDLERS = 6;
+    // Number of command ids with a latency histogram, see latencyIndex()
+    static const int LATENCY_COMMANDS = 5;
+
     // SMPP bind parameters
     std::string systemType;
     uint8_t interfaceVersion;  // interfaceVersion = 0x34;
@@ -80,10 +115,48 @@ class SmppClient {
 
     boost::function<uint16_t()> msgRefCallback;
 
+    // Message ids of the segments sent by the last sendSms
+    std::vector<std::string> lastMessageIds;
+    MultipartTracker* multipartTracker;
+    DuplicateFilter* duplicateFilter;
+    Metrics* metrics;
+    FlightRecorder* flightRecorder;
+    PcapWriter* pcapWriter;
+    // True once the session has been bound, so later binds are counted as reconnects
+    bool wasBound;
+
+    // A DELIVER_SM read with deferred acknowledgement, and its fingerprint for the duplicate filter, zero if none.
+    struct UnackedSms {
+        uint32_t sequence;
+        uint64_t fingerprint;
+    };
+
+    // Deferred acknowledgement of DELIVER_SM. The handles are generated by the client, as the SMSC may reuse the
+    // sequence number of an unacknowledged PDU, and map to the PDU.
+    bool deferredAck;
+    size_t maxUnacked;
+    uint32_t nextAckHandle;
+    std::unordered_map<uint32_t, UnackedSms> unacked;
+    // Handle of the DELIVER_SM being dispatched to a handler
+    uint32_t dispatchAckHandle;
+    // The acknowledgements not yet sent and their command status
+    std::vector<std::pair<UnackedSms, uint32_t> > pendingAcks;
+    boost::mutex ackMutex;
+    boost::condition_variable ackCondition;
+
+    PduHandler handlers[HANDLERS];
+    // Exception of a handler called while waiting for a response, raised by the next dispatchPdus
+    std::exception_ptr handlerError;
+    // Time from sending a command to receiving its response
+    LatencyHistogram latencies[LATENCY_COMMANDS];
+
     int state;
     std::shared_ptr<boost::asio::ip::tcp::socket> socket;
     uint32_t seqNo;
-    std::list<PDU> pdu_queue;
+    InboundQueue pdu_queue;
+    // PDU read from the socket by the read handlers, until it is taken by takeReceivedPdu()
+    boost::shared_array<uint8_t> receivedLength;
+    boost::shared_array<uint8_t> receivedBuffer;
     // Socket write timeout in milliseconds. Default is 5000 milliseconds.
     int socketWriteTimeout;
     // Socket read timeout in milliseconds. Default is 30000 milliseconds.
@@ -143,10 +216,69 @@ class SmppClient {
      */
     smpp::SMS readSms();
 
+    /**
+     * Reads the next SMS like readSms, when deferred acknowledgement is enabled.
+     * The SMSC is not sent a response until the SMS is acknowledged with ack().
+     * Returns an empty SMS if the number of unacknowledged SMSes stays at the limit for the socket read timeout.
+     *
+     * @param ackHandle Set to the handle to acknowledge the SMS with.
+     */
+    smpp::SMS readSms(uint32_t* ackHandle);
+
+    /**
+     * Reads the next SMS like readSms, but returns a lazily decoded view sharing the buffer of the received PDU.
+     * Useful when only a few fields are needed, ie. for delivery reports.
+     */
+    smpp::SmsView readSmsView();
+
+    smpp::SmsView readSmsView(uint32_t* ackHandle);
+
+    /**
+     * Returns all SMSes which are buffered or can be read from the socket without blocking, up to max.
+     * If there are none, it blocks for up to timeout milliseconds until one arrives.
+     * The responses to all of them are sent to the SMSC in a single write, as are responses to enquire links and
+     * DATA_SM received meanwhile.
+     *
+     * With deferred acknowledgement the SMSes are not responded to, and no more are returned than the limit of
+     * unacknowledged SMSes allows.
+     *
+     * Malformed SMSes are answered with an error status and left out. If reading fails after some SMSes were taken,
+     * those are returned and the failure is thrown by the next call.
+     *
+     * @param max Maximum number of SMSes to return.
+     * @param timeout Milliseconds to wait if no SMS is buffered.
+     * @param ackHandles Set to the handles to acknowledge the SMSes with, required with deferred acknowledgement.
+     * @return SMSes in the order they were received, empty if none arrived within the timeout.
+     */
+    std::vector<smpp::SMS> readSmsBatch(const size_t max, const int timeout,
+                                        std::vector<uint32_t>* ackHandles = 0);
+
+    /**
+     * Acknowledges an SMS read with deferred acknowledgement. May be called from any thread; the response is sent
+     * to the SMSC by the thread reading SMSes, the next time it reads or calls flushAcks().
+     *
+     * @param ackHandle Handle returned when the SMS was read.
+     * @param status Command status of the response, ie. ESME_RX_T_APPN to have the SMSC retry it later.
+     * @throw SmppException if the handle is not of an unacknowledged SMS.
+     */
+    void ack(const uint32_t ackHandle, const uint32_t status = smpp::ESME_ROK);
+
+    /**
+     * Acknowledges several SMSes like ack(), either all of them or none.
+     * @throw SmppException if a handle is not of an unacknowledged SMS or is repeated.
+     */
+    void ack(const std::vector<uint32_t> &ackHandles, const uint32_t status = smpp::ESME_ROK);
+
+    /**
+     * Sends the responses of all acknowledged SMSes to the SMSC in a single write.
+     * Must be called from the thread reading SMSes.
+     */
+    void flushAcks();
+
     /**
      * Query the SMSC about current state/status of a previous sent SMS.
      * You must specify the SMSC assigned message id and source of the sent SMS.
-     * Returns an boost::tuple with elements: message_id, final_date, message_state and error_code.
+     * Returns the message id, final date, message state and error code of the SMS.
      * message_state would be one of the SMPP::STATE_* constants. (SMPP v3.4 section 5.2.28)
      * error_code depends on the telco network, so could be anything.
      *
@@ -156,6 +288,50 @@ class SmppClient {
      */
     QuerySmResult querySm(std::string messageid, SmppAddress source);
 
+    /**
+     * Queries the state of many SMSes, keeping up to window queries in flight instead of waiting for each response
+     * before sending the next query. Queries which can be sent at the same time are sent in a single write.
+     * A query the SMSC rejects does not fail the batch, its result has the command status of the response and the
+     * message id of the query.
+     *
+     * @param queries SMSC assigned message id and source of each SMS.
+     * @param window Maximum number of queries awaiting a response.
+     * @param rate Maximum number of queries sent per second, 0 for no limit.
+     * @return Result of each query, in the order of the queries.
+     * @throw TransportException if no response arrives within the socket read timeout.
+     */
+    std::vector<QuerySmResult> querySmBatch(const std::vector<std::pair<std::string, SmppAddress> > &queries,
+                                            const size_t window = 10, const uint32_t rate = 0);
+
+    /**
+     * Registers a handler for a PDU the SMSC sends: DELIVER_SM, DATA_SM, ALERT_NOTIFICATION, OUTBIND, UNBIND or
+     * GENERIC_NACK, except the generic nack of a command we are waiting for a response to.
+     * The handler is called as soon as the PDU is read, by whichever method of the client is reading the socket,
+     * instead of the PDU being queued for readSms.
+     * DELIVER_SM, DATA_SM and UNBIND are then responded to with the command status the handler returns, and the
+     * client is unbound if it accepts an UNBIND. With deferred acknowledgement DELIVER_SM is not responded to,
+     * but must be acknowledged with the handle getDispatchAckHandle() returns while the handler runs.
+     * If the handler throws, DELIVER_SM and DATA_SM are responded to with ESME_RX_T_APPN. The exception is passed on
+     * by dispatchPdus; if the handler was called while waiting for the response to a command, it is logged and
+     * raised by the next call of dispatchPdus instead, so the command is not failed.
+     *
+     * @param commandId Command id of the PDUs to handle.
+     * @param handler Handler, or an empty function to queue the PDUs again.
+     * @throw SmppException if PDUs of the command id cannot be handled.
+     */
+    void setPduHandler(const uint32_t commandId, const PduHandler &handler);
+
+    /**
+     * Dispatches the queued PDUs which have a handler, and then reads PDUs from the SMSC and dispatches them as
+     * they arrive, until the timeout expires or the SMSC unbinds.
+     * With deferred acknowledgement the socket is not read while the limit of unacknowledged SMSes is reached.
+     *
+     * @param timeout Milliseconds to read for.
+     * @return Number of PDUs dispatched to a handler.
+     * @throw The exception of a handler, see setPduHandler().
+     */
+    size_t dispatchPdus(const int timeout);
+
     /**
      * Sends an enquire link command to SMSC and blocks until we a response.
      */
@@ -311,6 +487,10 @@ class SmppClient {
         return socketWriteTimeout;
     }
 
+    /**
+     * Logs every PDU sent and received with a hexdump. This is slow, see setFlightRecorder for a recorder which can
+     * be used in production.
+     */
     void setVerbose(const bool b) {
         verbose = b;
     }
@@ -328,6 +508,135 @@ class SmppClient {
         msgRefCallback = cb;
     }
 
+    /**
+     * Enables deferred acknowledgement, so SMSes are responded to when the application acknowledges them with ack(),
+     * ie. after persisting them, rather than when they are read. Must be set before reading any SMS.
+     * @param b True to enable deferred acknowledgement.
+     */
+    void setDeferredAck(const bool b) {
+        deferredAck = b;
+    }
+
+    bool isDeferredAck() const {
+        return deferredAck;
+    }
+
+    /**
+     * Sets the maximum number of unacknowledged SMSes. When it is reached the client stops reading the socket,
+     * which makes the SMSC hold back further messages. Default is 1000.
+     * @param max Maximum number of unacknowledged SMSes.
+     */
+    void setMaxUnacked(const size_t max) {
+        maxUnacked = max;
+    }
+
+    size_t getMaxUnacked() const {
+        return maxUnacked;
+    }
+
+    /**
+     * @return Number of SMSes read with deferred acknowledgement which have not been acknowledged.
+     */
+    size_t getUnackedCount() {
+        boost::mutex::scoped_lock lock(ackMutex);
+        return unacked.size();
+    }
+
+    /**
+     * @return Handle to acknowledge the DELIVER_SM being dispatched to a handler with, see setPduHandler().
+     */
+    uint32_t getDispatchAckHandle() const {
+        return dispatchAckHandle;
+    }
+
+    /**
+     * Sets the maximum number of PDUs of each kind buffered while they are not handled, ie. SMSes received while
+     * waiting for a response. When the queue of SMSes is full the client stops polling the socket. Default is 1000.
+     * @param capacity Maximum number of PDUs of each kind.
+     */
+    void setInboundQueueCapacity(const size_t capacity) {
+        pdu_queue.setCapacity(InboundQueue::RESPONSES, capacity);
+        pdu_queue.setCapacity(InboundQueue::MESSAGES, capacity);
+        pdu_queue.setCapacity(InboundQueue::REQUESTS, capacity);
+    }
+
+    /**
+     * @return Depth, overflow and pause counters of the inbound PDU queue.
+     */
+    InboundQueueStats getInboundQueueStats() const {
+        return pdu_queue.getStats();
+    }
+
+    /**
+     * Returns the latencies of a command, from sending it to receiving its response, which can be merged with those
+     * of other sessions. Latencies are recorded for the binds, SUBMIT_SM, QUERY_SM, ENQUIRE_LINK and UNBIND; the
+     * three binds share a histogram.
+     * @param commandId Command id of the request.
+     * @throw SmppException if latencies are not recorded for the command id.
+     */
+    LatencySnapshot getLatency(const uint32_t commandId) const;
+
+    /**
+     * Clears the latencies of all commands, ie. at the start of an interval.
+     */
+    void resetLatencies();
+
+    /**
+     * Sets metrics which the PDUs, responses, reconnects and timeouts of the session are counted in. Several
+     * clients, ie. of a pool, may share the same metrics. The metrics are not owned by the client.
+     * @param metrics Metrics, or null to stop counting.
+     */
+    void setMetrics(Metrics* _metrics) {
+        metrics = _metrics;
+        pdu_queue.setMetrics(_metrics);
+    }
+
+    /**
+     * Sets a flight recorder which every PDU sent and received is recorded in. The recorder is logged when the
+     * connection fails or the SMSC sends a generic_nack, and can be dumped on demand. It is far cheaper than
+     * verbose logging, so it can be left on in production. The recorder is not owned by the client.
+     * @param recorder Recorder, or null to stop recording.
+     */
+    void setFlightRecorder(FlightRecorder* recorder) {
+        flightRecorder = recorder;
+    }
+
+    /**
+     * Sets a writer which every PDU sent and received is captured with. The writer is made for the endpoints of the
+     * current connection, ie. socket->local_endpoint() and socket->remote_endpoint(), and is not owned by the client.
+     * @param writer Writer, or null to stop capturing.
+     */
+    void setPcapWriter(PcapWriter* writer) {
+        pcapWriter = writer;
+    }
+
+    /**
+     * Set a tracker which sendSms registers the segments of every message with, so the receipts of all segments
+     * can be aggregated into one outcome. The tracker is not owned by the client.
+     * @param tracker Tracker, or null to stop tracking.
+     */
+    void setMultipartTracker(MultipartTracker* tracker) {
+        multipartTracker = tracker;
+    }
+
+    /**
+     * Set a filter which DELIVER_SM are checked against, so ones the SMSC sends again, ie. because our response was
+     * late, are responded to but not returned or dispatched again. Only DELIVER_SM acknowledged with ESME_ROK are
+     * remembered, so one which was rejected or failed is returned again when the SMSC retries it. The filter is not
+     * owned by the client.
+     * @param filter Filter, or null to stop filtering.
+     */
+    void setDuplicateFilter(DuplicateFilter* filter) {
+        duplicateFilter = filter;
+    }
+
+    /**
+     * @return The message ids of all segments sent by the last call to sendSms, in order.
+     */
+    const std::vector<std::string> &getLastMessageIds() const {
+        return lastMessageIds;
+    }
+
   private:
     /**
      * Binds the client to be in the mode specified in the mode parameter.
@@ -347,12 +656,42 @@ class SmppClient {
     smpp::PDU setupBindPdu(uint32_t mode, const std::string &login, const std::string &password);
 
     /**
-     * Runs through the PDU queue and returns the first sms it finds, and sends a reponse to the SMSC.
+     * Returns the first DELIVER_SM PDU in the PDU queue,
+     * or does a blocking read on the socket until we receive one from the SMSC.
+     */
+    PDU readDeliverSm();
+
+    /**
+     * Runs through the PDU queue and returns the first DELIVER_SM PDU it finds, and sends a reponse to the SMSC.
      * While running through the PDU queuy, Alert notification and DataSm PDU are handled as well.
+     * A DELIVER_SM which cannot be decoded is rejected with an error status and skipped.
      *
-     * @return First sms found in the PDU queue or a null sms if there was no smses.
+     * @return First DELIVER_SM PDU found in the PDU queue or a null PDU if there was none.
+     */
+    PDU parseDeliverSm();
+
+    /**
+     * Removes up to max DELIVER_SM PDUs from the PDU queue and appends them to batch.
+     * Responses to the DELIVER_SM, DATA_SM and ENQUIRE_LINK PDUs taken from the queue are appended to responses
+     * instead of being sent. Alert notifications are dropped.
      */
-    smpp::SMS parseSms();
+    void parseDeliverSmBatch(const size_t max, std::vector<SMS>* batch, std::vector<PDU>* responses,
+                             std::vector<uint32_t>* ackHandles);
+
+    /**
+     * Sends the pending acknowledgements and waits for the number of unacknowledged SMSes to drop below the limit.
+     * @param timeout Milliseconds to wait.
+     * @return Number of SMSes which can be read before the limit is reached, zero if it was not.
+     */
+    size_t waitForAckWindow(const int timeout);
+
+    /**
+     * Registers a DELIVER_SM read with deferred acknowledgement.
+     * @param sequence Sequence number of the DELIVER_SM.
+     * @param fingerprint Fingerprint to remember if it is acknowledged with ESME_ROK, zero if none.
+     * @return Handle to acknowledge it with.
+     */
+    uint32_t addUnacked(const uint32_t sequence, const uint64_t fingerprint);
 
     /**
      * Splits a string, without leaving a dangling escape character, into an vector of substrings of a given length,
@@ -363,6 +702,11 @@ class SmppClient {
      */
     std::vector<std::string> split(const std::string &shortMessage, const int split);
 
+    /**
+     * Registers the segments of the last message with the multipart tracker, if there is one.
+     */
+    void trackLastMessage();
+
     /**
      * Sends a SUBMIT_SM pdu with the required details for sending an SMS to the SMSC.
      * It blocks until it gets a response from the SMSC.
@@ -378,9 +722,14 @@ class SmppClient {
      * @return SMSC sms id.
      */
     std::string submitSm(const SmppAddress &sender, const SmppAddress &receiver, const std::string &shortMessage,
-                         std::list<TLV> tags, const uint8_t priority_flag, const std::string &schedule_delivery_time,
-                         const std::string &validity_period, const int esmClassOpts, const int dataCoding =
-                             smpp::DATA_CODING_DEFAULT);
+                         const std::list<TLV> &tags, const uint8_t priority_flag,
+                         const std::string &schedule_delivery_time, const std::string &validity_period,
+                         const int esmClassOpts, const int dataCoding = smpp::DATA_CODING_DEFAULT);
+
+    /**
+     * Reads the body of a QUERY_SM_RESP.
+     */
+    static QuerySmResult parseQuerySmResp(PDU &reply);
 
     /**
      * @return Returns the next sequence number.
@@ -393,6 +742,16 @@ class SmppClient {
      */
     void sendPdu(PDU &pdu);
 
+    /**
+     * Sends several PDUs to the SMSC in a single write.
+     */
+    void sendPdus(std::vector<PDU> &pdus);
+
+    /**
+     * Writes a buffer to the socket, blocking until it is written or the write timeout expires.
+     */
+    void socketWrite(const uint8_t* data, const size_t length);
+
     /**
      * Sends one PDU to the SMSC and blocks until we a response to it.
      * @param pdu PDU to send.
@@ -402,10 +761,77 @@ class SmppClient {
 
     /**
      * Returns one PDU from SMSC.
+     * A non-blocking read returns a null PDU without reading the socket while the PDU queue is full.
      */
     PDU readPdu(const bool &);
 
-    void readPduBlocking();
+    /**
+     * Reads one PDU, waiting at most timeout milliseconds for it.
+     * @return The PDU, or a null PDU if none arrived in time.
+     */
+    PDU readPduBlocking(const int timeout);
+
+    /**
+     * Returns the PDU last read by the read handlers, or a null PDU if there is none.
+     */
+    PDU takeReceivedPdu();
+
+    /**
+     * @return Index in handlers of a command id, or -1 if it cannot have a handler.
+     */
+    static int handlerIndex(const uint32_t commandId);
+
+    /**
+     * @return Index in latencies of a command id, or -1 if its latency is not recorded.
+     */
+    static int latencyIndex(const uint32_t commandId);
+
+    /**
+     * Logs the records of the flight recorder, if there is one.
+     * @param reason Error which caused the dump.
+     */
+    void dumpFlightRecorder(const std::string &reason);
+
+    /**
+     * Records the latency of a command sent at start, as given by MonotonicClock.
+     */
+    void recordLatency(const uint32_t commandId, const int64_t start);
+
+    /**
+     * @return Fingerprint of a DELIVER_SM for the duplicate filter, zero if there is no filter or it is malformed.
+     */
+    uint64_t fingerprintOf(PDU &pdu);
+
+    /**
+     * @return True if a DELIVER_SM was acknowledged before, according to the duplicate filter.
+     */
+    bool isDuplicate(const uint64_t fingerprint);
+
+    /**
+     * Remembers a DELIVER_SM acknowledged with ESME_ROK in the duplicate filter, so it is not returned again.
+     * @param fingerprint Fingerprint of the DELIVER_SM, zero if none.
+     */
+    void rememberAcked(const uint64_t fingerprint);
+
+    /**
+     * Checks that a DELIVER_SM can be decoded, so it is rejected instead of being acknowledged and then lost when the
+     * application fails to decode it.
+     * @return ESME_ROK, or the status to respond with.
+     */
+    static uint32_t checkDeliverSm(PDU &pdu);
+
+    /**
+     * Calls the handler of a PDU and sends the response to it.
+     * @return False if there is no handler for the PDU.
+     */
+    bool dispatch(const PDU &pdu);
+
+    /**
+     * Adds a PDU read from the socket to the PDU queue, unless it has a handler. If the queue of its kind is full,
+     * a DELIVER_SM or DATA_SM is rejected with a temporary error and an ENQUIRE_LINK is answered at once, other PDUs
+     * are dropped. An exception of the handler is kept for the next dispatchPdus.
+     */
+    void enqueue(const PDU &pdu);
 
     void handleTimeout(boost::optional<boost::system::error_code>* opt, const boost::system::error_code &error);
 
@@ -427,6 +853,22 @@ class SmppClient {
      */
     void socketExecute();
 
+    /**
+     * Executes pending async operations until the I/O operation or its timer has completed.
+     * @param ioResult Result of the I/O operation.
+     * @param timerResult Result of the timer.
+     */
+    void awaitFirst(const boost::optional<boost::system::error_code> &ioResult,
+                    const boost::optional<boost::system::error_code> &timerResult);
+
+    /**
+     * Executes pending async operations until both the I/O operation and its timer have completed.
+     * @param ioResult Result of the I/O operation.
+     * @param timerResult Result of the timer.
+     */
+    void awaitBoth(const boost::optional<boost::system::error_code> &ioResult,
+                   const boost::optional<boost::system::error_code> &timerResult);
+
     /**
      * Handler for reading a PDU header.
      * If we read a valid PDU header on the socket, the readPduBodyHandler is invoked.
@@ -442,7 +884,7 @@ class SmppClient {
 
     /**
      * Handler for reading a PDU body.
-     * Reads a PDU body on the socket and pushes it onto the PDU queue.
+     * Reads a PDU body on the socket and keeps it for takeReceivedPdu().
      *
      * @param error Boost error code
      * @param read Bytes read
@@ -5,12 +5,11 @@
  */
 
 #include "smpp/sms.h"
-#include <regex>
 #include <string>
+#include "smpp/receipt.h"
 
 using std::endl;
 using std::streamsize;
-using std::stoi;
 using std::string;
 
 namespace smpp {
@@ -80,25 +79,15 @@ SMS::SMS(PDU &pdu) :
     pdu.readOctets(msg, boost::numeric_cast<streamsize>(sm_length));
     short_message = string(reinterpret_cast<char*>(msg.get()), boost::numeric_cast<size_t>(sm_length));
     // fetch any optional tags
-    uint16_t len = 0;
-    uint16_t tag = 0;
-
     while (pdu.hasMoreData()) {
-        pdu >> tag;
-        pdu >> len;
+        TLV tlv(0);
+        pdu >> tlv;
 
-        if (tag == 0) {
+        if (tlv.getTag() == 0) {
             break;
         }
 
-        if (len == 0) {
-            tlvs.push_back(TLV(tag));
-            continue;
-        }
-
-        boost::shared_array<uint8_t> octets(new uint8_t[len]);
-        pdu.readOctets(octets, len);
-        tlvs.push_back(TLV(tag, len, octets));
+        tlvs.push_back(tlv);
     }
 }
 
@@ -124,7 +113,7 @@ SMS::SMS(const SMS &rhs) :
     tlvs(), /**/
     is_null(rhs.is_null) {
     if (!is_null) {
-        tlvs.assign(rhs.tlvs.begin(), rhs.tlvs.end());
+        tlvs = rhs.tlvs;
     }
 }
 
@@ -150,19 +139,24 @@ DeliveryReport::DeliveryReport(const SMS &sms) :
     stat(""), /**/
     err(""), /**/
     text("") {
-    std::regex expression(
-        "^id:([^ ]+)\\s+sub:(\\d{1,3})\\s+dlvrd:(\\d{1,3})\\s+submit\\s+date:(\\d{1,10})\\s+done\\s+date:(\\d{1,10})\\s+stat:([A-Z]{7})\\s+err:(\\d{1,3})\\s+text:(.*)$");
-    std::smatch what;
-
-    if (std::regex_match(short_message, what, expression)) {
-        id = what[1];
-        sub = stoi(what[2]);
-        dlvrd = stoi(what[3]);
-        submitDate = smpp::timeformat::parseDlrTimestamp(what[4]);
-        doneDate = smpp::timeformat::parseDlrTimestamp(what[5]);
-        stat = what[6];
-        err = what[7];
-        text = what[8];
+    receipt::ReceiptText fields;
+
+    if (receipt::scanText(short_message.data(), short_message.length(), &fields)) {
+        id = fields.id.str();
+        sub = receipt::parseDecimal(fields.sub);
+        dlvrd = receipt::parseDecimal(fields.dlvrd);
+
+        if (!fields.submitDate.empty()) {
+            submitDate = smpp::timeformat::parseDlrTimestamp(fields.submitDate.data, fields.submitDate.length);
+        }
+
+        if (!fields.doneDate.empty()) {
+            doneDate = smpp::timeformat::parseDlrTimestamp(fields.doneDate.data, fields.doneDate.length);
+        }
+
+        stat = fields.stat.str();
+        err = fields.err.str();
+        text = fields.text.str();
     }
 }
 
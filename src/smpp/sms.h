@@ -18,6 +18,7 @@
 #include "smpp/smpp.h"
 #include "smpp/pdu.h"
 #include "smpp/tlv.h"
+#include "smpp/tlvlist.h"
 #include "smpp/timeformat.h"
 
 namespace smpp {
@@ -50,7 +51,7 @@ class SMS {
     int sm_length;
 
     std::string short_message;
-    std::list<TLV> tlvs;
+    TlvList tlvs;
 
     bool is_null;
 
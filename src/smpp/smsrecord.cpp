@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/smsrecord.h"
+#include <cstring>
+#include <string>
+
+using std::string;
+
+namespace smpp {
+namespace {
+/*
+ * Copies a string of len chars into a field of the given size and null terminates it.
+ */
+void copyField(char* field, const size_t size, const char* value, const size_t len) {
+    if (len >= size) {
+        throw smpp::SmppException("SmsRecord field is too long");
+    }
+
+    memcpy(field, value, len);
+    field[len] = '\0';
+}
+
+void copyField(char* field, const size_t size, const string &value) {
+    copyField(field, size, value.data(), value.length());
+}
+}  // namespace
+
+static_assert(sizeof(SmsRecord) == 512, "SmsRecord should be 512 bytes");
+
+SmsRecord::SmsRecord() :
+    source_addr_ton(0), /**/
+    source_addr_npi(0), /**/
+    dest_addr_ton(0), /**/
+    dest_addr_npi(0), /**/
+    esm_class(0), /**/
+    protocol_id(0), /**/
+    priority_flag(0), /**/
+    registered_delivery(0), /**/
+    replace_if_present_flag(0), /**/
+    data_coding(0), /**/
+    sm_default_msg_id(0), /**/
+    sm_length(0), /**/
+    is_null(true), /**/
+    tlv_length(0) {
+    service_type[0] = '\0';
+    source_addr[0] = '\0';
+    dest_addr[0] = '\0';
+    schedule_delivery_time[0] = '\0';
+    validity_period[0] = '\0';
+}
+
+SmsRecord::SmsRecord(const SmsView &view) :
+    source_addr_ton(0), /**/
+    source_addr_npi(0), /**/
+    dest_addr_ton(0), /**/
+    dest_addr_npi(0), /**/
+    esm_class(0), /**/
+    protocol_id(0), /**/
+    priority_flag(0), /**/
+    registered_delivery(0), /**/
+    replace_if_present_flag(0), /**/
+    data_coding(0), /**/
+    sm_default_msg_id(0), /**/
+    sm_length(0), /**/
+    is_null(view.isNull()), /**/
+    tlv_length(0) {
+    if (is_null) {
+        *this = SmsRecord();
+        return;
+    }
+
+    const char* base = reinterpret_cast<const char*>(view.base);
+    // the view has already checked that the strings are null terminated
+    copyField(service_type, SERVICE_TYPE_SIZE, base + SmsView::BODY_OFFSET, strlen(base + SmsView::BODY_OFFSET));
+    source_addr_ton = view.getSourceAddrTon();
+    source_addr_npi = view.getSourceAddrNpi();
+    copyField(source_addr, ADDR_SIZE, base + view.sourceAddr, strlen(base + view.sourceAddr));
+    dest_addr_ton = view.getDestAddrTon();
+    dest_addr_npi = view.getDestAddrNpi();
+    copyField(dest_addr, ADDR_SIZE, base + view.destAddr, strlen(base + view.destAddr));
+    esm_class = view.getEsmClass();
+    protocol_id = view.getProtocolId();
+    priority_flag = view.getPriorityFlag();
+    copyField(schedule_delivery_time, TIME_SIZE, base + view.scheduleDeliveryTime,
+              strlen(base + view.scheduleDeliveryTime));
+    copyField(validity_period, TIME_SIZE, base + view.validityPeriod, strlen(base + view.validityPeriod));
+    registered_delivery = view.getRegisteredDelivery();
+    replace_if_present_flag = view.getReplaceIfPresentFlag();
+    data_coding = view.getDataCoding();
+    sm_default_msg_id = view.getSmDefaultMsgId();
+    sm_length = view.getSmLength();
+
+    if (sm_length > SHORT_MESSAGE_SIZE) {
+        throw smpp::SmppException("SmsRecord short message is too long");
+    }
+
+    memcpy(short_message, view.getShortMessageData(), sm_length);
+    uint32_t tlvs = view.length - view.tlvs;
+
+    if (tlvs > TLV_AREA_SIZE) {
+        throw smpp::SmppException("SmsRecord TLVs do not fit in the record");
+    }
+
+    memcpy(tlv_area, view.base + view.tlvs, tlvs);
+    tlv_length = static_cast<uint16_t>(tlvs);
+}
+
+SmsRecord::SmsRecord(const SMS &sms) :
+    source_addr_ton(static_cast<uint8_t>(sms.source_addr_ton)), /**/
+    source_addr_npi(static_cast<uint8_t>(sms.source_addr_npi)), /**/
+    dest_addr_ton(static_cast<uint8_t>(sms.dest_addr_ton)), /**/
+    dest_addr_npi(static_cast<uint8_t>(sms.dest_addr_npi)), /**/
+    esm_class(sms.esm_class), /**/
+    protocol_id(static_cast<uint8_t>(sms.protocol_id)), /**/
+    priority_flag(static_cast<uint8_t>(sms.priority_flag)), /**/
+    registered_delivery(static_cast<uint8_t>(sms.registered_delivery)), /**/
+    replace_if_present_flag(static_cast<uint8_t>(sms.replace_if_present_flag)), /**/
+    data_coding(sms.data_coding), /**/
+    sm_default_msg_id(static_cast<uint8_t>(sms.sm_default_msg_id)), /**/
+    sm_length(0), /**/
+    is_null(sms.is_null), /**/
+    tlv_length(0) {
+    copyField(service_type, SERVICE_TYPE_SIZE, sms.service_type);
+    copyField(source_addr, ADDR_SIZE, sms.source_addr);
+    copyField(dest_addr, ADDR_SIZE, sms.dest_addr);
+    copyField(schedule_delivery_time, TIME_SIZE, sms.schedule_delivery_time);
+    copyField(validity_period, TIME_SIZE, sms.validity_period);
+
+    if (sms.short_message.length() > SHORT_MESSAGE_SIZE) {
+        throw smpp::SmppException("SmsRecord short message is too long");
+    }
+
+    sm_length = static_cast<uint8_t>(sms.short_message.length());
+    memcpy(short_message, sms.short_message.data(), sm_length);
+
+    for (TlvList::const_iterator it = sms.tlvs.begin(); it != sms.tlvs.end(); ++it) {
+        uint16_t len = it->getLen();
+
+        if (tlv_length + 4u + len > TLV_AREA_SIZE) {
+            throw smpp::SmppException("SmsRecord TLVs do not fit in the record");
+        }
+
+        uint8_t* pos = tlv_area + tlv_length;
+        pos[0] = static_cast<uint8_t>(it->getTag() >> 8);
+        pos[1] = static_cast<uint8_t>(it->getTag() & 0xff);
+        pos[2] = static_cast<uint8_t>(len >> 8);
+        pos[3] = static_cast<uint8_t>(len & 0xff);
+
+        if (len != 0) {
+            memcpy(pos + 4, it->getData(), len);
+        }
+
+        tlv_length = static_cast<uint16_t>(tlv_length + 4 + len);
+    }
+}
+
+const uint8_t* SmsRecord::findTlv(const uint16_t tag, uint16_t* len) const {
+    uint32_t pos = 0;
+
+    while (pos + 4 <= tlv_length) {
+        uint16_t t = static_cast<uint16_t>((tlv_area[pos] << 8) | tlv_area[pos + 1]);
+        uint16_t l = static_cast<uint16_t>((tlv_area[pos + 2] << 8) | tlv_area[pos + 3]);
+
+        if (t == 0 || pos + 4 + l > tlv_length) {
+            break;
+        }
+
+        if (t == tag) {
+            *len = l;
+            return tlv_area + pos + 4;
+        }
+
+        pos += 4 + l;
+    }
+
+    return 0;
+}
+
+TlvList SmsRecord::getTlvs() const {
+    TlvList result;
+    uint32_t pos = 0;
+
+    while (pos + 4 <= tlv_length) {
+        uint16_t t = static_cast<uint16_t>((tlv_area[pos] << 8) | tlv_area[pos + 1]);
+        uint16_t l = static_cast<uint16_t>((tlv_area[pos + 2] << 8) | tlv_area[pos + 3]);
+
+        if (t == 0 || pos + 4 + l > tlv_length) {
+            break;
+        }
+
+        result.push_back(TLV(t, l, tlv_area + pos + 4));
+        pos += 4 + l;
+    }
+
+    return result;
+}
+
+SMS SmsRecord::toSms() const {
+    SMS sms;
+
+    if (is_null) {
+        return sms;
+    }
+
+    sms.service_type = service_type;
+    sms.source_addr_ton = source_addr_ton;
+    sms.source_addr_npi = source_addr_npi;
+    sms.source_addr = source_addr;
+    sms.dest_addr_ton = dest_addr_ton;
+    sms.dest_addr_npi = dest_addr_npi;
+    sms.dest_addr = dest_addr;
+    sms.esm_class = esm_class;
+    sms.protocol_id = protocol_id;
+    sms.priority_flag = priority_flag;
+    sms.schedule_delivery_time = schedule_delivery_time;
+    sms.validity_period = validity_period;
+    sms.registered_delivery = registered_delivery;
+    sms.replace_if_present_flag = replace_if_present_flag;
+    sms.data_coding = data_coding;
+    sms.sm_default_msg_id = sm_default_msg_id;
+    sms.sm_length = sm_length;
+    sms.short_message = getShortMessage();
+    sms.tlvs = getTlvs();
+    sms.is_null = false;
+    return sms;
+}
+}  // namespace smpp
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_SMSRECORD_H_
+#define SMPP_SMSRECORD_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+#include "smpp/exceptions.h"
+#include "smpp/sms.h"
+#include "smpp/smsview.h"
+#include "smpp/tlv.h"
+#include "smpp/tlvlist.h"
+
+namespace smpp {
+/**
+ * Compact, fixed size representation of an SMS for keeping large numbers of messages in memory, ie. in queues of
+ * MO messages and delivery reports. Every field is stored inline using the maximum size given by the SMPP v3.4
+ * specification (section 5.2), one-octet fields are uint8_t and the TLVs are kept in a flat area in the same
+ * format as on the wire. A record is 512 bytes (8 cache lines), needs no allocations and can be copied with memcpy.
+ */
+class SmsRecord {
+  public:
+    // Field sizes including the null terminator
+    static const size_t SERVICE_TYPE_SIZE = 6;
+    static const size_t ADDR_SIZE = 21;
+    static const size_t TIME_SIZE = 17;
+    static const size_t SHORT_MESSAGE_SIZE = 254;
+    static const size_t TLV_AREA_SIZE = 160;
+
+    uint8_t source_addr_ton;
+    uint8_t source_addr_npi;
+    uint8_t dest_addr_ton;
+    uint8_t dest_addr_npi;
+    uint8_t esm_class;
+    uint8_t protocol_id;
+    uint8_t priority_flag;
+    uint8_t registered_delivery;
+    uint8_t replace_if_present_flag;
+    uint8_t data_coding;
+    uint8_t sm_default_msg_id;
+    uint8_t sm_length;
+    bool is_null;
+    // Octets used in tlv_area
+    uint16_t tlv_length;
+
+    char service_type[SERVICE_TYPE_SIZE];
+    char source_addr[ADDR_SIZE];
+    char dest_addr[ADDR_SIZE];
+    char schedule_delivery_time[TIME_SIZE];
+    char validity_period[TIME_SIZE];
+    uint8_t short_message[SHORT_MESSAGE_SIZE];
+    // TLVs as tag, length and value in network byte order
+    uint8_t tlv_area[TLV_AREA_SIZE];
+
+    /**
+     * Constructs a null record.
+     */
+    SmsRecord();
+
+    /**
+     * Constructs a record from a view of a received PDU, copying the TLVs in one go.
+     * @throw SmppException if a field is longer than allowed or the TLVs do not fit in the record.
+     */
+    explicit SmsRecord(const SmsView &view);
+
+    /**
+     * Constructs a record from an SMS.
+     * @throw SmppException if a field is longer than allowed or the TLVs do not fit in the record.
+     */
+    explicit SmsRecord(const SMS &sms);
+
+    /**
+     * Finds the first TLV with the given tag.
+     * @param tag TLV tag.
+     * @param len Set to the length of the value, if the TLV is found.
+     * @return Pointer to the value in tlv_area, or null if the TLV is not present.
+     */
+    const uint8_t* findTlv(const uint16_t tag, uint16_t* len) const;
+
+    /**
+     * @return Copy of the TLVs in the record.
+     */
+    TlvList getTlvs() const;
+
+    /**
+     * @return The short message as a string.
+     */
+    std::string getShortMessage() const {
+        return std::string(reinterpret_cast<const char*>(short_message), sm_length);
+    }
+
+    /**
+     * @return Fully decoded SMS with the same content as this record.
+     */
+    SMS toSms() const;
+};
+}  // namespace smpp
+
+#endif  // SMPP_SMSRECORD_H_
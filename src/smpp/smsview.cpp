@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/smsview.h"
+#include <cstring>
+#include <string>
+
+#include "smpp/tagregistry.h"
+
+using std::string;
+using boost::shared_array;
+
+namespace smpp {
+SmsView::SmsView() :
+    buffer(), /**/
+    base(0), /**/
+    length(0), /**/
+    sourceAddr(0), /**/
+    destAddr(0), /**/
+    esmClass(0), /**/
+    scheduleDeliveryTime(0), /**/
+    validityPeriod(0), /**/
+    registeredDelivery(0), /**/
+    tlvs(0) {
+}
+
+SmsView::SmsView(PDU &pdu) :
+    buffer(pdu.getRawBuffer()), /**/
+    base(0), /**/
+    length(0), /**/
+    sourceAddr(0), /**/
+    destAddr(0), /**/
+    esmClass(0), /**/
+    scheduleDeliveryTime(0), /**/
+    validityPeriod(0), /**/
+    registeredDelivery(0), /**/
+    tlvs(0) {
+    if (pdu.null) {
+        return;
+    }
+
+    uint32_t size = pdu.getSize() - HEADERFIELD_SIZE;
+
+    if (buffer) {
+        base = buffer.get();
+    } else {
+        // not a received PDU, so copy it once and skip the command length
+        buffer = pdu.getOctets();
+        base = buffer.get() + HEADERFIELD_SIZE;
+    }
+
+    length = size;
+    checkBounds(0, BODY_OFFSET);
+    // service_type, source_addr_ton, source_addr_npi
+    sourceAddr = skipString(BODY_OFFSET) + 2;
+    // dest_addr_ton, dest_addr_npi
+    destAddr = skipString(sourceAddr) + 2;
+    esmClass = skipString(destAddr);
+    // esm_class, protocol_id, priority_flag
+    scheduleDeliveryTime = esmClass + 3;
+    validityPeriod = skipString(scheduleDeliveryTime);
+    registeredDelivery = skipString(validityPeriod);
+    // registered_delivery, replace_if_present_flag, data_coding, sm_default_msg_id, sm_length
+    checkBounds(registeredDelivery, 5);
+    tlvs = registeredDelivery + 5 + getSmLength();
+    checkBounds(tlvs, 0);
+}
+
+string SmsView::getServiceType() const {
+    return getString(BODY_OFFSET);
+}
+
+uint8_t SmsView::getSourceAddrTon() const {
+    return base[sourceAddr - 2];
+}
+
+uint8_t SmsView::getSourceAddrNpi() const {
+    return base[sourceAddr - 1];
+}
+
+string SmsView::getSourceAddr() const {
+    return getString(sourceAddr);
+}
+
+uint8_t SmsView::getDestAddrTon() const {
+    return base[destAddr - 2];
+}
+
+uint8_t SmsView::getDestAddrNpi() const {
+    return base[destAddr - 1];
+}
+
+string SmsView::getDestAddr() const {
+    return getString(destAddr);
+}
+
+uint8_t SmsView::getEsmClass() const {
+    return base[esmClass];
+}
+
+uint8_t SmsView::getProtocolId() const {
+    return base[esmClass + 1];
+}
+
+uint8_t SmsView::getPriorityFlag() const {
+    return base[esmClass + 2];
+}
+
+string SmsView::getScheduleDeliveryTime() const {
+    return getString(scheduleDeliveryTime);
+}
+
+string SmsView::getValidityPeriod() const {
+    return getString(validityPeriod);
+}
+
+uint8_t SmsView::getRegisteredDelivery() const {
+    return base[registeredDelivery];
+}
+
+uint8_t SmsView::getReplaceIfPresentFlag() const {
+    return base[registeredDelivery + 1];
+}
+
+uint8_t SmsView::getDataCoding() const {
+    return base[registeredDelivery + 2];
+}
+
+uint8_t SmsView::getSmDefaultMsgId() const {
+    return base[registeredDelivery + 3];
+}
+
+uint8_t SmsView::getSmLength() const {
+    return base[registeredDelivery + 4];
+}
+
+string SmsView::getShortMessage() const {
+    return string(reinterpret_cast<const char*>(getShortMessageData()), getSmLength());
+}
+
+const uint8_t* SmsView::getShortMessageData() const {
+    return base + registeredDelivery + 5;
+}
+
+const uint8_t* SmsView::findTlv(const uint16_t tag, uint16_t* len) const {
+    uint32_t pos = tlvs;
+
+    while (pos + 4 <= length) {
+        uint16_t t = static_cast<uint16_t>((base[pos] << 8) | base[pos + 1]);
+        uint16_t l = static_cast<uint16_t>((base[pos + 2] << 8) | base[pos + 3]);
+
+        if (t == 0 || pos + 4 + l > length) {
+            break;
+        }
+
+        if (t == tag) {
+            *len = l;
+            return base + pos + 4;
+        }
+
+        pos += 4 + l;
+    }
+
+    return 0;
+}
+
+TlvList SmsView::getTlvs() const {
+    TlvList result;
+    uint32_t pos = tlvs;
+
+    while (pos + 4 <= length) {
+        uint16_t t = static_cast<uint16_t>((base[pos] << 8) | base[pos + 1]);
+        uint16_t l = static_cast<uint16_t>((base[pos + 2] << 8) | base[pos + 3]);
+
+        if (t == 0) {
+            break;
+        }
+
+        checkBounds(pos + 4, l);
+
+        // large values refer to the shared buffer
+        result.push_back(TLV(t, l, buffer, static_cast<uint32_t>(base - buffer.get()) + pos + 4));
+
+        pos += 4 + l;
+    }
+
+    return result;
+}
+
+void SmsView::validateTlvs() const {
+    uint32_t pos = tlvs;
+
+    while (pos < length) {
+        checkBounds(pos, 4);
+        uint16_t t = static_cast<uint16_t>((base[pos] << 8) | base[pos + 1]);
+        uint16_t l = static_cast<uint16_t>((base[pos + 2] << 8) | base[pos + 3]);
+        checkBounds(pos + 4, l);
+
+        // a zero tag is padding at the end of the PDU
+        if (t == 0) {
+            break;
+        }
+
+        validateTlv(t, l);
+        pos += 4 + l;
+    }
+}
+
+SMS SmsView::toSms() const {
+    SMS sms;
+
+    if (isNull()) {
+        return sms;
+    }
+
+    sms.service_type = getServiceType();
+    sms.source_addr_ton = getSourceAddrTon();
+    sms.source_addr_npi = getSourceAddrNpi();
+    sms.source_addr = getSourceAddr();
+    sms.dest_addr_ton = getDestAddrTon();
+    sms.dest_addr_npi = getDestAddrNpi();
+    sms.dest_addr = getDestAddr();
+    sms.esm_class = getEsmClass();
+    sms.protocol_id = getProtocolId();
+    sms.priority_flag = getPriorityFlag();
+    sms.schedule_delivery_time = getScheduleDeliveryTime();
+    sms.validity_period = getValidityPeriod();
+    sms.registered_delivery = getRegisteredDelivery();
+    sms.replace_if_present_flag = getReplaceIfPresentFlag();
+    sms.data_coding = getDataCoding();
+    sms.sm_default_msg_id = getSmDefaultMsgId();
+    sms.sm_length = getSmLength();
+    sms.short_message = getShortMessage();
+    sms.tlvs = getTlvs();
+    sms.is_null = false;
+    return sms;
+}
+
+string SmsView::getString(const uint32_t offset) const {
+    return string(reinterpret_cast<const char*>(base + offset));
+}
+
+uint32_t SmsView::skipString(const uint32_t offset) const {
+    checkBounds(offset, 1);
+    const void* end = memchr(base + offset, '\0', length - offset);
+
+    if (end == 0) {
+        throw smpp::SmppException("SmsView string is not null terminated");
+    }
+
+    return static_cast<const uint8_t*>(end) - base + 1;
+}
+
+void SmsView::checkBounds(const uint32_t offset, const uint32_t n) const {
+    if (offset > length || n > length - offset) {
+        throw smpp::SmppException("SmsView reached end of PDU");
+    }
+}
+}  // namespace smpp
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_SMSVIEW_H_
+#define SMPP_SMSVIEW_H_
+
+#include <stdint.h>
+#include <boost/shared_array.hpp>
+
+#include <string>
+
+#include "smpp/exceptions.h"
+#include "smpp/pdu.h"
+#include "smpp/sms.h"
+#include "smpp/tlv.h"
+#include "smpp/tlvlist.h"
+
+namespace smpp {
+/**
+ * Lazily decoded SMS on top of the buffer of a deliver_sm (or submit_sm) PDU.
+ * The constructor locates the mandatory fields in a single scan and shares the buffer of the PDU instead of copying
+ * it. One-octet fields are read directly from the buffer and strings are only created when they are asked for,
+ * which makes it cheap to look at a few fields, ie. the esm_class and receipt of a delivery report.
+ */
+class SmsView {
+  private:
+    friend class SmsRecord;
+
+    // The body of a PDU starts after command id, command status and sequence number
+    static const uint32_t BODY_OFFSET = HEADERFIELD_SIZE * 3;
+
+    boost::shared_array<uint8_t> buffer;
+    // Start of the PDU in buffer, at the command id
+    const uint8_t* base;
+    uint32_t length;
+
+    // Offsets into base found by the scan
+    uint32_t sourceAddr;
+    uint32_t destAddr;
+    uint32_t esmClass;
+    uint32_t scheduleDeliveryTime;
+    uint32_t validityPeriod;
+    uint32_t registeredDelivery;
+    uint32_t tlvs;
+
+  public:
+    /**
+     * Constructs a null view.
+     */
+    SmsView();
+
+    /**
+     * Constructs a view of a PDU. If the PDU was received, its buffer is shared, otherwise it is copied once.
+     * @param pdu deliver_sm or submit_sm PDU.
+     * @throw SmppException if the PDU is truncated or a string is not null terminated.
+     */
+    explicit SmsView(PDU &pdu);
+
+    /**
+     * Returns true if this is a null view.
+     */
+    bool isNull() const {
+        return length == 0;
+    }
+
+    std::string getServiceType() const;
+    uint8_t getSourceAddrTon() const;
+    uint8_t getSourceAddrNpi() const;
+    std::string getSourceAddr() const;
+    uint8_t getDestAddrTon() const;
+    uint8_t getDestAddrNpi() const;
+    std::string getDestAddr() const;
+    uint8_t getEsmClass() const;
+    uint8_t getProtocolId() const;
+    uint8_t getPriorityFlag() const;
+    std::string getScheduleDeliveryTime() const;
+    std::string getValidityPeriod() const;
+    uint8_t getRegisteredDelivery() const;
+    uint8_t getReplaceIfPresentFlag() const;
+    uint8_t getDataCoding() const;
+    uint8_t getSmDefaultMsgId() const;
+    uint8_t getSmLength() const;
+    std::string getShortMessage() const;
+
+    /**
+     * @return Pointer to the short message in the PDU buffer, getSmLength() octets long.
+     */
+    const uint8_t* getShortMessageData() const;
+
+    /**
+     * Finds the first TLV with the given tag without copying its value.
+     * @param tag TLV tag.
+     * @param len Set to the length of the value, if the TLV is found.
+     * @return Pointer to the value in the PDU buffer, or null if the TLV is not present.
+     */
+    const uint8_t* findTlv(const uint16_t tag, uint16_t* len) const;
+
+    /**
+     * @return Copy of all TLVs in the PDU.
+     */
+    TlvList getTlvs() const;
+
+    /**
+     * Checks the TLVs the way SMS(PDU&) decodes them, so a PDU which would fail to decode can be rejected before it
+     * is acknowledged.
+     * @throw SmppException if a TLV is truncated or its length is not allowed for its tag.
+     */
+    void validateTlvs() const;
+
+    /**
+     * @return Fully decoded SMS with the same content as this view.
+     */
+    SMS toSms() const;
+
+  private:
+    std::string getString(const uint32_t offset) const;
+
+    /**
+     * Returns the offset after the C-octet string at offset.
+     * @throw SmppException if the string is not null terminated within the PDU.
+     */
+    uint32_t skipString(const uint32_t offset) const;
+
+    /**
+     * Checks that n octets can be read at offset.
+     * @throw SmppException if the PDU is too short.
+     */
+    void checkBounds(const uint32_t offset, const uint32_t n) const;
+};
+}  // namespace smpp
+
+#endif  // SMPP_SMSVIEW_H_
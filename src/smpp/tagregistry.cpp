@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/tagregistry.h"
+#include <algorithm>
+#include <map>
+#include <string>
+
+namespace smpp {
+namespace {
+#define SMPP_TAG_INFO(name, valueType, minLen, maxLen) { tags::name, valueType, minLen, maxLen, #name },
+const TagInfo standardTags[] = {
+    SMPP_STANDARD_TAGS(SMPP_TAG_INFO)
+};
+#undef SMPP_TAG_INFO
+
+const size_t standardTagCount = sizeof(standardTags) / sizeof(standardTags[0]);
+
+bool tagLess(const TagInfo &info, const uint16_t tag) {
+    return info.tag < tag;
+}
+
+std::map<uint16_t, TagInfo> &vendorTags() {
+    static std::map<uint16_t, TagInfo> registry;
+    return registry;
+}
+}  // namespace
+
+const TagInfo* findTagInfo(const uint16_t tag) {
+    if (tag >= VENDOR_TAG_FIRST && tag <= VENDOR_TAG_LAST) {
+        std::map<uint16_t, TagInfo> &registry = vendorTags();
+        std::map<uint16_t, TagInfo>::const_iterator it = registry.find(tag);
+        return it != registry.end() ? &it->second : 0;
+    }
+
+    const TagInfo* end = standardTags + standardTagCount;
+    const TagInfo* it = std::lower_bound(standardTags, end, tag, tagLess);
+    return (it != end && it->tag == tag) ? it : 0;
+}
+
+void registerVendorTag(const TagInfo &info) {
+    if (info.tag < VENDOR_TAG_FIRST || info.tag > VENDOR_TAG_LAST) {
+        throw smpp::SmppException("Tag is not in the vendor specific range");
+    }
+
+    if (info.minLength > info.maxLength) {
+        throw smpp::SmppException("Tag has an invalid length range");
+    }
+
+    vendorTags()[info.tag] = info;
+}
+
+void validateTlv(const uint16_t tag, const uint16_t len) {
+    const TagInfo* info = findTagInfo(tag);
+
+    if (info != 0 && (len < info->minLength || len > info->maxLength)) {
+        throw smpp::SmppException(std::string("TLV ") + info->name + " has an invalid length");
+    }
+}
+}  // namespace smpp
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_TAGREGISTRY_H_
+#define SMPP_TAGREGISTRY_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "smpp/exceptions.h"
+#include "smpp/tlv.h"
+
+namespace smpp {
+/**
+ * Value types of TLVs, SMPP v3.4 section 5.3.2.
+ */
+enum TlvType {
+    TLV_EMPTY, TLV_INT8, TLV_INT16, TLV_INT32, TLV_CSTRING, TLV_OCTETS
+};
+
+/**
+ * Type and legal length of the value of a tag.
+ */
+struct TagInfo {
+    uint16_t tag;
+    TlvType type;
+    uint16_t minLength;
+    uint16_t maxLength;
+    const char* name;
+};
+
+// First and last tag reserved for SMSC vendor specific TLVs
+const uint16_t VENDOR_TAG_FIRST = 0x1400;
+const uint16_t VENDOR_TAG_LAST = 0x3FFF;
+
+/*
+ * The standard tags as (name, type, min length, max length), sorted by tag.
+ * Both the compile time traits and the runtime table below are generated from this list.
+ */
+#define SMPP_STANDARD_TAGS(X) \
+    X(DEST_ADDR_SUBUNIT, TLV_INT8, 1, 1) \
+    X(DEST_NETWORK_TYPE, TLV_INT8, 1, 1) \
+    X(DEST_BEARER_TYPE, TLV_INT8, 1, 1) \
+    X(DEST_TELEMATICS_ID, TLV_INT16, 2, 2) \
+    X(SOURCE_ADDR_SUBUNIT, TLV_INT8, 1, 1) \
+    X(SOURCE_NETWORK_TYPE, TLV_INT8, 1, 1) \
+    X(SOURCE_BEARER_TYPE, TLV_INT8, 1, 1) \
+    X(SOURCE_TELEMATICS_ID, TLV_INT8, 1, 1) \
+    X(QOS_TIME_TO_LIVE, TLV_INT32, 4, 4) \
+    X(PAYLOAD_TYPE, TLV_INT8, 1, 1) \
+    X(ADDITIONAL_STATUS_INFO_TEXT, TLV_CSTRING, 1, 256) \
+    X(RECEIPTED_MESSAGE_ID, TLV_CSTRING, 1, 65) \
+    X(MS_MSG_WAIT_FACILITIES, TLV_INT8, 1, 1) \
+    X(PRIVACY_INDICATOR, TLV_INT8, 1, 1) \
+    X(SOURCE_SUBADDRESS, TLV_OCTETS, 2, 23) \
+    X(DEST_SUBADDRESS, TLV_OCTETS, 2, 23) \
+    X(USER_MESSAGE_REFERENCE, TLV_INT16, 2, 2) \
+    X(USER_RESPONSE_CODE, TLV_INT8, 1, 1) \
+    X(SOURCE_PORT, TLV_INT16, 2, 2) \
+    X(DESTINATION_PORT, TLV_INT16, 2, 2) \
+    X(SAR_MSG_REF_NUM, TLV_INT16, 2, 2) \
+    X(LANGUAGE_INDICATOR, TLV_INT8, 1, 1) \
+    X(SAR_TOTAL_SEGMENTS, TLV_INT8, 1, 1) \
+    X(SAR_SEGMENT_SEQNUM, TLV_INT8, 1, 1) \
+    X(SC_INTERFACE_VERSION, TLV_INT8, 1, 1) \
+    X(CALLBACK_NUM_PRES_IND, TLV_INT8, 1, 1) \
+    X(CALLBACK_NUM_ATAG, TLV_OCTETS, 0, 65) \
+    X(NUMBER_OF_MESSAGES, TLV_INT8, 1, 1) \
+    X(CALLBACK_NUM, TLV_OCTETS, 4, 19) \
+    X(DPF_RESULT, TLV_INT8, 1, 1) \
+    X(SET_DPF, TLV_INT8, 1, 1) \
+    X(MS_AVAILABILITY_STATUS, TLV_INT8, 1, 1) \
+    X(NETWORK_ERROR_CODE, TLV_OCTETS, 3, 3) \
+    X(MESSAGE_PAYLOAD, TLV_OCTETS, 0, 0xFFFF) \
+    X(DELIVERY_FAILURE_REASON, TLV_INT8, 1, 1) \
+    X(MORE_MESSAGES_TO_SEND, TLV_INT8, 1, 1) \
+    X(MESSAGE_STATE, TLV_INT8, 1, 1) \
+    X(USSD_SERVICE_OP, TLV_INT8, 1, 1) \
+    X(DISPLAY_TIME, TLV_INT8, 1, 1) \
+    X(SMS_SIGNAL, TLV_INT16, 2, 2) \
+    X(MS_VALIDITY, TLV_INT8, 1, 1) \
+    X(ALERT_ON_MESSAGE_DELIVERY, TLV_EMPTY, 0, 0) \
+    X(ITS_REPLY_TYPE, TLV_INT8, 1, 1) \
+    X(ITS_SESSION_INFO, TLV_INT16, 2, 2)
+
+/**
+ * Maps a value type to its C++ type and encodes/decodes values of that type.
+ */
+template<TlvType Type>
+struct TlvValue;
+
+template<>
+struct TlvValue<TLV_EMPTY> {
+    typedef bool value_type;
+
+    static bool decode(const TLV &) {
+        return true;
+    }
+
+    static TLV encode(const uint16_t tag, const bool &) {
+        return TLV(tag);
+    }
+};
+
+template<>
+struct TlvValue<TLV_INT8> {
+    typedef uint8_t value_type;
+
+    static uint8_t decode(const TLV &tlv) {
+        return tlv.getData()[0];
+    }
+
+    static TLV encode(const uint16_t tag, const uint8_t &value) {
+        return TLV(tag, value);
+    }
+};
+
+template<>
+struct TlvValue<TLV_INT16> {
+    typedef uint16_t value_type;
+
+    static uint16_t decode(const TLV &tlv) {
+        const uint8_t* data = tlv.getData();
+        return static_cast<uint16_t>((data[0] << 8) | data[1]);
+    }
+
+    static TLV encode(const uint16_t tag, const uint16_t &value) {
+        return TLV(tag, value);
+    }
+};
+
+template<>
+struct TlvValue<TLV_INT32> {
+    typedef uint32_t value_type;
+
+    static uint32_t decode(const TLV &tlv) {
+        const uint8_t* data = tlv.getData();
+        return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    }
+
+    static TLV encode(const uint16_t tag, const uint32_t &value) {
+        return TLV(tag, value);
+    }
+};
+
+template<>
+struct TlvValue<TLV_CSTRING> {
+    typedef std::string value_type;
+
+    static std::string decode(const TLV &tlv) {
+        const char* data = reinterpret_cast<const char*>(tlv.getData());
+        std::string value(data, tlv.getLen());
+        // the null terminator is optional in practice
+        return value.substr(0, value.find('\0'));
+    }
+
+    static TLV encode(const uint16_t tag, const std::string &value) {
+        return TLV(tag, value + '\0');
+    }
+};
+
+template<>
+struct TlvValue<TLV_OCTETS> {
+    typedef std::string value_type;
+
+    static std::string decode(const TLV &tlv) {
+        return std::string(reinterpret_cast<const char*>(tlv.getData()), tlv.getLen());
+    }
+
+    static TLV encode(const uint16_t tag, const std::string &value) {
+        return TLV(tag, value);
+    }
+};
+
+/**
+ * Compile time type and length of a tag. Specializations exist for the standard tags, vendor specific tags can be
+ * added with SMPP_DEFINE_TAG in namespace smpp:
+ *
+ *   namespace smpp {
+ *   SMPP_DEFINE_TAG(0x1401, TLV_INT16, 2, 2)
+ *   }
+ *
+ * Using a tag without traits in the typed accessors is a compile error.
+ */
+template<uint16_t Tag>
+struct TagTraits;
+
+#define SMPP_DEFINE_TAG(tag, valueType, minLen, maxLen) \
+    template<> \
+    struct TagTraits<tag> : public TlvValue<valueType> { \
+        static const TlvType type = valueType; \
+        static const uint16_t minLength = minLen; \
+        static const uint16_t maxLength = maxLen; \
+    };
+
+#define SMPP_DEFINE_STANDARD_TAG(name, valueType, minLen, maxLen) SMPP_DEFINE_TAG(tags::name, valueType, minLen, maxLen)
+SMPP_STANDARD_TAGS(SMPP_DEFINE_STANDARD_TAG)
+#undef SMPP_DEFINE_STANDARD_TAG
+
+/**
+ * Constructs a TLV from a value of the type of the tag, ie. makeTlv<tags::SAR_MSG_REF_NUM>(ref).
+ * C-Octet strings are null terminated.
+ */
+template<uint16_t Tag>
+TLV makeTlv(const typename TagTraits<Tag>::value_type &value) {
+    return TagTraits<Tag>::encode(Tag, value);
+}
+
+/**
+ * Returns the type and length of a standard or registered vendor specific tag.
+ * @return Pointer to the tag info, or null if the tag is unknown.
+ */
+const TagInfo* findTagInfo(const uint16_t tag);
+
+/**
+ * Registers a vendor specific tag, so the decoder validates its length and findTagInfo knows about it.
+ * Registration is not synchronized, register tags at startup before PDUs are decoded.
+ * @param info Tag information, name must point to a string that outlives the registry.
+ * @throw SmppException if the tag is outside the vendor specific range or the length range is invalid.
+ */
+void registerVendorTag(const TagInfo &info);
+
+/**
+ * Checks the length of a TLV value against the registry. Unknown tags are accepted.
+ * @throw SmppException if the length is outside the legal range of the tag.
+ */
+void validateTlv(const uint16_t tag, const uint16_t len);
+}  // namespace smpp
+
+#endif  // SMPP_TAGREGISTRY_H_
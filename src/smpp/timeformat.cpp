@@ -5,78 +5,136 @@
  */
 
 #include "smpp/timeformat.h"
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
 #include <string>
 
 using std::setfill;
 using std::setw;
 using std::string;
-using std::stoi;
 using std::stringstream;
 
 using boost::local_time::local_date_time;
 using boost::local_time::posix_time_zone;
 using boost::local_time::time_zone_ptr;
-using boost::posix_time::from_iso_string;
 using boost::posix_time::ptime;
 using boost::posix_time::time_duration;
-using boost::posix_time::time_input_facet;
-
-using std::regex;
-using std::smatch;
 
 namespace smpp {
 namespace timeformat {
-time_duration parseRelativeTimestamp(const smatch &match) {
-    int yy = stoi(match[1]);
-    int mon = stoi(match[2]);
-    int dd = stoi(match[3]);
-    int hh = stoi(match[4]);
-    int min = stoi(match[5]);
-    int sec = stoi(match[6]);
+namespace {
+// Offsets in quarter hours boost accepts for a time zone, which are -12 to +14 hours
+const int MIN_OFFSET = -48;
+const int MAX_OFFSET = 56;
+
+/**
+ * Time zones of all offsets of absolute timestamps, by offset in quarter hours minus MIN_OFFSET.
+ */
+struct OffsetZones {
+    time_zone_ptr zones[MAX_OFFSET - MIN_OFFSET + 1];
+
+    OffsetZones() {
+        for (int i = MIN_OFFSET; i <= MAX_OFFSET; ++i) {
+            if (i == 0) {
+                zones[-MIN_OFFSET] = time_zone_ptr(new posix_time_zone("GMT"));
+                continue;
+            }
+
+            int n = abs(i);
+            stringstream gmt;
+            gmt << "GMT" << (i < 0 ? '-' : '+') << setw(2) << setfill('0') << (n >> 2) << ":" << setw(2)
+                << setfill('0') << (n % 4) * 15;
+            zones[i - MIN_OFFSET] = time_zone_ptr(new posix_time_zone(gmt.str()));
+        }
+    }
+};
+
+inline int twoDigits(const char* s) {
+    return (s[0] - '0') * 10 + (s[1] - '0');
+}
+
+/**
+ * Days from 1970-01-01 to a date in the proleptic Gregorian calendar, for years from 1 and up.
+ */
+inline int64_t daysFromCivil(int y, const int m, const int d) {
+    y -= m <= 2;
+    const int era = y / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return static_cast<int64_t>(era) * 146097 + doe - 719468;
+}
+
+const ptime EPOCH(boost::gregorian::date(1970, 1, 1));
+
+const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/**
+ * Writes a number from 0 to 99 as two digits.
+ */
+inline void writePair(char* buffer, const int n) {
+    memcpy(buffer, DIGIT_PAIRS + n * 2, 2);
+}
+}  // namespace
+
+time_zone_ptr getOffsetZone(const int quarterHours) {
+    // created on first use, which is thread safe
+    static const OffsetZones cache;
+
+    if (quarterHours < MIN_OFFSET || quarterHours > MAX_OFFSET) {
+        throw SmppException("Time zone offset out of range");
+    }
+
+    return cache.zones[quarterHours - MIN_OFFSET];
+}
+
+time_duration parseRelativeTimestamp(const char* time) {
+    int yy = twoDigits(time);
+    int mon = twoDigits(time + 2);
+    int dd = twoDigits(time + 4);
+    int hh = twoDigits(time + 6);
+    int min = twoDigits(time + 8);
+    int sec = twoDigits(time + 10);
     int totalHours = (yy * 365 * 24) + (mon * 30 * 24) + (dd * 24) + hh;
     time_duration td(totalHours, min, sec);
     return td;
 }
 
-local_date_time parseAbsoluteTimestamp(const smatch &match) {
-    string yy = match[1];
-    string mon = match[2];
-    string dd = match[3];
-    string hh = match[4];
-    string min = match[5];
-    string sec = match[6];
-    ptime ts(from_iso_string(string("20") + yy + mon + dd + "T" + hh + min + sec));
-    int n = stoi(match[8]);
-    int offsetHours = (n >> 2);
-    int offsetMinutes = (n % 4) * 15;
-    // construct timezone
-    stringstream gmt;
-    gmt << "GMT" << match[9] << setw(2) << setfill('0') << offsetHours << ":" << setw(2) << setfill('0')
-        << offsetMinutes;
-    time_zone_ptr zone(new boost::local_time::posix_time_zone(gmt.str()));
-    boost::local_time::local_date_time ldt(ts.date(), ts.time_of_day(), zone, false);
+local_date_time parseAbsoluteTimestamp(const char* time) {
+    boost::gregorian::date d(2000 + twoDigits(time), twoDigits(time + 2), twoDigits(time + 4));
+    time_duration tod(twoDigits(time + 6), twoDigits(time + 8), twoDigits(time + 10));
+    int n = twoDigits(time + 13);
+    time_zone_ptr zone = getOffsetZone(time[15] == '-' ? -n : n);
+    boost::local_time::local_date_time ldt(d, tod, zone, false);
     return ldt;
 }
 
 DatePair parseSmppTimestamp(const string &time) {
     // Matches the pattern “YYMMDDhhmmsstnnp”
-    static const regex pattern("^(\\d{2})(\\d{2})(\\d{2})(\\d{2})(\\d{2})(\\d{2})(\\d{1})(\\d{2})([R+-])$");
-    smatch match;
+    bool valid = time.length() == 16 && (time[15] == 'R' || time[15] == '+' || time[15] == '-');
+
+    for (int i = 0; valid && i < 15; ++i) {
+        valid = time[i] >= '0' && time[i] <= '9';
+    }
 
-    if (regex_match(time.begin(), time.end(), match, pattern)) {
+    if (valid) {
         // relative
-        if (match[match.size() - 1] == "R") {
+        if (time[15] == 'R') {
             // parse the relative timestamp
-            time_duration td = parseRelativeTimestamp(match);
+            time_duration td = parseRelativeTimestamp(time.data());
             // construct a absolute timestamp based on the relative timestamp
-            time_zone_ptr zone(new posix_time_zone("GMT"));
-            local_date_time ldt = boost::local_time::local_sec_clock::local_time(zone);
+            local_date_time ldt(boost::posix_time::from_time_t(CoarseClock::now()), getOffsetZone(0));
             ldt += td;
             return DatePair(ldt, td);
         } else {
             // parse the absolute timestamp
-            boost::local_time::local_date_time ldt = parseAbsoluteTimestamp(match);
-            boost::local_time::local_date_time lt = boost::local_time::local_sec_clock::local_time(ldt.zone());
+            boost::local_time::local_date_time ldt = parseAbsoluteTimestamp(time.data());
+            boost::local_time::local_date_time lt(boost::posix_time::from_time_t(CoarseClock::now()), ldt.zone());
             // construct a relative timestamp based on the local clock and the absolute timestamp
             boost::local_time::local_time_period ltp(ldt, lt);
             time_duration td = ltp.length();
@@ -87,36 +145,93 @@ DatePair parseSmppTimestamp(const string &time) {
     throw smpp::SmppException(string("Timestamp \"") + time + "\" has the wrong format.");
 }
 
-ptime parseDlrTimestamp(const string &time) {
-    stringstream ss;
-    time_input_facet* fac = new time_input_facet("%y%m%d%H%M%S");  // looks like a memleak, but it's not
-    ss.imbue(std::locale(std::locale::classic(), fac));
-    ss << time;
-    ptime timestamp;
-    ss >> timestamp;
-    return timestamp;
+bool parseDlrEpoch(const char* time, const size_t length, int64_t* seconds) {
+    if (length != 10 && length != 12) {
+        return false;
+    }
+
+    unsigned invalid = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+        invalid |= static_cast<unsigned>(time[i] - '0') > 9;
+    }
+
+    if (invalid) {
+        return false;
+    }
+
+    // two digit years are in this century
+    int year = 2000 + twoDigits(time);
+    int month = twoDigits(time + 2);
+    int day = twoDigits(time + 4);
+    int hour = twoDigits(time + 6);
+    int minute = twoDigits(time + 8);
+    int second = length == 12 ? twoDigits(time + 10) : 0;
+    static const int DAYS[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+    if (month < 1 || month > 12 || day < 1 || day > DAYS[month - 1] || hour > 23 || minute > 59 || second > 59) {
+        return false;
+    }
+
+    // every year from 2000 to 2099 divisible by 4 is a leap year
+    if (month == 2 && day == 29 && year % 4 != 0) {
+        return false;
+    }
+
+    *seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+ptime parseDlrTimestamp(const char* time, const size_t length) {
+    int64_t seconds;
+
+    if (!parseDlrEpoch(time, length, &seconds)) {
+        return ptime(boost::posix_time::not_a_date_time);
+    }
+
+    return EPOCH + boost::posix_time::seconds(static_cast<long>(seconds));
 }
 
 string getTimeString(const local_date_time &ldt) {
+    char buffer[TIME_STRING_SIZE];
+    return string(buffer, formatTimeString(ldt, buffer));
+}
+
+string getTimeString(const time_duration &td) {
+    char buffer[TIME_STRING_SIZE];
+    return string(buffer, formatTimeString(td, buffer));
+}
+
+size_t formatTimeString(const local_date_time &ldt, char* buffer) {
     time_zone_ptr zone = ldt.zone();
     ptime t = ldt.local_time();
     time_duration td = t.time_of_day();
-    stringstream output;
     time_duration offset = zone->base_utc_offset();
 
     if (ldt.is_dst()) {
         offset += zone->dst_offset();
     }
 
-    string p = offset.is_negative() ? "-" : "+";
     int nn = abs((offset.hours() * 4) + (offset.minutes() / 15));
-    string d = to_iso_string(t.date());
-    output << d.substr(2, 6) << setw(2) << setfill('0') << td.hours() << setw(2) << td.minutes() << setw(2)
-           << td.seconds() << "0" << setw(2) << nn << p;
-    return output.str();
+    boost::gregorian::date::ymd_type ymd = t.date().year_month_day();
+    writePair(buffer, ymd.year % 100);
+    writePair(buffer + 2, ymd.month);
+    writePair(buffer + 4, ymd.day);
+    writePair(buffer + 6, td.hours());
+    writePair(buffer + 8, td.minutes());
+    writePair(buffer + 10, td.seconds());
+    buffer[12] = '0';
+    writePair(buffer + 13, nn);
+    buffer[15] = offset.is_negative() ? '-' : '+';
+    buffer[16] = '\0';
+    return 16;
 }
 
-string getTimeString(const time_duration &td) {
+size_t formatTimeString(const time_duration &td, char* buffer) {
+    if (td.is_negative()) {
+        throw SmppException("Time duration is negative");
+    }
+
     int totalHours = td.hours();
     int yy = totalHours / 24 / 365;
     totalHours -= (yy * 24 * 365);
@@ -129,10 +244,32 @@ string getTimeString(const time_duration &td) {
         throw SmppException("Time duration overflows");
     }
 
-    stringstream output;
-    output << setfill('0') << setw(2) << yy << setw(2) << mon << setw(2) << dd << setw(2) << totalHours << setw(2)
-           << td.minutes() << setw(2) << td.seconds() << "000R";
-    return output.str();
+    writePair(buffer, yy);
+    writePair(buffer + 2, mon);
+    writePair(buffer + 4, dd);
+    writePair(buffer + 6, totalHours);
+    writePair(buffer + 8, td.minutes());
+    writePair(buffer + 10, td.seconds());
+    memcpy(buffer + 12, "000R", 5);
+    return 16;
+}
+
+TimeStringCache::TimeStringCache(const time_duration &_offset, const time_zone_ptr &_zone) :
+    offset(_offset), /**/
+    zone(_zone ? _zone : getOffsetZone(0)), /**/
+    second(-1) {
+    formatTimeString(offset, relative);
+    absolute[0] = '\0';
+}
+
+const char* TimeStringCache::getAbsolute(const time_t now) {
+    if (now != second) {
+        local_date_time ldt(EPOCH + boost::posix_time::seconds(static_cast<long>(now)) + offset, zone);
+        formatTimeString(ldt, absolute);
+        second = now;
+    }
+
+    return absolute;
 }
 }  // namespace timeformat
 }  // namespace smpp
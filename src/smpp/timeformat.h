@@ -7,15 +7,16 @@
 #ifndef SMPP_TIMEFORMAT_H_
 #define SMPP_TIMEFORMAT_H_
 
-//#include <boost/regex.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/local_time/local_time.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
+#include <stdint.h>
 
+#include <ctime>
 #include <utility>
-#include <regex>
 #include <string>
 
+#include "smpp/clock.h"
 #include "smpp/exceptions.h"
 
 namespace smpp {
@@ -23,19 +24,28 @@ namespace timeformat {
 
 typedef std::pair<boost::local_time::local_date_time, boost::posix_time::time_duration> DatePair;
 
+/**
+ * Returns the time zone of a UTC offset in quarter hours, as used by absolute timestamps.
+ * The zones are created once and shared, so the returned pointer must not be modified.
+ * @param quarterHours Offset from UTC in quarter hours, between -48 and 56.
+ * @return Time zone named GMT+hh:mm or GMT-hh:mm, or GMT for offset 0.
+ * @throw SmppException if the offset is out of range.
+ */
+boost::local_time::time_zone_ptr getOffsetZone(const int quarterHours);
+
 /**
  * Parses a relative timestamp and returns it as a time_duration.
- * @param match Relative timestamp on the form of a std::smatch
+ * @param time Relative timestamp of 16 characters, the digits of which are not checked.
  * @return time_duration representation of the timestamp.
  */
-boost::posix_time::time_duration parseRelativeTimestamp(const std::smatch &match);
+boost::posix_time::time_duration parseRelativeTimestamp(const char* time);
 
 /**
  * Parses an absolute timestamp and returns it as a local_date_time.
- * @param match Absolute timestmp on the form of a std::smatch
+ * @param time Absolute timestamp of 16 characters, the digits of which are not checked.
  * @return local_date_time representation of the timestamp.
  */
-boost::local_time::local_date_time parseAbsoluteTimestamp(const std::smatch &match);
+boost::local_time::local_date_time parseAbsoluteTimestamp(const char* time);
 
 /**
  * Parses a smpp timestamp and returns a DatePair representation of the timestamp.
@@ -48,11 +58,26 @@ boost::local_time::local_date_time parseAbsoluteTimestamp(const std::smatch &mat
 DatePair parseSmppTimestamp(const std::string &time);
 
 /**
- * Parses a delivery receipt timestamp and returns it as ptime.
+ * Parses a delivery receipt timestamp of the form YYMMDDhhmm or YYMMDDhhmmss into seconds since the epoch,
+ * without allocating.
  * @param time Timestamp to parse.
- * @return ptime representation of the timestamp.
+ * @param length Length of the timestamp, 10 or 12.
+ * @param seconds Set to the timestamp in seconds since the epoch, if it is valid.
+ * @return False if the timestamp has the wrong length, is not all digits or is not a valid date and time.
+ */
+bool parseDlrEpoch(const char* time, const size_t length, int64_t* seconds);
+
+/**
+ * Parses a delivery receipt timestamp and returns it as ptime.
+ * @param time Timestamp to parse, YYMMDDhhmm or YYMMDDhhmmss.
+ * @param length Length of the timestamp.
+ * @return ptime representation of the timestamp, or not_a_date_time if it is invalid.
  */
-boost::posix_time::ptime parseDlrTimestamp(const std::string &time);
+boost::posix_time::ptime parseDlrTimestamp(const char* time, const size_t length);
+
+inline boost::posix_time::ptime parseDlrTimestamp(const std::string &time) {
+    return parseDlrTimestamp(time.data(), time.length());
+}
 
 /**
  * Returns the local_date_time as a string formatted as an absolute timestamp
@@ -68,6 +93,66 @@ std::string getTimeString(const boost::local_time::local_date_time &ldt);
  */
 std::string getTimeString(const boost::posix_time::time_duration &td);
 
+// Size of a buffer for a timestamp, including the terminator
+const size_t TIME_STRING_SIZE = 17;
+
+/**
+ * Writes the local_date_time formatted as an absolute timestamp, like getTimeString, into a buffer.
+ * @param ldt
+ * @param buffer Buffer of at least TIME_STRING_SIZE characters, which is null terminated.
+ * @return Length of the timestamp, 16.
+ */
+size_t formatTimeString(const boost::local_time::local_date_time &ldt, char* buffer);
+
+/**
+ * Writes a relative timestamp of the time_duration, like getTimeString, into a buffer.
+ * @param td
+ * @param buffer Buffer of at least TIME_STRING_SIZE characters, which is null terminated.
+ * @return Length of the timestamp, 16.
+ * @throw SmppException if the duration is negative or overflows 99 years.
+ */
+size_t formatTimeString(const boost::posix_time::time_duration &td, char* buffer);
+
+/**
+ * Timestamps of the current time plus an offset, ie. the validity period or delivery time of messages.
+ * The relative timestamp is formatted once, and the absolute timestamp once per second, so getting them for every
+ * message is cheap. A cache must not be shared between threads.
+ */
+class TimeStringCache {
+  private:
+    boost::posix_time::time_duration offset;
+    boost::local_time::time_zone_ptr zone;
+    char relative[TIME_STRING_SIZE];
+    char absolute[TIME_STRING_SIZE];
+    // Second the absolute timestamp was formatted for
+    time_t second;
+
+  public:
+    /**
+     * @param offset Time from now the timestamps refer to.
+     * @param zone Time zone of the absolute timestamp, GMT if null.
+     * @throw SmppException if the offset cannot be a relative timestamp.
+     */
+    explicit TimeStringCache(const boost::posix_time::time_duration &offset,
+                             const boost::local_time::time_zone_ptr &zone = boost::local_time::time_zone_ptr());
+
+    /**
+     * @return Relative timestamp of the offset.
+     */
+    const char* getRelative() const {
+        return relative;
+    }
+
+    /**
+     * @param now Current time in seconds since the epoch.
+     * @return Absolute timestamp of now plus the offset.
+     */
+    const char* getAbsolute(const time_t now);
+
+    const char* getAbsolute() {
+        return getAbsolute(CoarseClock::now());
+    }
+};
 }  // namespace timeformat
 }  // namespace smpp
 
@@ -7,6 +7,7 @@
 #ifndef SMPP_TLV_H_
 #define SMPP_TLV_H_
 
+#include <stdint.h>
 #include <boost/shared_array.hpp>
 #include <iomanip>
 #include <algorithm>
@@ -62,12 +63,22 @@ const uint16_t ITS_SESSION_INFO = 0x1383;
 
 /**
  * TLV container class.
+ * Values of up to INLINE_SIZE octets are stored inside the TLV, so the common one, two and four octet TLVs cost no
+ * allocations. Larger values are kept in a shared array, which can be the buffer of a received PDU.
  */
 class TLV {
+  public:
+    static const uint16_t INLINE_SIZE = 16;
+
   private:
+    friend class PDU;
+
     uint16_t tag;
     uint16_t len;
+    uint8_t inlineOctets[INLINE_SIZE];
+    // Holds values larger than INLINE_SIZE, starting at offset.
     boost::shared_array<uint8_t> octets;
+    uint32_t offset;
 
   public:
     /**
@@ -75,7 +86,7 @@ class TLV {
      * @param _tag TLV tag.
      */
     explicit TLV(const uint16_t &_tag) :
-        tag(_tag), len(0), octets() {
+        tag(_tag), len(0), inlineOctets(), octets(), offset(0) {
     }
 
     /**
@@ -84,8 +95,8 @@ class TLV {
      * @param value TLV value.
      */
     TLV(const uint16_t &_tag, int value) :
-        tag(_tag), len(1), octets(new uint8_t[len]) {
-        octets[0] = value & 0xff;
+        tag(_tag), len(1), inlineOctets(), octets(), offset(0) {
+        inlineOctets[0] = value & 0xff;
     }
 
     /**
@@ -94,8 +105,8 @@ class TLV {
      * @param value TLV value.
      */
     TLV(const uint16_t &_tag, uint8_t value) :
-        tag(_tag), len(1), octets(new uint8_t[len]) {
-        octets[0] = value & 0xff;
+        tag(_tag), len(1), inlineOctets(), octets(), offset(0) {
+        inlineOctets[0] = value & 0xff;
     }
 
     /**
@@ -104,9 +115,9 @@ class TLV {
      * @param value TLV value.
      */
     TLV(const uint16_t &_tag, uint16_t value) :
-        tag(_tag), len(2), octets(new uint8_t[len]) {
-        octets[0] = (value >> 8) & 0xff;
-        octets[1] = value & 0xff;
+        tag(_tag), len(2), inlineOctets(), octets(), offset(0) {
+        inlineOctets[0] = (value >> 8) & 0xff;
+        inlineOctets[1] = value & 0xff;
     }
 
     /**
@@ -115,11 +126,11 @@ class TLV {
      * @param value TLV value.
      */
     TLV(const uint16_t &_tag, uint32_t value) :
-        tag(_tag), len(4), octets(new uint8_t[len]) {
-        octets[0] = (value >> 24) & 0xff;
-        octets[1] = (value >> 16) & 0xff;
-        octets[2] = (value >> 8) & 0xff;
-        octets[3] = value & 0xff;
+        tag(_tag), len(4), inlineOctets(), octets(), offset(0) {
+        inlineOctets[0] = (value >> 24) & 0xff;
+        inlineOctets[1] = (value >> 16) & 0xff;
+        inlineOctets[2] = (value >> 8) & 0xff;
+        inlineOctets[3] = value & 0xff;
     }
 
     /**
@@ -128,8 +139,19 @@ class TLV {
      * @param value TLV value.
      */
     TLV(const uint16_t &_tag, std::basic_string<char> s) :
-        tag(_tag), len(s.length()), octets(new uint8_t[len]) {
-        std::copy(s.begin(), s.end(), octets.get());
+        tag(_tag), len(s.length()), inlineOctets(), octets(), offset(0) {
+        assign(reinterpret_cast<const uint8_t*>(s.data()));
+    }
+
+    /**
+     * Constructs a TLV with a copy of an array of octets.
+     * @param _tag TLV tag.
+     * @param _len Length of octet array.
+     * @param _octets Array of octets.
+     */
+    TLV(const uint16_t &_tag, const uint16_t &_len, const uint8_t* _octets) :
+        tag(_tag), len(_len), inlineOctets(), octets(), offset(0) {
+        assign(_octets);
     }
 
     /**
@@ -139,7 +161,22 @@ class TLV {
      * @param _octets Array of octets.
      */
     TLV(const uint16_t &_tag, const uint16_t &_len, const boost::shared_array<uint8_t> &_octets) :
-        tag(_tag), len(_len), octets(_octets) {
+        tag(_tag), len(_len), inlineOctets(), octets(), offset(0) {
+        share(_octets);
+    }
+
+    /**
+     * Constructs a TLV with a value inside a larger array, ie. the buffer of a received PDU.
+     * The array is shared rather than copied, unless the value is small enough to be stored inline.
+     * @param _tag TLV tag.
+     * @param _len Length of the value.
+     * @param buffer Array holding the value.
+     * @param _offset Offset of the value in buffer.
+     */
+    TLV(const uint16_t &_tag, const uint16_t &_len, const boost::shared_array<uint8_t> &buffer,
+        const uint32_t &_offset) :
+        tag(_tag), len(_len), inlineOctets(), octets(), offset(_offset) {
+        share(buffer);
     }
 
     uint16_t getTag() const {
@@ -150,8 +187,45 @@ class TLV {
         return len;
     }
 
+    /**
+     * @return Pointer to the value, getLen() octets long.
+     */
+    const uint8_t* getData() const {
+        return len <= INLINE_SIZE ? inlineOctets : octets.get() + offset;
+    }
+
+    /**
+     * Returns the value as a shared array. Values that are stored inline or inside a larger array are copied,
+     * use getData() to avoid that.
+     * @return Array of getLen() octets.
+     */
     boost::shared_array<uint8_t> getOctets() const {
-        return octets;
+        if (len > INLINE_SIZE && offset == 0) {
+            return octets;
+        }
+
+        boost::shared_array<uint8_t> copy(new uint8_t[len]);
+        std::copy(getData(), getData() + len, copy.get());
+        return copy;
+    }
+
+  private:
+    void assign(const uint8_t* value) {
+        if (len <= INLINE_SIZE) {
+            std::copy(value, value + len, inlineOctets);
+        } else {
+            octets.reset(new uint8_t[len]);
+            std::copy(value, value + len, octets.get());
+        }
+    }
+
+    void share(const boost::shared_array<uint8_t> &buffer) {
+        if (len <= INLINE_SIZE) {
+            std::copy(buffer.get() + offset, buffer.get() + offset + len, inlineOctets);
+            offset = 0;
+        } else {
+            octets = buffer;
+        }
     }
 };
 
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#include "smpp/tlvlist.h"
+#include <cstring>
+#include <string>
+
+using std::string;
+
+namespace smpp {
+TlvList::TlvList() :
+    tlvs(), index(), stale(false) {
+}
+
+void TlvList::push_back(const TLV &tlv) {
+    tlvs.push_back(tlv);
+
+    if (!stale) {
+        addToIndex(tlvs.size() - 1);
+    }
+}
+
+void TlvList::pop_back() {
+    tlvs.pop_back();
+    rebuildIndex();
+}
+
+TlvList::iterator TlvList::insert(const_iterator position, const TLV &tlv) {
+    iterator it = tlvs.insert(tlvs.begin() + (position - tlvs.begin()), tlv);
+    // the positions after it have moved
+    rebuildIndex();
+    return it;
+}
+
+TlvList::iterator TlvList::erase(const_iterator position) {
+    iterator it = tlvs.erase(tlvs.begin() + (position - tlvs.begin()));
+    rebuildIndex();
+    return it;
+}
+
+void TlvList::set(const TLV &tlv) {
+    for (std::vector<TLV>::iterator it = tlvs.begin(); it != tlvs.end(); ++it) {
+        if (it->getTag() == tlv.getTag()) {
+            // same tag, so the index is still valid
+            *it = tlv;
+            return;
+        }
+    }
+
+    push_back(tlv);
+}
+
+void TlvList::clear() {
+    tlvs.clear();
+    memset(index, 0, sizeof(index));
+    stale = false;
+}
+
+const TLV* TlvList::find(const uint16_t tag) const {
+    if (stale) {
+        rebuildIndex();
+    }
+
+    for (size_t i = slot(tag); index[i] != 0; i = (i + 1) & (INDEX_SIZE - 1)) {
+        const TLV &tlv = tlvs[index[i] - 1];
+
+        if (tlv.getTag() == tag) {
+            return &tlv;
+        }
+    }
+
+    // only the first MAX_INDEXED TLVs are in the index
+    for (size_t i = MAX_INDEXED; i < tlvs.size(); ++i) {
+        if (tlvs[i].getTag() == tag) {
+            return &tlvs[i];
+        }
+    }
+
+    return 0;
+}
+
+string TlvList::getString(const uint16_t tag) const {
+    const TLV* tlv = find(tag);
+
+    if (tlv == 0 || tlv->getLen() == 0) {
+        return string();
+    }
+
+    const char* data = reinterpret_cast<const char*>(tlv->getData());
+    return string(data, strnlen(data, tlv->getLen()));
+}
+
+void TlvList::addToIndex(const size_t position) const {
+    if (position >= MAX_INDEXED) {
+        return;
+    }
+
+    uint16_t tag = tlvs[position].getTag();
+    size_t i = slot(tag);
+
+    for (; index[i] != 0; i = (i + 1) & (INDEX_SIZE - 1)) {
+        if (tlvs[index[i] - 1].getTag() == tag) {
+            // lookups return the first TLV with a tag
+            return;
+        }
+    }
+
+    index[i] = static_cast<uint8_t>(position + 1);
+}
+
+void TlvList::rebuildIndex() const {
+    memset(index, 0, sizeof(index));
+
+    for (size_t i = 0; i < tlvs.size(); ++i) {
+        addToIndex(i);
+    }
+
+    stale = false;
+}
+}  // namespace smpp
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2011 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ * @author hd@onlinecity.dk & td@onlinecity.dk
+ */
+
+#ifndef SMPP_TLVLIST_H_
+#define SMPP_TLVLIST_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "smpp/exceptions.h"
+#include "smpp/tagregistry.h"
+#include "smpp/tlv.h"
+
+namespace smpp {
+/**
+ * Flat container of the TLVs of a PDU.
+ * The TLVs are kept in a vector in the order they were added, which is also the order they are encoded in. A small
+ * open addressing index from tag to position makes lookups O(1), and the typed accessors decode the value directly
+ * from the TLV. If a tag occurs more than once, lookups return the first one.
+ *
+ * The interface is a subset of std::list<TLV>, which SMS::tlvs used to be, but std::list<TLV>::iterator must be
+ * replaced with TlvList::iterator. The TLVs can be modified through the mutable accessors. As a TLV may have been
+ * given another tag, the index is then rebuilt by the next lookup, so a reference from a mutable accessor must not
+ * be used to change a tag after a lookup. Unlike list iterators, the iterators are invalidated by push_back, insert
+ * and erase.
+ */
+class TlvList {
+  public:
+    typedef std::vector<TLV>::iterator iterator;
+    typedef std::vector<TLV>::const_iterator const_iterator;
+
+  private:
+    // Number of slots in the index, must be a power of two
+    static const size_t INDEX_SIZE = 32;
+    // Lists with more TLVs than this are searched linearly
+    static const size_t MAX_INDEXED = 24;
+
+    std::vector<TLV> tlvs;
+    // Position + 1 of the TLV in tlvs, 0 is an empty slot
+    mutable uint8_t index[INDEX_SIZE];
+    // True once the TLVs may have been modified through a mutable accessor, until the next lookup rebuilds the index
+    mutable bool stale;
+
+  public:
+    TlvList();
+
+    template<typename InputIterator>
+    TlvList(InputIterator first, InputIterator last) :
+        tlvs(), index(), stale(false) {
+        assign(first, last);
+    }
+
+    template<typename InputIterator>
+    void assign(InputIterator first, InputIterator last) {
+        clear();
+
+        for (; first != last; ++first) {
+            push_back(*first);
+        }
+    }
+
+    const_iterator begin() const {
+        return tlvs.begin();
+    }
+
+    const_iterator end() const {
+        return tlvs.end();
+    }
+
+    iterator begin() {
+        stale = true;
+        return tlvs.begin();
+    }
+
+    iterator end() {
+        stale = true;
+        return tlvs.end();
+    }
+
+    size_t size() const {
+        return tlvs.size();
+    }
+
+    bool empty() const {
+        return tlvs.empty();
+    }
+
+    const TLV &front() const {
+        return tlvs.front();
+    }
+
+    const TLV &back() const {
+        return tlvs.back();
+    }
+
+    const TLV &operator[](const size_t i) const {
+        return tlvs[i];
+    }
+
+    TLV &front() {
+        stale = true;
+        return tlvs.front();
+    }
+
+    TLV &back() {
+        stale = true;
+        return tlvs.back();
+    }
+
+    TLV &operator[](const size_t i) {
+        stale = true;
+        return tlvs[i];
+    }
+
+    /**
+     * Appends a TLV.
+     */
+    void push_back(const TLV &tlv);
+
+    /**
+     * Removes the last TLV.
+     */
+    void pop_back();
+
+    /**
+     * Inserts a TLV before position.
+     * @return Iterator to the inserted TLV.
+     */
+    iterator insert(const_iterator position, const TLV &tlv);
+
+    /**
+     * Removes a TLV.
+     * @return Iterator to the TLV after it.
+     */
+    iterator erase(const_iterator position);
+
+    /**
+     * Replaces the first TLV with the same tag, or appends the TLV if the tag is not present.
+     */
+    void set(const TLV &tlv);
+
+    void clear();
+
+    /**
+     * @return The first TLV with the given tag, or null if the tag is not present.
+     */
+    const TLV* find(const uint16_t tag) const;
+
+    bool contains(const uint16_t tag) const {
+        return find(tag) != 0;
+    }
+
+    /**
+     * Decodes an integer TLV, ie. get<uint16_t>(tags::SAR_MSG_REF_NUM).
+     * @param tag TLV tag.
+     * @param defaultValue Value returned if the tag is not present.
+     * @return The value in host byte order.
+     * @throw SmppException if the length of the value is not sizeof(T).
+     */
+    template<typename T>
+    T get(const uint16_t tag, const T &defaultValue = T()) const {
+        static_assert(std::is_integral<T>::value, "TlvList::get only decodes integers");
+        const TLV* tlv = find(tag);
+
+        if (tlv == 0) {
+            return defaultValue;
+        }
+
+        if (tlv->getLen() != sizeof(T)) {
+            throw smpp::SmppException("TLV length does not match the requested type");
+        }
+
+        const uint8_t* data = tlv->getData();
+        T value = 0;
+
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            value = static_cast<T>((value << 8) | data[i]);
+        }
+
+        return value;
+    }
+
+    /**
+     * Decodes a TLV using the type of the tag in the registry, ie. get<tags::RECEIPTED_MESSAGE_ID>() returns a
+     * string and get<tags::SAR_MSG_REF_NUM>() an uint16_t.
+     * @param defaultValue Value returned if the tag is not present.
+     * @throw SmppException if the length of the value is invalid for the tag.
+     */
+    template<uint16_t Tag>
+    typename TagTraits<Tag>::value_type get(const typename TagTraits<Tag>::value_type &defaultValue =
+            typename TagTraits<Tag>::value_type()) const {
+        const TLV* tlv = find(Tag);
+
+        if (tlv == 0) {
+            return defaultValue;
+        }
+
+        if (tlv->getLen() < TagTraits<Tag>::minLength || tlv->getLen() > TagTraits<Tag>::maxLength) {
+            throw smpp::SmppException("TLV length does not match the tag");
+        }
+
+        return TagTraits<Tag>::decode(*tlv);
+    }
+
+    /**
+     * Sets a TLV from a value of the type of the tag, replacing the first TLV with the same tag.
+     */
+    template<uint16_t Tag>
+    void set(const typename TagTraits<Tag>::value_type &value) {
+        set(makeTlv<Tag>(value));
+    }
+
+    /**
+     * Returns a C-Octet string TLV, ie. getString(tags::RECEIPTED_MESSAGE_ID). The null terminator is optional.
+     * @return The value up to the null terminator, or an empty string if the tag is not present.
+     */
+    std::string getString(const uint16_t tag) const;
+
+  private:
+    static size_t slot(const uint16_t tag) {
+        // Fibonacci hashing of the 16 bit tag to 5 bits
+        return static_cast<uint16_t>(tag * 40503u) >> 11;
+    }
+
+    void addToIndex(const size_t position) const;
+    void rebuildIndex() const;
+};
+}  // namespace smpp
+
+#endif  // SMPP_TLVLIST_H_
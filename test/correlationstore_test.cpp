@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "smpp/correlationstore.h"
+#include "smpp/receipt.h"
+#include "smpp/smpp.h"
+
+using std::string;
+
+TEST(CorrelationStoreTest, insertFind) {
+    smpp::CorrelationStore store(1000);
+    uint64_t value = 0;
+    EXPECT_FALSE(store.find("a1b2c3", &value));
+    EXPECT_TRUE(store.insert("a1b2c3", 42));
+    EXPECT_TRUE(store.insert("a1b2c4", 43));
+    EXPECT_EQ(store.size(), size_t(2));
+    ASSERT_TRUE(store.find("a1b2c3", &value));
+    EXPECT_EQ(value, uint64_t(42));
+    ASSERT_TRUE(store.find("a1b2c4", &value));
+    EXPECT_EQ(value, uint64_t(43));
+
+    // update
+    EXPECT_TRUE(store.insert("a1b2c3", 44));
+    EXPECT_EQ(store.size(), size_t(2));
+    ASSERT_TRUE(store.find("a1b2c3", &value));
+    EXPECT_EQ(value, uint64_t(44));
+
+    EXPECT_TRUE(store.remove("a1b2c3", &value));
+    EXPECT_EQ(value, uint64_t(44));
+    EXPECT_FALSE(store.find("a1b2c3", &value));
+    EXPECT_FALSE(store.remove("a1b2c3", 0));
+    EXPECT_EQ(store.size(), size_t(1));
+
+    // ids longer than the inline key share a prefix
+    string prefix(smpp::CorrelationStore::KEY_SIZE, 'x');
+    EXPECT_TRUE(store.insert(prefix + "-0001", 1));
+    EXPECT_TRUE(store.insert(prefix + "-0002", 2));
+    ASSERT_TRUE(store.find(prefix + "-0002", &value));
+    EXPECT_EQ(value, uint64_t(2));
+    EXPECT_FALSE(store.find(prefix + "-0003", &value));
+}
+
+TEST(CorrelationStoreTest, full) {
+    smpp::CorrelationStore store(100);
+
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(store.insert(boost::lexical_cast<string>(i), i));
+    }
+
+    EXPECT_FALSE(store.insert("100", 100));
+
+    // removing and inserting keeps working when the table is full of tombstones
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < 100; ++i) {
+            string id = boost::lexical_cast<string>(round * 100 + i);
+            ASSERT_TRUE(store.remove(id, 0));
+            ASSERT_TRUE(store.insert(boost::lexical_cast<string>((round + 1) * 100 + i), i));
+        }
+    }
+
+    uint64_t value = 0;
+
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(store.find(boost::lexical_cast<string>(1000 + i), &value));
+        ASSERT_EQ(value, uint64_t(i));
+    }
+}
+
+TEST(CorrelationStoreTest, expire) {
+    smpp::CorrelationStore store(1000, 3600, 60);
+    time_t now = 1400000000;
+    ASSERT_TRUE(store.insert("old", 3, 1, now));
+    ASSERT_TRUE(store.insert("new", 3, 2, now + 1800));
+    ASSERT_TRUE(store.insert("renewed", 7, 3, now));
+    ASSERT_TRUE(store.insert("renewed", 7, 3, now + 1800));
+
+    EXPECT_EQ(store.expire(now + 3599), size_t(0));
+    EXPECT_EQ(store.expire(now + 3660), size_t(1));
+    uint64_t value = 0;
+    EXPECT_FALSE(store.find("old", &value));
+    EXPECT_TRUE(store.find("new", &value));
+    EXPECT_TRUE(store.find("renewed", &value));
+
+    // inserting into a bucket a full ring later expires its entries
+    ASSERT_TRUE(store.insert("later", 5, 4, now + 1800 + 3600 + 120));
+    EXPECT_FALSE(store.find("new", &value));
+    EXPECT_FALSE(store.find("renewed", &value));
+    EXPECT_EQ(store.size(), size_t(1));
+
+    // an updated entry moves to the bucket of its new expiry
+    now += 7200;
+
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(store.insert("moving", 6, i, now + i * 60));
+    }
+
+    // and expires only once that bucket is due, while "later" went when its bucket was reused
+    EXPECT_FALSE(store.find("later", &value));
+    EXPECT_EQ(store.expire(now + 99 * 60 + 3599), size_t(0));
+    EXPECT_TRUE(store.find("moving", &value));
+    EXPECT_EQ(store.expire(now + 99 * 60 + 3660), size_t(1));
+    EXPECT_FALSE(store.find("moving", &value));
+}
+
+TEST(CorrelationStoreTest, resolve) {
+    smpp::CorrelationStore store(10);
+    ASSERT_TRUE(store.insert("a1b2c3", 42));
+    smpp::receipt::Receipt receipt;
+    receipt.id = "a1b2c3";
+    receipt.state = smpp::STATE_ENROUTE;
+    uint64_t value = 0;
+    ASSERT_TRUE(store.resolve(receipt, &value));
+    EXPECT_EQ(value, uint64_t(42));
+    EXPECT_EQ(store.size(), size_t(1));
+
+    // a final state removes the entry
+    receipt.state = smpp::STATE_DELIVERED;
+    ASSERT_TRUE(store.resolve(receipt, &value));
+    EXPECT_EQ(store.size(), size_t(0));
+    EXPECT_FALSE(store.resolve(receipt, &value));
+}
+
+TEST(CorrelationStoreTest, concurrentReaders) {
+    smpp::CorrelationStore store(20000);
+
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_TRUE(store.insert(boost::lexical_cast<string>(i), i));
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<int> errors(0);
+    boost::thread_group readers;
+
+    for (int t = 0; t < 4; ++t) {
+        readers.create_thread([&store, &done, &errors]() {
+            while (!done) {
+                for (int i = 0; i < 10000; ++i) {
+                    uint64_t value = 0;
+
+                    if (!store.find(boost::lexical_cast<string>(i), &value) || value != uint64_t(i)) {
+                        ++errors;
+                    }
+                }
+            }
+        });
+    }
+
+    // churn other keys while reading
+    for (int i = 10000; i < 100000; ++i) {
+        string id = boost::lexical_cast<string>(i);
+        store.insert(id, i);
+        store.remove(id, 0);
+    }
+
+    done = true;
+    readers.join_all();
+    EXPECT_EQ(errors, 0);
+}
+
+TEST(CorrelationStoreTest, mapped) {
+    string path = "/tmp/correlationstore_test." + boost::lexical_cast<string>(getpid());
+    time_t now = 1400000000;
+    std::remove(path.c_str());
+
+    {
+        smpp::CorrelationStore store(path, 1000, 3600, 60);
+        EXPECT_TRUE(store.isMapped());
+
+        for (int i = 0; i < 500; ++i) {
+            string id = boost::lexical_cast<string>(i);
+            ASSERT_TRUE(store.insert(id.data(), id.length(), i, i < 100 ? now - 3000 : now));
+        }
+
+        for (int i = 200; i < 300; ++i) {
+            ASSERT_TRUE(store.remove(boost::lexical_cast<string>(i), 0));
+        }
+
+        EXPECT_EQ(store.size(), size_t(400));
+
+        // a copy taken while the store is open looks like a crash, and is checked when opened
+        std::ifstream source(path.c_str(), std::ios::binary);
+        std::ofstream copy((path + ".copy").c_str(), std::ios::binary);
+        copy << source.rdbuf();
+    }
+
+    {
+        // reopened with the geometry of the file
+        smpp::CorrelationStore store(path, 10);
+        EXPECT_EQ(store.size(), size_t(400));
+        EXPECT_EQ(store.capacity(), size_t(1000));
+        uint64_t value = 0;
+        ASSERT_TRUE(store.find("499", &value));
+        EXPECT_EQ(value, uint64_t(499));
+        EXPECT_FALSE(store.find("250", &value));
+
+        // the entries from the file are swept, the first 100 have expired
+        size_t removed = 0;
+
+        for (int i = 0; i < 100; ++i) {
+            removed += store.expire(now + 700);
+        }
+
+        EXPECT_EQ(removed, size_t(100));
+        EXPECT_FALSE(store.find("50", &value));
+
+        EXPECT_EQ(store.compact(now + 700), size_t(300));
+        ASSERT_TRUE(store.find("150", &value));
+        EXPECT_EQ(value, uint64_t(150));
+        EXPECT_TRUE(store.insert("new", 3, 1, now + 700));
+        EXPECT_EQ(store.size(), size_t(301));
+    }
+
+    {
+        smpp::CorrelationStore store(path + ".copy", 1000);
+        EXPECT_EQ(store.size(), size_t(400));
+        uint64_t value = 0;
+        EXPECT_TRUE(store.find("0", &value));
+    }
+
+    {
+        smpp::CorrelationStore store(path, 1000);
+        EXPECT_EQ(store.size(), size_t(301));
+    }
+
+    std::ofstream garbage((path + ".garbage").c_str());
+    garbage << "not a correlation store, but long enough to have a header of sixty-four bytes in it";
+    garbage.close();
+    EXPECT_THROW(smpp::CorrelationStore store(path + ".garbage", 1000), smpp::SmppException);
+
+    std::remove(path.c_str());
+    std::remove((path + ".copy").c_str());
+    std::remove((path + ".garbage").c_str());
+}
+
+TEST(CorrelationStoreTest, emptyFile) {
+    // a crash between creating and sizing the file leaves it empty
+    string path = "/tmp/correlationstore_test.empty." + boost::lexical_cast<string>(getpid());
+    std::ofstream(path.c_str()).close();
+
+    {
+        smpp::CorrelationStore store(path, 100);
+        EXPECT_EQ(store.size(), size_t(0));
+        EXPECT_TRUE(store.insert("a1b2c3", 42));
+    }
+
+    {
+        smpp::CorrelationStore store(path, 100);
+        uint64_t value = 0;
+        ASSERT_TRUE(store.find("a1b2c3", &value));
+        EXPECT_EQ(value, uint64_t(42));
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(CorrelationStoreTest, compactFailure) {
+    string directory = "/tmp/correlationstore_test.d." + boost::lexical_cast<string>(getpid());
+    string path = directory + "/store";
+    ASSERT_EQ(mkdir(directory.c_str(), 0755), 0);
+    time_t now = 1400000000;
+
+    {
+        smpp::CorrelationStore store(path, 1000, 3600, 60);
+
+        for (int i = 0; i < 200; ++i) {
+            string id = boost::lexical_cast<string>(i);
+            ASSERT_TRUE(store.insert(id.data(), id.length(), i, i < 100 ? now : now + 1800));
+        }
+
+        // a non-empty directory in place of the file makes replacing it fail
+        std::remove(path.c_str());
+        ASSERT_EQ(mkdir(path.c_str(), 0755), 0);
+        std::ofstream((path + "/file").c_str()).close();
+        EXPECT_THROW(store.compact(now + 3660), smpp::SmppException);
+
+        // the store is unchanged, so the expiry index still finds the entries which are due
+        EXPECT_EQ(store.size(), size_t(200));
+        EXPECT_EQ(store.expire(now + 3660), size_t(100));
+        uint64_t value = 0;
+        ASSERT_TRUE(store.find("150", &value));
+        EXPECT_EQ(value, uint64_t(150));
+        EXPECT_FALSE(store.find("50", &value));
+    }
+
+    std::remove((path + "/file").c_str());
+    rmdir(path.c_str());
+    std::remove((path + ".compact").c_str());
+    rmdir(directory.c_str());
+}
+
+TEST(CorrelationStoreTest, concurrentCompact) {
+    string path = "/tmp/correlationstore_test.compact." + boost::lexical_cast<string>(getpid());
+    std::remove(path.c_str());
+
+    for (int mapped = 0; mapped < 2; ++mapped) {
+        boost::scoped_ptr<smpp::CorrelationStore> store(mapped ? new smpp::CorrelationStore(path, 20000)
+                : new smpp::CorrelationStore(20000));
+
+        for (int i = 0; i < 10000; ++i) {
+            ASSERT_TRUE(store->insert(boost::lexical_cast<string>(i), i));
+        }
+
+        std::atomic<bool> done(false);
+        std::atomic<int> errors(0);
+        boost::thread_group readers;
+
+        for (int t = 0; t < 4; ++t) {
+            readers.create_thread([&store, &done, &errors]() {
+                while (!done) {
+                    for (int i = 0; i < 10000; i += 7) {
+                        uint64_t value = 0;
+
+                        if (!store->find(boost::lexical_cast<string>(i), &value) || value != uint64_t(i)) {
+                            ++errors;
+                        }
+                    }
+                }
+            });
+        }
+
+        // the old table is freed or unmapped while it is read
+        for (int round = 0; round < 20; ++round) {
+            for (int i = 10000; i < 10500; ++i) {
+                string id = boost::lexical_cast<string>(i);
+                store->insert(id, i);
+                store->remove(id, 0);
+            }
+
+            EXPECT_EQ(store->compact(smpp::CoarseClock::now()), size_t(10000));
+        }
+
+        done = true;
+        readers.join_all();
+        EXPECT_EQ(errors, 0);
+    }
+
+    std::remove(path.c_str());
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
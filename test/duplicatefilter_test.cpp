@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "smpp/duplicatefilter.h"
+#include "smpp/pdu.h"
+#include "smpp/smpp.h"
+#include "smpp/smsview.h"
+#include "smpp/tlv.h"
+
+using std::string;
+
+namespace {
+smpp::PDU deliverSm(const string &source, const string &message, const string &receiptedId = "") {
+    smpp::PDU pdu(smpp::DELIVER_SM, 0, 1);
+    pdu << "" << smpp::SmppAddress(source, 1, 1) << smpp::SmppAddress("4512345678", 1, 1);
+    pdu << 0 << 0 << 0 << "" << "" << 0 << 0 << 0 << 0;
+    pdu << static_cast<uint8_t>(message.length() + 1) << message;
+
+    if (!receiptedId.empty()) {
+        pdu << smpp::TLV(smpp::tags::RECEIPTED_MESSAGE_ID, receiptedId + '\0');
+    }
+
+    return pdu;
+}
+}  // namespace
+
+TEST(DuplicateFilterTest, fingerprint) {
+    smpp::PDU a = deliverSm("4587654321", "hello");
+    smpp::PDU b = deliverSm("4587654321", "hello");
+    smpp::PDU c = deliverSm("4587654321", "hello!");
+    smpp::PDU d = deliverSm("4587654322", "hello");
+    uint64_t fa = smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(a));
+    EXPECT_EQ(fa, smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(b)));
+    EXPECT_NE(fa, smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(c)));
+    EXPECT_NE(fa, smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(d)));
+
+    // receipts are told apart by the message id and state, not the rest of the text
+    smpp::PDU r1 = deliverSm("4587654321", "id:1 stat:DELIVRD", "1");
+    smpp::PDU r2 = deliverSm("4587654321", "id:1 stat:DELIVRD", "2");
+    smpp::PDU r3 = deliverSm("4587654321", "id:1 stat:ENROUTE", "1");
+    smpp::PDU r4 = deliverSm("4587654321", "id:1 done date:1405011200 stat:DELIVRD", "1");
+    uint64_t f1 = smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(r1));
+    EXPECT_NE(f1, smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(r2)));
+    EXPECT_NE(f1, smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(r3)));
+    EXPECT_EQ(f1, smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(r4)));
+
+    // the MESSAGE_STATE tag is used when present
+    smpp::PDU t1 = deliverSm("4587654321", "id:1 stat:DELIVRD", "1");
+    t1 << smpp::TLV(smpp::tags::MESSAGE_STATE, smpp::STATE_ENROUTE);
+    smpp::PDU t2 = deliverSm("4587654321", "id:1 stat:DELIVRD", "1");
+    t2 << smpp::TLV(smpp::tags::MESSAGE_STATE, smpp::STATE_DELIVERED);
+    EXPECT_NE(smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(t1)),
+              smpp::DuplicateFilter::fingerprintOf(smpp::SmsView(t2)));
+}
+
+TEST(DuplicateFilterTest, window) {
+    smpp::DuplicateFilter filter(1000, 60);
+    time_t now = 1400000000;
+
+    for (uint64_t i = 1; i <= 500; ++i) {
+        EXPECT_FALSE(filter.check(i * 0x9e3779b97f4a7c15ULL, now));
+    }
+
+    EXPECT_TRUE(filter.check(7 * 0x9e3779b97f4a7c15ULL, now + 30));
+    // still remembered in the previous generation
+    EXPECT_TRUE(filter.check(8 * 0x9e3779b97f4a7c15ULL, now + 90));
+    EXPECT_EQ(2u, filter.getDuplicates());
+    // remembered until its generation is reused, after at most two windows
+    EXPECT_TRUE(filter.check(9 * 0x9e3779b97f4a7c15ULL, now + 130));
+    EXPECT_FALSE(filter.check(10 * 0x9e3779b97f4a7c15ULL, now + 160));
+}
+
+TEST(DuplicateFilterTest, capacity) {
+    smpp::DuplicateFilter filter(100, 600);
+    time_t now = 1400000000;
+
+    for (uint64_t i = 1; i <= 100; ++i) {
+        EXPECT_FALSE(filter.check(i, now));
+    }
+
+    // a full generation is rotated early, the previous one is kept
+    EXPECT_FALSE(filter.check(101, now));
+    EXPECT_TRUE(filter.check(1, now));
+    EXPECT_TRUE(filter.check(101, now));
+    EXPECT_EQ(101u, filter.size());
+}
+
+TEST(DuplicateFilterTest, remember) {
+    smpp::DuplicateFilter filter(100, 600);
+    time_t now = 1400000000;
+
+    // only remembered messages are duplicates, and remembering one twice keeps one entry
+    EXPECT_FALSE(filter.contains(1, now));
+    EXPECT_FALSE(filter.contains(1, now));
+    filter.remember(1, now);
+    filter.remember(1, now);
+    EXPECT_TRUE(filter.contains(1, now));
+    EXPECT_EQ(1u, filter.size());
+    EXPECT_EQ(1u, filter.getDuplicates());
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
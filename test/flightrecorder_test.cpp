@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <boost/thread/thread.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "smpp/flightrecorder.h"
+#include "smpp/pdu.h"
+#include "smpp/smpp.h"
+
+using smpp::FlightRecord;
+using smpp::FlightRecorder;
+using std::string;
+using std::vector;
+
+namespace {
+void recordPdu(FlightRecorder* recorder, const bool sent, smpp::PDU pdu) {
+    recorder->record(sent, pdu.getOctets().get(), pdu.getSize());
+}
+}  // namespace
+
+TEST(FlightRecorderTest, ring) {
+    FlightRecorder recorder(4, 32);
+    ASSERT_TRUE(recorder.getRecords().empty());
+
+    for (uint32_t i = 1; i <= 6; ++i) {
+        smpp::PDU pdu(smpp::ENQUIRE_LINK, 0, i);
+        recordPdu(&recorder, i % 2 == 1, pdu);
+    }
+
+    vector<FlightRecord> records = recorder.getRecords();
+    ASSERT_EQ(recorder.getRecorded(), 6u);
+    ASSERT_EQ(records.size(), 4u);
+
+    for (size_t i = 0; i < records.size(); ++i) {
+        ASSERT_EQ(records[i].length, 16u);
+        ASSERT_EQ(records[i].data.size(), 16u);
+        // sequence numbers 3 to 6, oldest first
+        ASSERT_EQ(records[i].data[15], i + 3);
+        ASSERT_EQ(records[i].sent, (i + 3) % 2 == 1);
+        ASSERT_GT(records[i].timestamp, 0);
+    }
+}
+
+TEST(FlightRecorderTest, truncate) {
+    FlightRecorder recorder(4, 20);
+    uint8_t head[4] = {0, 0, 0, 40};
+    uint8_t body[36] = {0x80, 0, 0, 4};
+    recorder.record(false, head, 4, body, 36);
+    vector<FlightRecord> records = recorder.getRecords();
+    ASSERT_EQ(records.size(), 1u);
+    ASSERT_EQ(records[0].length, 40u);
+    ASSERT_EQ(records[0].data.size(), 20u);
+    ASSERT_EQ(records[0].data[3], 40);
+    ASSERT_EQ(records[0].data[4], 0x80);
+    ASSERT_EQ(records[0].data[7], 4);
+}
+
+TEST(FlightRecorderTest, dump) {
+    FlightRecorder recorder;
+    smpp::PDU pdu(smpp::SUBMIT_SM, 0, 1);
+    pdu << "abc";
+    recordPdu(&recorder, true, pdu);
+    std::ostringstream out;
+    recorder.dump(out);
+    string text = out.str();
+    ASSERT_NE(text.find(" sent submit_sm 20 bytes\n"), string::npos);
+    ASSERT_NE(text.find("00000000  00 00 00 14 00 00 00 04  00 00 00 00 00 00 00 01  |................|\n"),
+              string::npos);
+    ASSERT_NE(text.find("00000010  61 62 63 00"), string::npos);
+}
+
+TEST(FlightRecorderTest, concurrent) {
+    // few slots, so writers wrap around the ring while others are writing
+    FlightRecorder recorder(4, 16);
+    boost::thread_group writers;
+
+    for (int t = 0; t < 4; ++t) {
+        writers.create_thread([&recorder, t]() {
+            uint8_t bytes[16];
+
+            for (int i = 0; i < 10000; ++i) {
+                for (int j = 0; j < 16; ++j) {
+                    bytes[j] = t;
+                }
+
+                recorder.record(true, bytes, sizeof(bytes));
+            }
+        });
+    }
+
+    // records read while they are written are either complete or left out
+    for (int i = 0; i < 100; ++i) {
+        vector<FlightRecord> records = recorder.getRecords();
+
+        for (size_t j = 0; j < records.size(); ++j) {
+            ASSERT_EQ(records[j].data.size(), 16u);
+            ASSERT_EQ(vector<uint8_t>(16, records[j].data[0]), records[j].data);
+        }
+    }
+
+    writers.join_all();
+    ASSERT_EQ(recorder.getRecorded(), 40000u);
+    vector<FlightRecord> records = recorder.getRecords();
+    ASSERT_EQ(records.size(), 4u);
+
+    for (size_t j = 0; j < records.size(); ++j) {
+        ASSERT_EQ(vector<uint8_t>(16, records[j].data[0]), records[j].data);
+    }
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
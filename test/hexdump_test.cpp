@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "smpp/hexdump.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+vector<uint8_t> range(const int from, const int to) {
+    vector<uint8_t> bytes;
+
+    for (int i = from; i < to; ++i) {
+        bytes.push_back(i);
+    }
+
+    return bytes;
+}
+
+string dump(const vector<uint8_t> &bytes) {
+    return oc::tools::hexdump(bytes.empty() ? 0 : &bytes[0], bytes.size());
+}
+
+string streamDump(const vector<uint8_t> &bytes) {
+    std::ostringstream out;
+    oc::tools::hexdump(out, bytes.empty() ? 0 : &bytes[0], bytes.size());
+    return out.str();
+}
+}  // namespace
+
+// Expected output is that of the stream based hexdump this one replaced
+TEST(HexdumpTest, output) {
+    ASSERT_EQ(dump(vector<uint8_t>()), "");
+    ASSERT_EQ(dump(vector<uint8_t>(1, 0x41)),
+              "00000000  41                                                |A|\n"
+              "00000001\n");
+    ASSERT_EQ(dump(range(0, 8)),
+              "00000000  00 01 02 03 04 05 06 07                           |........|\n"
+              "00000008\n");
+    ASSERT_EQ(dump(range(0, 9)),
+              "00000000  00 01 02 03 04 05 06 07  08                       |.........|\n"
+              "00000009\n");
+    ASSERT_EQ(dump(range(0, 16)),
+              "00000000  00 01 02 03 04 05 06 07  08 09 0a 0b 0c 0d 0e 0f  |................|\n"
+              "00000010\n");
+    ASSERT_EQ(dump(range(0x1e, 0x40)),
+              "00000000  1e 1f 20 21 22 23 24 25  26 27 28 29 2a 2b 2c 2d  |.. !\"#$%&'()*+,-|\n"
+              "00000010  2e 2f 30 31 32 33 34 35  36 37 38 39 3a 3b 3c 3d  |./0123456789:;<=|\n"
+              "00000020  3e 3f                                             |>?|\n"
+              "00000022\n");
+    ASSERT_EQ(dump(range(0x70, 0x90)),
+              "00000000  70 71 72 73 74 75 76 77  78 79 7a 7b 7c 7d 7e 7f  |pqrstuvwxyz{|}~\x7f|\n"
+              "00000010  80 81 82 83 84 85 86 87  88 89 8a 8b 8c 8d 8e 8f  |................|\n"
+              "00000020\n");
+}
+
+TEST(HexdumpTest, buffer) {
+    for (size_t length = 0; length < 100; ++length) {
+        vector<uint8_t> bytes = range(0, length);
+        string expected = dump(bytes);
+        ASSERT_EQ(oc::tools::hexdumpSize(length), expected.size());
+        vector<char> buffer(expected.size() + 1, '#');
+        ASSERT_EQ(oc::tools::hexdump(bytes.empty() ? 0 : &bytes[0], length, &buffer[0]), expected.size());
+        ASSERT_EQ(string(&buffer[0], expected.size()), expected);
+        ASSERT_EQ(buffer[expected.size()], '#');
+    }
+}
+
+TEST(HexdumpTest, stream) {
+    // larger than the lines streamed at a time
+    vector<uint8_t> bytes;
+
+    for (int i = 0; i < 5000; ++i) {
+        bytes.push_back(i * 7);
+    }
+
+    for (size_t length = 0; length <= bytes.size(); length += length < 40 ? 1 : 997) {
+        vector<uint8_t> prefix(bytes.begin(), bytes.begin() + length);
+        ASSERT_EQ(streamDump(prefix), dump(prefix));
+    }
+
+    ASSERT_EQ(streamDump(range(0, 1024 + 16)), dump(range(0, 1024 + 16)));
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "smpp/inboundqueue.h"
+#include "smpp/metrics.h"
+#include "smpp/pdu.h"
+#include "smpp/smpp.h"
+
+using smpp::InboundQueue;
+using smpp::PDU;
+
+TEST(InboundQueueTest, kinds) {
+    EXPECT_EQ(InboundQueue::RESPONSES, InboundQueue::kindOf(smpp::SUBMIT_SM_RESP));
+    EXPECT_EQ(InboundQueue::RESPONSES, InboundQueue::kindOf(smpp::GENERIC_NACK));
+    EXPECT_EQ(InboundQueue::MESSAGES, InboundQueue::kindOf(smpp::DELIVER_SM));
+    EXPECT_EQ(InboundQueue::MESSAGES, InboundQueue::kindOf(smpp::ALERT_NOTIFICATION));
+    EXPECT_EQ(InboundQueue::REQUESTS, InboundQueue::kindOf(smpp::ENQUIRE_LINK));
+
+    InboundQueue queue;
+    EXPECT_TRUE(queue.push(PDU(smpp::DELIVER_SM, 0, 1)));
+    EXPECT_TRUE(queue.push(PDU(smpp::SUBMIT_SM_RESP, 0, 2)));
+    EXPECT_TRUE(queue.push(PDU(smpp::DELIVER_SM, 0, 3)));
+    EXPECT_EQ(2u, queue.size(InboundQueue::MESSAGES));
+    EXPECT_EQ(1u, queue.size(InboundQueue::RESPONSES));
+    EXPECT_EQ(1u, queue.pop(InboundQueue::MESSAGES).getSequenceNo());
+    EXPECT_EQ(3u, queue.pop(InboundQueue::MESSAGES).getSequenceNo());
+    EXPECT_TRUE(queue.pop(InboundQueue::MESSAGES).null);
+    EXPECT_FALSE(queue.empty());
+}
+
+TEST(InboundQueueTest, bounded) {
+    InboundQueue queue(2);
+    EXPECT_TRUE(queue.push(PDU(smpp::DELIVER_SM, 0, 1)));
+    EXPECT_FALSE(queue.isPaused());
+    EXPECT_TRUE(queue.push(PDU(smpp::DELIVER_SM, 0, 2)));
+    EXPECT_TRUE(queue.isPaused());
+    EXPECT_FALSE(queue.push(PDU(smpp::DELIVER_SM, 0, 3)));
+    EXPECT_EQ(2u, queue.size(InboundQueue::MESSAGES));
+
+    // responses replace the oldest and do not pause the queue
+    EXPECT_TRUE(queue.push(PDU(smpp::SUBMIT_SM_RESP, 0, 4)));
+    EXPECT_TRUE(queue.push(PDU(smpp::SUBMIT_SM_RESP, 0, 5)));
+    EXPECT_TRUE(queue.push(PDU(smpp::SUBMIT_SM_RESP, 0, 6)));
+    EXPECT_EQ(2u, queue.size(InboundQueue::RESPONSES));
+    EXPECT_EQ(5u, queue.begin(InboundQueue::RESPONSES)->getSequenceNo());
+
+    queue.erase(InboundQueue::MESSAGES, queue.begin(InboundQueue::MESSAGES));
+    EXPECT_FALSE(queue.isPaused());
+
+    smpp::InboundQueueStats stats = queue.getStats();
+    EXPECT_EQ(1u, stats.depth[InboundQueue::MESSAGES]);
+    EXPECT_EQ(2u, stats.peakDepth[InboundQueue::MESSAGES]);
+    EXPECT_EQ(2u, stats.overflows);
+    EXPECT_EQ(1u, stats.pauses);
+}
+
+TEST(InboundQueueTest, metrics) {
+    smpp::Metrics metrics;
+    {
+        InboundQueue queue;
+        queue.setMetrics(&metrics);
+        EXPECT_TRUE(queue.push(PDU(smpp::DELIVER_SM, 0, 1)));
+        EXPECT_TRUE(queue.push(PDU(smpp::ENQUIRE_LINK, 0, 2)));
+        EXPECT_EQ(2, metrics.getSnapshot().inboundQueueDepth);
+    }
+
+    // the PDUs of a destroyed queue are no longer counted
+    EXPECT_EQ(0, metrics.getSnapshot().inboundQueueDepth);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
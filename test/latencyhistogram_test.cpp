@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <boost/thread/thread.hpp>
+
+#include "gtest/gtest.h"
+#include "smpp/latencyhistogram.h"
+
+using smpp::LatencyHistogram;
+using smpp::LatencySnapshot;
+
+TEST(LatencyHistogramTest, buckets) {
+    ASSERT_EQ(LatencyHistogram::bucketOf(0), 0);
+    ASSERT_EQ(LatencyHistogram::bucketOf(15), 15);
+    ASSERT_EQ(LatencyHistogram::bucketOf(16), 16);
+    ASSERT_EQ(LatencyHistogram::bucketOf(31), 31);
+    ASSERT_EQ(LatencyHistogram::bucketOf(32), 32);
+    ASSERT_EQ(LatencyHistogram::bucketOf(33), 32);
+    ASSERT_EQ(LatencyHistogram::bucketOf(~0ULL), LatencyHistogram::BUCKETS - 1);
+
+    // the buckets are contiguous, and each value is within its bucket
+    for (int i = 0; i + 1 < LatencyHistogram::BUCKETS; ++i) {
+        ASSERT_EQ(LatencyHistogram::upperBound(i), LatencyHistogram::lowerBound(i + 1));
+        ASSERT_EQ(LatencyHistogram::bucketOf(LatencyHistogram::lowerBound(i)), i);
+        ASSERT_EQ(LatencyHistogram::bucketOf(LatencyHistogram::upperBound(i) - 1), i);
+    }
+
+    // precision is 1/16th of the value
+    ASSERT_EQ(LatencyHistogram::lowerBound(LatencyHistogram::bucketOf(100000)), 98304u);
+    ASSERT_EQ(LatencyHistogram::upperBound(LatencyHistogram::bucketOf(100000)), 102400u);
+}
+
+TEST(LatencyHistogramTest, percentiles) {
+    LatencyHistogram histogram;
+    ASSERT_EQ(histogram.getSnapshot().getPercentile(50), 0u);
+
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        histogram.record(i * 10);
+    }
+
+    LatencySnapshot snapshot = histogram.getSnapshot();
+    ASSERT_EQ(snapshot.getCount(), 1000u);
+    ASSERT_EQ(snapshot.getMax(), 10000u);
+    ASSERT_DOUBLE_EQ(snapshot.getMean(), 5005);
+    ASSERT_NEAR(snapshot.getPercentile(50), 5000, 5000 / 16);
+    ASSERT_NEAR(snapshot.getPercentile(90), 9000, 9000 / 16);
+    ASSERT_NEAR(snapshot.getPercentile(99), 9900, 9900 / 16);
+    ASSERT_EQ(snapshot.getPercentile(99.9), 10000u);
+    ASSERT_EQ(snapshot.getPercentile(100), 10000u);
+    ASSERT_EQ(snapshot.getPercentile(0), 10u);
+
+    histogram.reset();
+    ASSERT_EQ(histogram.getSnapshot().getCount(), 0u);
+}
+
+TEST(LatencyHistogramTest, merge) {
+    LatencyHistogram fast;
+    LatencyHistogram slow;
+
+    for (int i = 0; i < 90; ++i) {
+        fast.record(100);
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        slow.record(100000);
+    }
+
+    LatencySnapshot snapshot = fast.getSnapshot();
+    snapshot.merge(slow.getSnapshot());
+    ASSERT_EQ(snapshot.getCount(), 100u);
+    ASSERT_EQ(snapshot.getMax(), 100000u);
+    ASSERT_EQ(snapshot.getPercentile(90), 103u);
+    ASSERT_EQ(snapshot.getPercentile(91), 100000u);
+}
+
+TEST(LatencyHistogramTest, concurrent) {
+    LatencyHistogram histogram;
+    boost::thread_group writers;
+
+    for (int t = 0; t < 4; ++t) {
+        writers.create_thread([&histogram, t]() {
+            for (int i = 0; i < 100000; ++i) {
+                histogram.record(t * 1000 + i % 1000);
+            }
+        });
+    }
+
+    writers.join_all();
+    LatencySnapshot snapshot = histogram.getSnapshot();
+    ASSERT_EQ(snapshot.getCount(), 400000u);
+    ASSERT_EQ(snapshot.getMax(), 3999u);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
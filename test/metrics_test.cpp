@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <boost/thread/thread.hpp>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "smpp/inboundqueue.h"
+#include "smpp/metrics.h"
+#include "smpp/pdu.h"
+#include "smpp/smpp.h"
+
+using smpp::Metrics;
+using smpp::MetricsSnapshot;
+using std::string;
+
+TEST(MetricsTest, commandIndex) {
+    for (int i = 0; i < Metrics::COMMANDS; ++i) {
+        ASSERT_EQ(Metrics::commandIndex(Metrics::commandOf(i)), i);
+    }
+
+    ASSERT_EQ(Metrics::commandOf(Metrics::commandIndex(smpp::DATA_SM_RESP)), smpp::DATA_SM_RESP);
+    ASSERT_EQ(Metrics::commandOf(Metrics::commandIndex(smpp::GENERIC_NACK)), smpp::GENERIC_NACK);
+    ASSERT_EQ(Metrics::commandIndex(0x00010200), -1);
+    ASSERT_EQ(smpp::getCommandName(smpp::SUBMIT_SM_RESP), string("submit_sm_resp"));
+    ASSERT_EQ(smpp::getCommandName(smpp::GENERIC_NACK), string("generic_nack"));
+    ASSERT_EQ(smpp::getCommandName(0x80000099), string("0x80000099"));
+}
+
+TEST(MetricsTest, counters) {
+    Metrics metrics;
+    metrics.pduSent(smpp::SUBMIT_SM, 60);
+    metrics.pduSent(smpp::SUBMIT_SM, 70);
+    metrics.pduReceived(smpp::SUBMIT_SM_RESP, smpp::ESME_ROK, 26);
+    metrics.pduReceived(smpp::SUBMIT_SM_RESP, smpp::ESME_RTHROTTLED, 17);
+    metrics.pduReceived(smpp::DELIVER_SM, 0, 100);
+    metrics.pduReceived(smpp::GENERIC_NACK, 0x400, 16);
+    metrics.timeout();
+    metrics.reconnect();
+    metrics.addWindowOccupancy(3);
+    metrics.addWindowOccupancy(-1);
+
+    MetricsSnapshot snapshot = metrics.getSnapshot();
+    ASSERT_EQ(snapshot.pdusSent.size(), 1u);
+    ASSERT_EQ(snapshot.pdusSent[smpp::SUBMIT_SM], 2u);
+    ASSERT_EQ(snapshot.bytesSent[smpp::SUBMIT_SM], 130u);
+    ASSERT_EQ(snapshot.pdusReceived[smpp::SUBMIT_SM_RESP], 2u);
+    ASSERT_EQ(snapshot.bytesReceived[smpp::SUBMIT_SM_RESP], 43u);
+    ASSERT_EQ(snapshot.pdusReceived[smpp::DELIVER_SM], 1u);
+    ASSERT_EQ(snapshot.responses.size(), 3u);
+    ASSERT_EQ(snapshot.responses[smpp::ESME_ROK], 1u);
+    ASSERT_EQ(snapshot.responses[smpp::ESME_RTHROTTLED], 1u);
+    // vendor specific statuses share a counter
+    ASSERT_EQ(snapshot.responses[MetricsSnapshot::OTHER_STATUSES], 1u);
+    ASSERT_EQ(snapshot.timeouts, 1u);
+    ASSERT_EQ(snapshot.reconnects, 1u);
+    ASSERT_EQ(snapshot.windowOccupancy, 2);
+
+    snapshot.merge(metrics.getSnapshot());
+    ASSERT_EQ(snapshot.pdusSent[smpp::SUBMIT_SM], 4u);
+    ASSERT_EQ(snapshot.windowOccupancy, 4);
+}
+
+TEST(MetricsTest, threads) {
+    Metrics metrics;
+    boost::thread_group senders;
+
+    for (int t = 0; t < 8; ++t) {
+        senders.create_thread([&metrics]() {
+            for (int i = 0; i < 100000; ++i) {
+                metrics.pduSent(smpp::SUBMIT_SM, 50);
+            }
+        });
+    }
+
+    senders.join_all();
+    MetricsSnapshot snapshot = metrics.getSnapshot();
+    ASSERT_EQ(snapshot.pdusSent[smpp::SUBMIT_SM], 800000u);
+    ASSERT_EQ(snapshot.bytesSent[smpp::SUBMIT_SM], 40000000u);
+}
+
+TEST(MetricsTest, inboundQueueDepth) {
+    Metrics metrics;
+    smpp::InboundQueue queue(10);
+    queue.push(smpp::PDU(smpp::ENQUIRE_LINK, 0, 1));
+    queue.setMetrics(&metrics);
+    ASSERT_EQ(metrics.getSnapshot().inboundQueueDepth, 1);
+    queue.push(smpp::PDU(smpp::DELIVER_SM, 0, 2));
+    queue.push(smpp::PDU(smpp::SUBMIT_SM_RESP, 0, 3));
+    ASSERT_EQ(metrics.getSnapshot().inboundQueueDepth, 3);
+    queue.pop(smpp::InboundQueue::MESSAGES);
+    ASSERT_EQ(metrics.getSnapshot().inboundQueueDepth, 2);
+    queue.setMetrics(0);
+    ASSERT_EQ(metrics.getSnapshot().inboundQueueDepth, 0);
+}
+
+TEST(MetricsTest, prometheus) {
+    Metrics metrics;
+    metrics.pduSent(smpp::SUBMIT_SM, 60);
+    metrics.pduReceived(smpp::SUBMIT_SM_RESP, smpp::ESME_RTHROTTLED, 17);
+    string text = smpp::formatPrometheus(metrics.getSnapshot(), "session=\"smsc1\"");
+    ASSERT_NE(text.find("# TYPE smpp_pdus_sent_total counter\n"), string::npos);
+    ASSERT_NE(text.find("smpp_pdus_sent_total{session=\"smsc1\",command=\"submit_sm\"} 1\n"), string::npos);
+    ASSERT_NE(text.find("smpp_bytes_sent_total{session=\"smsc1\",command=\"submit_sm\"} 60\n"), string::npos);
+    ASSERT_NE(text.find("smpp_responses_total{session=\"smsc1\",status=\"0x00000058\"} 1\n"), string::npos);
+    ASSERT_EQ(text.find("status=\"other\""), string::npos);
+    ASSERT_NE(text.find("# TYPE smpp_window_occupancy gauge\n"), string::npos);
+    ASSERT_NE(text.find("smpp_window_occupancy{session=\"smsc1\"} 0\n"), string::npos);
+
+    // vendor specific statuses are not exported as status 0x100
+    metrics.pduReceived(smpp::SUBMIT_SM_RESP, 0x400, 17);
+    text = smpp::formatPrometheus(metrics.getSnapshot());
+    ASSERT_NE(text.find("smpp_pdus_received_total{command=\"submit_sm_resp\"} 2\n"), string::npos);
+    ASSERT_NE(text.find("smpp_responses_total{status=\"other\"} 1\n"), string::npos);
+    ASSERT_EQ(text.find("status=\"0x00000100\""), string::npos);
+    ASSERT_NE(text.find("smpp_timeouts_total 0\n"), string::npos);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
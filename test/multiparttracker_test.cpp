@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "smpp/multiparttracker.h"
+#include "smpp/receipt.h"
+#include "smpp/smpp.h"
+
+using std::string;
+
+namespace {
+smpp::receipt::Receipt receiptOf(const string &id, const uint8_t state, const uint16_t error = 0) {
+    smpp::receipt::Receipt receipt;
+    receipt.id = id;
+    receipt.state = state;
+    receipt.error = error;
+    return receipt;
+}
+}  // namespace
+
+TEST(MultipartTrackerTest, aggregate) {
+    smpp::MultipartTracker tracker(100);
+    std::vector<string> ids;
+    ids.push_back("seg1");
+    ids.push_back("seg2");
+    ids.push_back("seg3");
+    ASSERT_TRUE(tracker.track(ids));
+    std::vector<string> single(1, "single");
+    ASSERT_TRUE(tracker.track(single));
+    EXPECT_EQ(tracker.size(), size_t(2));
+
+    smpp::MultipartOutcome outcome;
+    EXPECT_FALSE(tracker.onReceipt(receiptOf("seg2", smpp::STATE_DELIVERED), &outcome));
+    EXPECT_FALSE(tracker.onReceipt(receiptOf("seg1", smpp::STATE_ENROUTE), &outcome));
+    EXPECT_FALSE(tracker.onReceipt(receiptOf("seg1", smpp::STATE_UNDELIVERABLE, 11), &outcome));
+    // repeated receipts are ignored
+    EXPECT_FALSE(tracker.onReceipt(receiptOf("seg1", smpp::STATE_DELIVERED), &outcome));
+    ASSERT_TRUE(tracker.onReceipt(receiptOf("seg3", smpp::STATE_DELIVERED), &outcome));
+    EXPECT_EQ(outcome.messageId, string("seg3"));
+    EXPECT_EQ(outcome.segments, 3);
+    EXPECT_EQ(outcome.delivered, 2);
+    EXPECT_EQ(outcome.failed, 1);
+    EXPECT_EQ(outcome.error, 11);
+    EXPECT_EQ(outcome.status, smpp::MultipartOutcome::PARTIAL);
+    EXPECT_FALSE(outcome.expired);
+
+    ASSERT_TRUE(tracker.onReceipt(receiptOf("single", smpp::STATE_DELIVERED), &outcome));
+    EXPECT_EQ(outcome.status, smpp::MultipartOutcome::DELIVERED);
+    EXPECT_EQ(tracker.size(), size_t(0));
+    EXPECT_FALSE(tracker.onReceipt(receiptOf("unknown", smpp::STATE_DELIVERED), &outcome));
+}
+
+TEST(MultipartTrackerTest, expire) {
+    smpp::MultipartTracker tracker(100, 3600);
+    time_t now = 1400000000;
+    std::vector<string> ids;
+    ids.push_back("a");
+    ids.push_back("b");
+    ASSERT_TRUE(tracker.track(ids, now));
+    ids[0] = "c";
+    ids[1] = "d";
+    ASSERT_TRUE(tracker.track(ids, now + 10));
+
+    smpp::MultipartOutcome outcome;
+    EXPECT_FALSE(tracker.onReceipt(receiptOf("a", smpp::STATE_EXPIRED), &outcome));
+    EXPECT_TRUE(tracker.expire(now + 3599).empty());
+    std::vector<smpp::MultipartOutcome> outcomes = tracker.expire(now + 3600);
+    ASSERT_EQ(outcomes.size(), size_t(1));
+    EXPECT_EQ(outcomes[0].messageId, string("b"));
+    EXPECT_EQ(outcomes[0].failed, 1);
+    EXPECT_EQ(outcomes[0].status, smpp::MultipartOutcome::FAILED);
+    EXPECT_TRUE(outcomes[0].expired);
+    EXPECT_EQ(tracker.size(), size_t(1));
+
+    std::vector<string> tooMany(256, "x");
+    EXPECT_FALSE(tracker.track(tooMany, now));
+}
+
+TEST(MultipartTrackerTest, reusedIds) {
+    smpp::MultipartTracker tracker(100);
+    std::vector<string> ids;
+    ids.push_back("a");
+    ids.push_back("b");
+    ASSERT_TRUE(tracker.track(ids));
+
+    // an id tracked by another message, or repeated, is rejected without tracking any of the segments
+    std::vector<string> reused;
+    reused.push_back("c");
+    reused.push_back("b");
+    EXPECT_FALSE(tracker.track(reused));
+    std::vector<string> repeated(2, "d");
+    EXPECT_FALSE(tracker.track(repeated));
+    EXPECT_EQ(tracker.size(), size_t(1));
+
+    smpp::MultipartOutcome outcome;
+    EXPECT_FALSE(tracker.onReceipt(receiptOf("c", smpp::STATE_DELIVERED), &outcome));
+    EXPECT_FALSE(tracker.onReceipt(receiptOf("a", smpp::STATE_DELIVERED), &outcome));
+    ASSERT_TRUE(tracker.onReceipt(receiptOf("b", smpp::STATE_DELIVERED), &outcome));
+    EXPECT_EQ(outcome.messageId, string("b"));
+    EXPECT_EQ(outcome.status, smpp::MultipartOutcome::DELIVERED);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "smpp/exceptions.h"
+#include "smpp/pcapwriter.h"
+#include "smpp/pdu.h"
+#include "smpp/smpp.h"
+
+using boost::asio::ip::address;
+using boost::asio::ip::tcp;
+using std::string;
+using std::vector;
+
+namespace {
+vector<uint8_t> readFile(const string &path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    return vector<uint8_t>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+uint32_t get16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+uint32_t get32(const uint8_t* p) {
+    return (get16(p) << 16) | get16(p + 2);
+}
+
+uint32_t hostUint32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+// Ones' complement sum, which is 0xFFFF over data including a valid checksum
+uint32_t fold(const uint8_t* data, const size_t length, uint32_t sum) {
+    for (size_t i = 0; i < length; i += 2) {
+        sum += (data[i] << 8) | (i + 1 < length ? data[i + 1] : 0);
+    }
+
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return sum;
+}
+
+void recordPdu(smpp::PcapWriter* writer, const bool sent, smpp::PDU pdu) {
+    writer->record(sent, pdu.getOctets().get(), pdu.getSize());
+}
+}  // namespace
+
+TEST(PcapWriterTest, ipv4) {
+    string path = "/tmp/pcapwriter_test." + boost::lexical_cast<string>(getpid());
+    tcp::endpoint local(address::from_string("10.0.0.1"), 40000);
+    tcp::endpoint remote(address::from_string("10.0.0.2"), 2775);
+    {
+        smpp::PcapWriter writer(path, local, remote);
+        smpp::PDU submit(smpp::SUBMIT_SM, 0, 1);
+        submit << "abc";
+        recordPdu(&writer, true, submit);
+        smpp::PDU resp(smpp::SUBMIT_SM_RESP, 0, 1);
+        resp << "id";
+        boost::shared_array<uint8_t> octets = resp.getOctets();
+        writer.record(false, octets.get(), 4, octets.get() + 4, resp.getSize() - 4);
+        ASSERT_EQ(writer.getDropped(), 0u);
+    }
+
+    vector<uint8_t> file = readFile(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(file.size(), 24u + (16 + 40 + 20) + (16 + 40 + 19));
+    ASSERT_EQ(hostUint32(&file[0]), 0xA1B2C3D4);
+    ASSERT_EQ(hostUint32(&file[20]), 101u);
+
+    // the submit_sm
+    const uint8_t* record = &file[24];
+    ASSERT_EQ(hostUint32(record + 8), 60u);
+    ASSERT_EQ(hostUint32(record + 12), 60u);
+    const uint8_t* ip = record + 16;
+    ASSERT_EQ(ip[0], 0x45);
+    ASSERT_EQ(get16(ip + 2), 60u);
+    ASSERT_EQ(ip[9], 6);
+    ASSERT_EQ(get32(ip + 12), 0x0A000001u);
+    ASSERT_EQ(get32(ip + 16), 0x0A000002u);
+    ASSERT_EQ(fold(ip, 20, 0), 0xFFFFu);
+    const uint8_t* tcp = ip + 20;
+    ASSERT_EQ(get16(tcp), 40000u);
+    ASSERT_EQ(get16(tcp + 2), 2775u);
+    ASSERT_EQ(get32(tcp + 4), 1u);
+    ASSERT_EQ(get32(tcp + 8), 1u);
+    ASSERT_EQ(fold(tcp, 40, fold(ip + 12, 8, 6 + 40)), 0xFFFFu);
+    ASSERT_EQ(get32(tcp + 20 + 4), smpp::SUBMIT_SM);
+
+    // the response, which acknowledges the submit_sm
+    record = &file[24 + 16 + 60];
+    ASSERT_GE(hostUint32(record) * 1000000ULL + hostUint32(record + 4),
+              hostUint32(&file[24]) * 1000000ULL + hostUint32(&file[28]));
+    ip = record + 16;
+    tcp = ip + 20;
+    ASSERT_EQ(get32(ip + 12), 0x0A000002u);
+    ASSERT_EQ(get16(tcp), 2775u);
+    ASSERT_EQ(get32(tcp + 4), 1u);
+    ASSERT_EQ(get32(tcp + 8), 21u);
+    ASSERT_EQ(fold(tcp, 39, fold(ip + 12, 8, 6 + 39)), 0xFFFFu);
+    ASSERT_EQ(get32(tcp + 20 + 4), smpp::SUBMIT_SM_RESP);
+}
+
+TEST(PcapWriterTest, ipv6) {
+    string path = "/tmp/pcapwriter_test6." + boost::lexical_cast<string>(getpid());
+    {
+        smpp::PcapWriter writer(path, tcp::endpoint(address::from_string("::1"), 40000),
+                                tcp::endpoint(address::from_string("::1"), 2775));
+        recordPdu(&writer, true, smpp::PDU(smpp::ENQUIRE_LINK, 0, 1));
+    }
+
+    vector<uint8_t> file = readFile(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(file.size(), 24u + 16 + 40 + 20 + 16);
+    const uint8_t* ip = &file[24 + 16];
+    ASSERT_EQ(ip[0], 0x60);
+    ASSERT_EQ(get16(ip + 4), 36u);
+    ASSERT_EQ(ip[6], 6);
+    ASSERT_EQ(ip[23], 1);
+    ASSERT_EQ(fold(ip + 40, 36, fold(ip + 8, 32, 6 + 36)), 0xFFFFu);
+}
+
+TEST(PcapWriterTest, errors) {
+    tcp::endpoint local(address::from_string("10.0.0.1"), 40000);
+    EXPECT_THROW(smpp::PcapWriter writer("/nonexistent/capture.pcap", local, local), smpp::SmppException);
+    EXPECT_THROW(smpp::PcapWriter writer("/tmp/capture.pcap", local, tcp::endpoint(address::from_string("::1"), 1)),
+                 smpp::SmppException);
+}
+
+TEST(PcapWriterTest, drop) {
+    string path = "/tmp/pcapwriter_test_drop." + boost::lexical_cast<string>(getpid());
+    tcp::endpoint local(address::from_string("10.0.0.1"), 40000);
+    {
+        smpp::PcapWriter writer(path, local, tcp::endpoint(address::from_string("10.0.0.2"), 2775), 4096);
+        vector<uint8_t> big(8000);
+        writer.record(true, &big[0], big.size());
+        ASSERT_EQ(writer.getDropped(), 1u);
+    }
+
+    std::remove(path.c_str());
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/gregorian/gregorian.hpp>
+
+#include <cstring>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "smpp/receipt.h"
+#include "smpp/sms.h"
+#include "smpp/tlv.h"
+
+using std::string;
+using smpp::receipt::ReceiptText;
+using smpp::receipt::scanText;
+using smpp::receipt::parseDecimal;
+using boost::gregorian::date;
+using boost::posix_time::ptime;
+using boost::posix_time::time_duration;
+
+static bool scan(const char* s, ReceiptText* fields) {
+    return scanText(s, strlen(s), fields);
+}
+
+TEST(ReceiptTest, standard) {
+    ReceiptText f;
+    ASSERT_TRUE(scan("id:dc0dc8ec67e1 sub:001 dlvrd:001 submit date:1110261646 done date:1110261647 stat:DELIVRD "
+                     "err:000 text:Hello World", &f));
+    EXPECT_EQ(f.id.str(), string("dc0dc8ec67e1"));
+    EXPECT_EQ(parseDecimal(f.sub), uint32_t(1));
+    EXPECT_EQ(parseDecimal(f.dlvrd), uint32_t(1));
+    EXPECT_EQ(f.submitDate.str(), string("1110261646"));
+    EXPECT_EQ(f.doneDate.str(), string("1110261647"));
+    EXPECT_EQ(f.stat.str(), string("DELIVRD"));
+    EXPECT_EQ(f.err.str(), string("000"));
+    EXPECT_EQ(f.text.str(), string("Hello World"));
+}
+
+TEST(ReceiptTest, variants) {
+    ReceiptText f;
+    // capitalised keys, underscores, extra whitespace and 12 digit dates
+    ASSERT_TRUE(scan("Id:42  Sub:1\tDlvrd:0 Submit_date:110203133755  Done_Date:110203133801 Stat:UNDELIV Err:0x0B "
+                     "Text:", &f));
+    EXPECT_EQ(f.id.str(), string("42"));
+    EXPECT_EQ(f.submitDate.str(), string("110203133755"));
+    EXPECT_EQ(f.doneDate.str(), string("110203133801"));
+    EXPECT_EQ(f.stat.str(), string("UNDELIV"));
+    EXPECT_EQ(f.err.str(), string("0x0B"));
+    EXPECT_TRUE(f.text.empty());
+
+    // missing fields, unknown fields and no text
+    ASSERT_TRUE(scan("id:ABC123 foo:bar submitdate:1102031337 stat:EXPIRED", &f));
+    EXPECT_EQ(f.id.str(), string("ABC123"));
+    EXPECT_TRUE(f.sub.empty());
+    EXPECT_TRUE(f.doneDate.empty());
+    EXPECT_EQ(f.submitDate.str(), string("1102031337"));
+    EXPECT_EQ(f.stat.str(), string("EXPIRED"));
+
+    // text keeps its spaces and keys
+    ASSERT_TRUE(scan("id:1 stat:DELIVRD text:id:2 stat:x ", &f));
+    EXPECT_EQ(f.id.str(), string("1"));
+    EXPECT_EQ(f.text.str(), string("id:2 stat:x "));
+}
+
+TEST(ReceiptTest, invalid) {
+    ReceiptText f;
+    EXPECT_FALSE(scan("", &f));
+    EXPECT_FALSE(scan("Hello World", &f));
+    EXPECT_FALSE(scan("id:1234 sub:001 dlvrd:001", &f));
+    EXPECT_FALSE(scan("identity:1234 status:DELIVRD", &f));
+    EXPECT_EQ(parseDecimal(smpp::receipt::TextRange()), uint32_t(0));
+}
+
+TEST(ReceiptTest, deliveryReport) {
+    smpp::SMS sms;
+    sms.is_null = false;
+    sms.esm_class = smpp::ESM_DELIVER_SMSC_RECEIPT;
+    sms.short_message = "id:0123456789 sub:001 dlvrd:001 submit date:1102031337 done date:110203133755 stat:DELIVRD "
+                        "err:000 text:";
+    smpp::DeliveryReport dlr(sms);
+    EXPECT_EQ(dlr.id, string("0123456789"));
+    EXPECT_EQ(dlr.sub, uint32_t(1));
+    EXPECT_EQ(dlr.dlvrd, uint32_t(1));
+    EXPECT_EQ(dlr.submitDate, ptime(date(2011, boost::gregorian::Feb, 3), time_duration(13, 37, 0)));
+    EXPECT_EQ(dlr.doneDate, ptime(date(2011, boost::gregorian::Feb, 3), time_duration(13, 37, 55)));
+    EXPECT_EQ(dlr.stat, string("DELIVRD"));
+    EXPECT_EQ(dlr.err, string("000"));
+    EXPECT_EQ(dlr.text, string(""));
+
+    sms.short_message = "Hello World";
+    smpp::DeliveryReport notDlr(sms);
+    EXPECT_EQ(notDlr.id, string(""));
+    EXPECT_TRUE(notDlr.submitDate.is_not_a_date_time());
+}
+
+TEST(ReceiptTest, stat) {
+    EXPECT_EQ(smpp::receipt::parseStat(smpp::receipt::TextRange("DELIVRD", 7)), smpp::STATE_DELIVERED);
+    EXPECT_EQ(smpp::receipt::parseStat(smpp::receipt::TextRange("undeliv", 7)), smpp::STATE_UNDELIVERABLE);
+    EXPECT_EQ(smpp::receipt::parseStat(smpp::receipt::TextRange("REJECTD", 7)), smpp::STATE_REJECTED);
+    EXPECT_EQ(smpp::receipt::parseStat(smpp::receipt::TextRange("DELIVERED", 9)), 0);
+    EXPECT_EQ(smpp::receipt::parseStat(smpp::receipt::TextRange()), 0);
+}
+
+TEST(ReceiptTest, decodeTlvs) {
+    smpp::SMS sms;
+    sms.is_null = false;
+    sms.esm_class = smpp::ESM_DELIVER_SMSC_RECEIPT;
+    sms.short_message = "id:1 sub:001 dlvrd:000 submit date:1102031337 done date:1102031338 stat:EXPIRED err:042 text:";
+    sms.tlvs.push_back(smpp::TLV(smpp::tags::RECEIPTED_MESSAGE_ID, string("a1b2c3") + '\0'));
+    sms.tlvs.push_back(smpp::TLV(smpp::tags::MESSAGE_STATE, smpp::STATE_UNDELIVERABLE));
+    boost::shared_array<uint8_t> networkError(new uint8_t[3]);
+    networkError[0] = 0x03;  // GSM
+    networkError[1] = 0x00;
+    networkError[2] = 0x0b;
+    sms.tlvs.push_back(smpp::TLV(smpp::tags::NETWORK_ERROR_CODE, 3, networkError));
+
+    smpp::receipt::Receipt receipt;
+    ASSERT_TRUE(smpp::receipt::decode(sms, &receipt));
+    EXPECT_EQ(receipt.id, string("a1b2c3"));
+    EXPECT_EQ(receipt.state, smpp::STATE_UNDELIVERABLE);
+    EXPECT_EQ(receipt.networkType, 0x03);
+    EXPECT_EQ(receipt.error, 0x0b);
+
+    // without NETWORK_ERROR_CODE a failure takes its error from the text
+    sms.tlvs.pop_back();
+    ASSERT_TRUE(smpp::receipt::decode(sms, &receipt));
+    EXPECT_EQ(receipt.id, string("a1b2c3"));
+    EXPECT_EQ(receipt.state, smpp::STATE_UNDELIVERABLE);
+    EXPECT_EQ(receipt.networkType, 0);
+    EXPECT_EQ(receipt.error, 42);
+}
+
+TEST(ReceiptTest, decodeText) {
+    smpp::SMS sms;
+    sms.is_null = false;
+    sms.esm_class = smpp::ESM_DELIVER_SMSC_RECEIPT;
+    sms.short_message = "id:1 sub:001 dlvrd:000 submit date:1102031337 done date:1102031338 stat:REJECTD err:007 text:";
+
+    smpp::receipt::Receipt receipt;
+    ASSERT_TRUE(smpp::receipt::decode(sms, &receipt));
+    EXPECT_EQ(receipt.id, string("1"));
+    EXPECT_EQ(receipt.state, smpp::STATE_REJECTED);
+    EXPECT_EQ(receipt.error, 7);
+
+    sms.short_message = "Hello World";
+    EXPECT_FALSE(smpp::receipt::decode(sms, &receipt));
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
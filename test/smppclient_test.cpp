@@ -4,10 +4,15 @@
  */
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
 #include <list>
+#include <stdexcept>
 #include <string>
+#include <vector>
 #include "gtest/gtest.h"
 #include "smpp/gsmencoding.h"
+#include "smpp/tagregistry.h"
 #include "smpp/timeformat.h"
 #include "smppclient_test.h"
 
@@ -60,7 +65,37 @@ TEST_F(SmppClientTest, querySm) {
     auto smscResult = client->sendSms(from, to, GsmEncoder::getGsm0338(message));
     string smscId = smscResult.first;
     smpp::QuerySmResult result = client->querySm(smscId, from);
-    ASSERT_EQ(result.get<0>(), smscId);
+    ASSERT_EQ(result.messageId, smscId);
+    ASSERT_EQ(client->getLatency(smpp::QUERY_SM).getCount(), 1u);
+    ASSERT_GT(client->getLatency(smpp::SUBMIT_SM).getPercentile(50), 0u);
+    client->unbind();
+    socket->close();
+}
+
+// Test pipelined QUERY_SM of several messages
+TEST_F(SmppClientTest, querySmBatch) {
+    socket->connect(endpoint);
+    client->bindTransmitter(SMPP_USERNAME, SMPP_PASSWORD);
+    SmppAddress from("CPPSMPP", smpp::TON_ALPHANUMERIC, smpp::NPI_UNKNOWN);
+    SmppAddress to("4513371337", smpp::TON_INTERNATIONAL, smpp::NPI_E164);
+    std::vector<std::pair<string, SmppAddress> > queries;
+
+    for (int i = 0; i < 5; i++) {
+        auto smscResult = client->sendSms(from, to, GsmEncoder::getGsm0338("message to send"));
+        queries.push_back(std::make_pair(smscResult.first, from));
+    }
+
+    queries.push_back(std::make_pair(string("unknown"), from));
+    std::vector<smpp::QuerySmResult> results = client->querySmBatch(queries, 2, 100);
+    ASSERT_EQ(results.size(), queries.size());
+
+    for (size_t i = 0; i < 5; i++) {
+        ASSERT_EQ(results[i].messageId, queries[i].first);
+        ASSERT_EQ(results[i].commandStatus, smpp::ESME_ROK);
+    }
+
+    ASSERT_EQ(results[5].messageId, string("unknown"));
+    ASSERT_NE(results[5].commandStatus, smpp::ESME_ROK);
     client->unbind();
     socket->close();
 }
@@ -176,6 +211,46 @@ TEST_F(SmppClientTest, receive) {
     smpp::SMS sms = client->readSms();
 }
 
+TEST_F(SmppClientTest, receiveBatch) {
+    socket->connect(endpoint);
+    client->bindReceiver(SMPP_USERNAME, SMPP_PASSWORD);
+    std::vector<smpp::SMS> batch = client->readSmsBatch(100, 1000);
+    EXPECT_LE(batch.size(), 100u);
+}
+
+TEST_F(SmppClientTest, receiveDeferredAck) {
+    socket->connect(endpoint);
+    client->setDeferredAck(true);
+    client->setMaxUnacked(10);
+    client->bindReceiver(SMPP_USERNAME, SMPP_PASSWORD);
+    EXPECT_THROW(client->readSms(), smpp::SmppException);
+
+    std::vector<uint32_t> handles;
+    std::vector<smpp::SMS> batch = client->readSmsBatch(100, 1000, &handles);
+    EXPECT_LE(batch.size(), 10u);
+    EXPECT_EQ(batch.size(), handles.size());
+    EXPECT_EQ(handles.size(), client->getUnackedCount());
+    client->ack(handles);
+    EXPECT_EQ(0u, client->getUnackedCount());
+    client->flushAcks();
+}
+
+namespace {
+uint32_t countPdu(size_t* count, smpp::PDU &pdu) {
+    ++*count;
+    return smpp::ESME_ROK;
+}
+}  // namespace
+
+TEST_F(SmppClientTest, handlers) {
+    EXPECT_THROW(client->setPduHandler(smpp::SUBMIT_SM, smpp::PduHandler()), smpp::SmppException);
+    size_t count = 0;
+    client->setPduHandler(smpp::DELIVER_SM, boost::bind(&countPdu, &count, _1));
+    socket->connect(endpoint);
+    client->bindReceiver(SMPP_USERNAME, SMPP_PASSWORD);
+    EXPECT_EQ(count, client->dispatchPdus(1000));
+}
+
 TEST_F(SmppClientTest, logging) {
     client->setVerbose(true);
     socket->connect(endpoint);
@@ -184,6 +259,343 @@ TEST_F(SmppClientTest, logging) {
     socket->close();
 }
 
+namespace {
+/**
+ * SMSC on the loopback interface, which answers a bind, then sends the PDUs of its script and records the PDUs the
+ * client sends until the client closes the connection. A submit_sm is answered after sending the PDUs of
+ * submitScript.
+ */
+class FakeSmsc {
+  public:
+    std::vector<smpp::PDU> script;
+    std::vector<smpp::PDU> submitScript;
+    std::vector<smpp::PDU> received;
+    // Sends a PDU of the script again when the client answers it with ESME_RX_T_APPN, like an SMSC retrying it
+    bool retry;
+
+  private:
+    boost::asio::io_service ios;
+    boost::asio::ip::tcp::acceptor acceptor;
+    boost::thread thread;
+
+  public:
+    FakeSmsc() :
+        script(), submitScript(), received(), retry(false), ios(), acceptor(ios, boost::asio::ip::tcp::endpoint(
+                boost::asio::ip::address_v4::loopback(), 0)), thread() {
+    }
+
+    boost::asio::ip::tcp::endpoint endpoint() const {
+        return acceptor.local_endpoint();
+    }
+
+    void start() {
+        thread = boost::thread(&FakeSmsc::run, this);
+    }
+
+    void join() {
+        thread.join();
+    }
+
+    /**
+     * @return The responses the client sent to the PDU with a sequence number, in order.
+     */
+    std::vector<uint32_t> statusesOf(const uint32_t sequence) const {
+        std::vector<uint32_t> statuses;
+
+        for (std::vector<smpp::PDU>::const_iterator it = received.begin(); it != received.end(); ++it) {
+            if (it->getSequenceNo() == sequence && (it->getCommandId() & smpp::GENERIC_NACK)) {
+                statuses.push_back(it->getCommandStatus());
+            }
+        }
+
+        return statuses;
+    }
+
+  private:
+    void run() {
+        boost::asio::ip::tcp::socket socket(ios);
+        acceptor.accept(socket);
+        boost::system::error_code error;
+
+        for (;;) {
+            boost::shared_array<uint8_t> length(new uint8_t[4]);
+            boost::asio::read(socket, boost::asio::buffer(length.get(), 4), error);
+
+            if (error) {
+                break;
+            }
+
+            uint32_t size = smpp::PDU::getPduLength(length);
+            boost::shared_array<uint8_t> body(new uint8_t[size - 4]);
+            boost::asio::read(socket, boost::asio::buffer(body.get(), size - 4), error);
+
+            if (error) {
+                break;
+            }
+
+            smpp::PDU pdu(length, body);
+            received.push_back(pdu);
+
+            if (pdu.getCommandId() == smpp::BIND_RECEIVER || pdu.getCommandId() == smpp::BIND_TRANSMITTER
+                    || pdu.getCommandId() == smpp::BIND_TRANSCEIVER) {
+                smpp::PDU resp(pdu.getCommandId() | smpp::GENERIC_NACK, smpp::ESME_ROK, pdu.getSequenceNo());
+                resp << string("fake");
+                write(&socket, &resp);
+
+                for (std::vector<smpp::PDU>::iterator it = script.begin(); it != script.end(); ++it) {
+                    write(&socket, &*it);
+                }
+            }
+
+            if (retry && pdu.getCommandId() == smpp::DELIVER_SM_RESP && pdu.getCommandStatus() == smpp::ESME_RX_T_APPN) {
+                for (std::vector<smpp::PDU>::iterator it = script.begin(); it != script.end(); ++it) {
+                    if (it->getSequenceNo() == pdu.getSequenceNo()) {
+                        write(&socket, &*it);
+                    }
+                }
+            }
+
+            if (pdu.getCommandId() == smpp::SUBMIT_SM) {
+                for (std::vector<smpp::PDU>::iterator it = submitScript.begin(); it != submitScript.end(); ++it) {
+                    write(&socket, &*it);
+                }
+
+                smpp::PDU resp(smpp::SUBMIT_SM_RESP, smpp::ESME_ROK, pdu.getSequenceNo());
+                resp << string("msg") + boost::lexical_cast<string>(pdu.getSequenceNo());
+                write(&socket, &resp);
+            }
+        }
+    }
+
+    static void write(boost::asio::ip::tcp::socket* socket, smpp::PDU* pdu) {
+        boost::shared_array<uint8_t> octets = pdu->getOctets();
+        boost::asio::write(*socket, boost::asio::buffer(octets.get(), pdu->getSize()));
+    }
+};
+
+smpp::PDU deliverSm(const uint32_t sequence, const string &message) {
+    smpp::PDU pdu(smpp::DELIVER_SM, 0, sequence);
+    pdu << string("") << smpp::SmppAddress("4512345678", smpp::TON_INTERNATIONAL, smpp::NPI_E164)
+        << smpp::SmppAddress("1234", smpp::TON_NATIONAL, smpp::NPI_E164);
+    pdu << uint8_t(0) << uint8_t(0) << uint8_t(0) << string("") << string("") << uint8_t(0) << uint8_t(0)
+        << uint8_t(0) << uint8_t(0);
+    pdu << static_cast<uint8_t>(message.length());
+    pdu.setNullTerminateOctetStrings(false);
+    pdu << message;
+    pdu.setNullTerminateOctetStrings(true);
+    return pdu;
+}
+
+/**
+ * A deliver_sm with a message_state TLV of four octets, which the tag registry does not allow.
+ */
+smpp::PDU malformedDeliverSm(const uint32_t sequence) {
+    smpp::PDU pdu = deliverSm(sequence, "malformed");
+    pdu << TLV(smpp::tags::MESSAGE_STATE, static_cast<uint32_t>(smpp::STATE_DELIVERED));
+    return pdu;
+}
+
+class SmppClientLoopbackTest: public testing::Test {
+  public:
+    FakeSmsc smsc;
+    boost::asio::io_service ios;
+    std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+    std::shared_ptr<SmppClient> client;
+
+    SmppClientLoopbackTest() :
+        smsc(), ios(), socket(new boost::asio::ip::tcp::socket(ios)), client(new SmppClient(socket)) {
+        client->setSocketReadTimeout(500);
+    }
+
+    void bind() {
+        smsc.start();
+        socket->connect(smsc.endpoint());
+        client->bindReceiver(SMPP_USERNAME, SMPP_PASSWORD);
+    }
+
+    /**
+     * Closes the connection and waits for the SMSC to record what the client sent.
+     */
+    void close() {
+        socket->close();
+        smsc.join();
+    }
+};
+}  // namespace
+
+TEST_F(SmppClientLoopbackTest, rejectMalformedTlv) {
+    smsc.script.push_back(malformedDeliverSm(1));
+    smsc.script.push_back(deliverSm(2, "valid"));
+    bind();
+    smpp::SMS sms = client->readSms();
+    ASSERT_FALSE(sms.is_null);
+    EXPECT_EQ(sms.short_message, string("valid"));
+    close();
+    EXPECT_EQ(smsc.statusesOf(1), std::vector<uint32_t>(1, smpp::ESME_RINVOPTPARSTREAM));
+    EXPECT_EQ(smsc.statusesOf(2), std::vector<uint32_t>(1, smpp::ESME_ROK));
+}
+
+TEST_F(SmppClientLoopbackTest, rejectMalformedTlvHandler) {
+    smsc.script.push_back(malformedDeliverSm(1));
+    smsc.script.push_back(deliverSm(2, "valid"));
+    std::vector<string> messages;
+    client->setPduHandler(smpp::DELIVER_SM, [&messages](smpp::PDU &pdu) -> uint32_t {
+        messages.push_back(smpp::SMS(pdu).short_message);
+        return smpp::ESME_ROK;
+    });
+    bind();
+    client->dispatchPdus(200);
+    close();
+    EXPECT_EQ(messages, std::vector<string>(1, "valid"));
+    EXPECT_EQ(smsc.statusesOf(1), std::vector<uint32_t>(1, smpp::ESME_RINVOPTPARSTREAM));
+    EXPECT_EQ(smsc.statusesOf(2), std::vector<uint32_t>(1, smpp::ESME_ROK));
+}
+
+TEST_F(SmppClientLoopbackTest, rejectMalformedTlvBatch) {
+    smsc.script.push_back(malformedDeliverSm(1));
+    smsc.script.push_back(deliverSm(2, "first"));
+    smsc.script.push_back(deliverSm(3, "second"));
+    client->setDeferredAck(true);
+    bind();
+    std::vector<smpp::SMS> batch;
+    std::vector<uint32_t> handles;
+
+    for (int i = 0; i < 10 && batch.size() < 2; ++i) {
+        std::vector<smpp::SMS> read = client->readSmsBatch(10, 100, &handles);
+        batch.insert(batch.end(), read.begin(), read.end());
+    }
+
+    ASSERT_EQ(batch.size(), size_t(2));
+    EXPECT_EQ(batch[0].short_message, string("first"));
+    EXPECT_EQ(batch[1].short_message, string("second"));
+    ASSERT_EQ(handles.size(), size_t(2));
+    EXPECT_EQ(client->getUnackedCount(), size_t(2));
+    client->ack(handles);
+    client->flushAcks();
+    close();
+    EXPECT_EQ(smsc.statusesOf(1), std::vector<uint32_t>(1, smpp::ESME_RINVOPTPARSTREAM));
+    EXPECT_EQ(smsc.statusesOf(2), std::vector<uint32_t>(1, smpp::ESME_ROK));
+    EXPECT_EQ(smsc.statusesOf(3), std::vector<uint32_t>(1, smpp::ESME_ROK));
+}
+
+TEST_F(SmppClientLoopbackTest, reusedSequenceNumber) {
+    // the SMSC may reuse the sequence number of a deliver_sm which is not yet acknowledged
+    smsc.script.push_back(deliverSm(7, "first"));
+    smsc.script.push_back(deliverSm(7, "second"));
+    client->setDeferredAck(true);
+    bind();
+    uint32_t first = 0;
+    uint32_t second = 0;
+    ASSERT_FALSE(client->readSms(&first).is_null);
+    ASSERT_FALSE(client->readSms(&second).is_null);
+    EXPECT_NE(first, second);
+    EXPECT_EQ(client->getUnackedCount(), size_t(2));
+
+    // nothing is acknowledged if one of the handles is invalid
+    std::vector<uint32_t> handles;
+    handles.push_back(first);
+    handles.push_back(first);
+    EXPECT_THROW(client->ack(handles), smpp::SmppException);
+    EXPECT_EQ(client->getUnackedCount(), size_t(2));
+
+    handles[1] = second;
+    client->ack(handles);
+    EXPECT_EQ(client->getUnackedCount(), size_t(0));
+    client->flushAcks();
+    close();
+    EXPECT_EQ(smsc.statusesOf(7), std::vector<uint32_t>(2, smpp::ESME_ROK));
+}
+
+TEST_F(SmppClientLoopbackTest, dispatchAckWindow) {
+    smsc.script.push_back(deliverSm(1, "first"));
+    smsc.script.push_back(deliverSm(2, "second"));
+    smsc.script.push_back(deliverSm(3, "third"));
+    client->setDeferredAck(true);
+    client->setMaxUnacked(1);
+    std::vector<uint32_t> handles;
+    SmppClient* c = client.get();
+    client->setPduHandler(smpp::DELIVER_SM, [&handles, c](smpp::PDU &pdu) -> uint32_t {
+        handles.push_back(c->getDispatchAckHandle());
+        return smpp::ESME_ROK;
+    });
+    bind();
+    EXPECT_EQ(client->dispatchPdus(200), size_t(1));
+    EXPECT_EQ(client->getUnackedCount(), size_t(1));
+    client->ack(handles.back());
+    EXPECT_EQ(client->dispatchPdus(200), size_t(1));
+    EXPECT_EQ(client->getUnackedCount(), size_t(1));
+    ASSERT_EQ(handles.size(), size_t(2));
+    client->ack(handles.back());
+    client->flushAcks();
+    close();
+    EXPECT_EQ(smsc.statusesOf(1), std::vector<uint32_t>(1, smpp::ESME_ROK));
+    EXPECT_EQ(smsc.statusesOf(2), std::vector<uint32_t>(1, smpp::ESME_ROK));
+    EXPECT_TRUE(smsc.statusesOf(3).empty());
+}
+
+TEST_F(SmppClientLoopbackTest, dispatchHandlerThrows) {
+    smsc.script.push_back(deliverSm(1, "first"));
+    client->setDeferredAck(true);
+    client->setPduHandler(smpp::DELIVER_SM, [](smpp::PDU &pdu) -> uint32_t {
+        throw std::logic_error("handler failed");
+    });
+    bind();
+    EXPECT_THROW(client->dispatchPdus(500), std::logic_error);
+    EXPECT_EQ(client->getUnackedCount(), size_t(0));
+    close();
+    EXPECT_EQ(smsc.statusesOf(1), std::vector<uint32_t>(1, smpp::ESME_RX_T_APPN));
+}
+
+TEST_F(SmppClientLoopbackTest, duplicateFilterRetry) {
+    // a deliver_sm answered with a temporary error is not remembered, so the retry of the SMSC is returned again
+    smsc.script.push_back(deliverSm(1, "first"));
+    smsc.retry = true;
+    smpp::DuplicateFilter filter(100);
+    client->setDuplicateFilter(&filter);
+    client->setDeferredAck(true);
+    bind();
+    uint32_t handle = 0;
+    smpp::SMS sms = client->readSms(&handle);
+    ASSERT_FALSE(sms.is_null);
+    EXPECT_EQ(sms.short_message, string("first"));
+    client->ack(handle, smpp::ESME_RX_T_APPN);
+    client->flushAcks();
+    EXPECT_EQ(filter.size(), size_t(0));
+
+    sms = client->readSms(&handle);
+    ASSERT_FALSE(sms.is_null);
+    EXPECT_EQ(sms.short_message, string("first"));
+    client->ack(handle);
+    client->flushAcks();
+    EXPECT_EQ(filter.size(), size_t(1));
+    EXPECT_EQ(filter.getDuplicates(), uint64_t(0));
+    close();
+    std::vector<uint32_t> statuses;
+    statuses.push_back(smpp::ESME_RX_T_APPN);
+    statuses.push_back(smpp::ESME_ROK);
+    EXPECT_EQ(smsc.statusesOf(1), statuses);
+}
+
+TEST_F(SmppClientLoopbackTest, handlerThrowsDuringSubmit) {
+    // the deliver_sm arrives while the client waits for the submit_sm_resp
+    smsc.submitScript.push_back(deliverSm(1, "first"));
+    client->setPduHandler(smpp::DELIVER_SM, [](smpp::PDU &pdu) -> uint32_t {
+        throw std::logic_error("handler failed");
+    });
+    smsc.start();
+    socket->connect(smsc.endpoint());
+    client->bindTransmitter(SMPP_USERNAME, SMPP_PASSWORD);
+    std::pair<string, int> result = client->sendSms(smpp::SmppAddress("1234", smpp::TON_NATIONAL, smpp::NPI_E164),
+            smpp::SmppAddress("4512345678", smpp::TON_INTERNATIONAL, smpp::NPI_E164), "hello");
+    EXPECT_EQ(result.first, string("msg2"));
+
+    // the error of the handler is raised by the next dispatchPdus
+    EXPECT_THROW(client->dispatchPdus(0), std::logic_error);
+    EXPECT_EQ(client->dispatchPdus(0), size_t(0));
+    close();
+    EXPECT_EQ(smsc.statusesOf(1), std::vector<uint32_t>(1, smpp::ESME_RX_T_APPN));
+}
+
 int main(int argc, char** argv) {
     google::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
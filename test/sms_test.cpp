@@ -8,15 +8,17 @@
 #include <boost/date_time/gregorian/gregorian.hpp>
 
 #include <algorithm>
-#include <list>
+#include <cstring>
 #include <string>
 
 #include "gtest/gtest.h"
+#include "smpp/receipt.h"
 #include "smpp/sms.h"
+#include "smpp/smsrecord.h"
+#include "smpp/smsview.h"
 #include "smpp/smpp.h"
 #include "smpp/tlv.h"
 
-using std::list;
 using std::string;
 
 /**
@@ -44,14 +46,14 @@ TEST(SmsTest, copy) {
 
     // Compare TLVs
     ASSERT_EQ(sms.tlvs.size(), sms2.tlvs.size());
-    list<smpp::TLV>::iterator it;
-    list<smpp::TLV>::iterator it2;
+    smpp::TlvList::const_iterator it;
+    smpp::TlvList::const_iterator it2;
     it = sms.tlvs.begin();
     it2 = sms2.tlvs.begin();
     while (it != sms.tlvs.end()) {
         ASSERT_EQ((*it).getTag(), (*it2).getTag());
         ASSERT_EQ((*it).getLen(), (*it2).getLen());
-        ASSERT_EQ((*it).getOctets(), (*it2).getOctets());
+        ASSERT_EQ(0, memcmp((*it).getData(), (*it2).getData(), (*it).getLen()));
         it++;
         it2++;
     }
@@ -99,13 +101,15 @@ TEST(SmsTest, dlr) {
 
     // Assertions for TLV fields
     EXPECT_EQ(static_cast<int>(sms.tlvs.size()), 2);
-    list<smpp::TLV>::iterator it;
+    smpp::TlvList::iterator it;
     it = sms.tlvs.begin();
     EXPECT_EQ(it->getTag(), smpp::tags::MESSAGE_STATE);
     EXPECT_EQ(it->getOctets()[0], smpp::STATE_DELIVERED);
     it++;
     EXPECT_EQ(it->getTag(), smpp::tags::RECEIPTED_MESSAGE_ID);
     EXPECT_EQ(string(reinterpret_cast<char*>(it->getOctets().get())), string("dc0dc8ec67e16082483f9e8cd1b135dd"));
+    EXPECT_EQ(sms.tlvs.get<uint8_t>(smpp::tags::MESSAGE_STATE), smpp::STATE_DELIVERED);
+    EXPECT_EQ(sms.tlvs.getString(smpp::tags::RECEIPTED_MESSAGE_ID), string("dc0dc8ec67e16082483f9e8cd1b135dd"));
 
     // Assertions for DLR part of SMS
     EXPECT_EQ(dlr.id, string("dc0dc8ec67e16082483f9e8cd1b135dd"));
@@ -117,6 +121,130 @@ TEST(SmsTest, dlr) {
     EXPECT_EQ(dlr.err, string("000"));
 }
 
+TEST(SmsTest, view) {
+    uint8_t testheader[] = { 0x00, 0x00, 0x00, 0xe4 };
+    uint8_t testdata[] = {
+            0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x01, 0x34, 0x35, 0x32,
+            0x36, 0x31, 0x35, 0x39, 0x39, 0x31, 0x37, 0x00, 0x05, 0x00, 0x64, 0x65, 0x66, 0x61, 0x75, 0x6c, 0x74, 0x00,
+            0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x88, 0x69, 0x64, 0x3a, 0x64, 0x63, 0x30, 0x64, 0x63,
+            0x38, 0x65, 0x63, 0x36, 0x37, 0x65, 0x31, 0x36, 0x30, 0x38, 0x32, 0x34, 0x38, 0x33, 0x66, 0x39, 0x65, 0x38,
+            0x63, 0x64, 0x31, 0x62, 0x31, 0x33, 0x35, 0x64, 0x64, 0x20, 0x73, 0x75, 0x62, 0x3a, 0x30, 0x30, 0x31, 0x20,
+            0x64, 0x6c, 0x76, 0x72, 0x64, 0x3a, 0x30, 0x30, 0x31, 0x20, 0x73, 0x75, 0x62, 0x6d, 0x69, 0x74, 0x20, 0x64,
+            0x61, 0x74, 0x65, 0x3a, 0x31, 0x31, 0x31, 0x30, 0x32, 0x36, 0x31, 0x36, 0x34, 0x36, 0x20, 0x64, 0x6f, 0x6e,
+            0x65, 0x20, 0x64, 0x61, 0x74, 0x65, 0x3a, 0x31, 0x31, 0x31, 0x30, 0x32, 0x36, 0x31, 0x36, 0x34, 0x37, 0x20,
+            0x73, 0x74, 0x61, 0x74, 0x3a, 0x44, 0x45, 0x4c, 0x49, 0x56, 0x52, 0x44, 0x20, 0x65, 0x72, 0x72, 0x3a, 0x30,
+            0x30, 0x30, 0x20, 0x74, 0x65, 0x78, 0x74, 0x3a, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x20, 0x57, 0x6f, 0x72, 0x6c,
+            0x64, 0x40, 0x04, 0x27, 0x00, 0x01, 0x02, 0x00, 0x1e, 0x00, 0x21, 0x64, 0x63, 0x30, 0x64, 0x63, 0x38, 0x65,
+            0x63, 0x36, 0x37, 0x65, 0x31, 0x36, 0x30, 0x38, 0x32, 0x34, 0x38, 0x33, 0x66, 0x39, 0x65, 0x38, 0x63, 0x64,
+            0x31, 0x62, 0x31, 0x33, 0x35, 0x64, 0x64, 0x00 };
+
+    boost::shared_array<uint8_t> head(new uint8_t[4]);
+    std::copy(testheader, testheader + 4, head.get());
+    boost::shared_array<uint8_t> data(new uint8_t[0xe0]);
+    std::copy(testdata, testdata + 0xe0, data.get());
+
+    smpp::PDU pdu(head, data);
+    smpp::SmsView view(pdu);
+    smpp::SMS sms(pdu);
+
+    // the view shares the received buffer
+    ASSERT_TRUE(!view.isNull());
+    EXPECT_EQ(pdu.getRawBuffer().get(), data.get());
+
+    EXPECT_EQ(view.getServiceType(), sms.service_type);
+    EXPECT_EQ(view.getSourceAddrTon(), sms.source_addr_ton);
+    EXPECT_EQ(view.getSourceAddrNpi(), sms.source_addr_npi);
+    EXPECT_EQ(view.getSourceAddr(), sms.source_addr);
+    EXPECT_EQ(view.getDestAddrTon(), sms.dest_addr_ton);
+    EXPECT_EQ(view.getDestAddrNpi(), sms.dest_addr_npi);
+    EXPECT_EQ(view.getDestAddr(), sms.dest_addr);
+    EXPECT_EQ(view.getEsmClass(), sms.esm_class);
+    EXPECT_EQ(view.getDataCoding(), sms.data_coding);
+    EXPECT_EQ(view.getSmLength(), sms.sm_length);
+    EXPECT_EQ(view.getShortMessage(), sms.short_message);
+
+    uint16_t len = 0;
+    const uint8_t* state = view.findTlv(smpp::tags::MESSAGE_STATE, &len);
+    ASSERT_TRUE(state != 0);
+    EXPECT_EQ(len, 1);
+    EXPECT_EQ(state[0], smpp::STATE_DELIVERED);
+    EXPECT_TRUE(view.findTlv(smpp::tags::NETWORK_ERROR_CODE, &len) == 0);
+
+    smpp::SMS copy = view.toSms();
+    EXPECT_EQ(copy.short_message, sms.short_message);
+    EXPECT_EQ(copy.tlvs.size(), sms.tlvs.size());
+
+    smpp::receipt::Receipt receipt;
+    ASSERT_TRUE(smpp::receipt::decode(view, &receipt));
+    EXPECT_EQ(receipt.id, string("dc0dc8ec67e16082483f9e8cd1b135dd"));
+    EXPECT_EQ(receipt.state, smpp::STATE_DELIVERED);
+    EXPECT_EQ(receipt.error, 0);
+
+    // a record holds the same message inline
+    smpp::SmsRecord record(view);
+    EXPECT_EQ(sizeof(record), size_t(512));
+    EXPECT_EQ(string(record.source_addr), sms.source_addr);
+    EXPECT_EQ(string(record.dest_addr), sms.dest_addr);
+    EXPECT_EQ(record.esm_class, sms.esm_class);
+    EXPECT_EQ(record.getShortMessage(), sms.short_message);
+    const uint8_t* id = record.findTlv(smpp::tags::RECEIPTED_MESSAGE_ID, &len);
+    ASSERT_TRUE(id != 0);
+    EXPECT_EQ(string(reinterpret_cast<const char*>(id)), string("dc0dc8ec67e16082483f9e8cd1b135dd"));
+    smpp::SmsRecord fromSms(sms);
+    EXPECT_EQ(fromSms.tlv_length, record.tlv_length);
+    EXPECT_EQ(memcmp(fromSms.tlv_area, record.tlv_area, record.tlv_length), 0);
+    EXPECT_EQ(fromSms.toSms().tlvs.size(), sms.tlvs.size());
+
+    sms.source_addr = "0123456789012345678901";
+    EXPECT_THROW(smpp::SmsRecord tooLong(sms), smpp::SmppException);
+
+    // a truncated PDU is rejected
+    uint8_t truncatedheader[] = { 0x00, 0x00, 0x00, 0x18 };
+    std::copy(truncatedheader, truncatedheader + 4, head.get());
+    smpp::PDU truncated(head, data);
+    EXPECT_THROW(smpp::SmsView truncatedView(truncated), smpp::SmppException);
+}
+
+TEST(SmsTest, tlv) {
+    // small values are stored inline
+    smpp::TLV state(smpp::tags::MESSAGE_STATE, smpp::STATE_DELIVERED);
+    smpp::TLV copy(state);
+    EXPECT_EQ(copy.getLen(), 1);
+    EXPECT_EQ(copy.getData()[0], smpp::STATE_DELIVERED);
+    EXPECT_NE(copy.getData(), state.getData());
+    EXPECT_EQ(copy.getOctets()[0], smpp::STATE_DELIVERED);
+
+    smpp::TLV ref(smpp::tags::SAR_MSG_REF_NUM, static_cast<uint16_t>(0x1234));
+    EXPECT_EQ(ref.getLen(), 2);
+    EXPECT_EQ(ref.getData()[0], 0x12);
+    EXPECT_EQ(ref.getData()[1], 0x34);
+
+    // larger values refer to the buffer they were read from
+    string id("dc0dc8ec67e16082483f9e8cd1b135dd");
+    boost::shared_array<uint8_t> buffer(new uint8_t[id.length() + 8]);
+    std::copy(id.begin(), id.end(), buffer.get() + 8);
+    smpp::TLV large(smpp::tags::RECEIPTED_MESSAGE_ID, static_cast<uint16_t>(id.length()), buffer, 8);
+    EXPECT_EQ(large.getData(), buffer.get() + 8);
+    EXPECT_EQ(string(reinterpret_cast<const char*>(large.getData()), large.getLen()), id);
+    EXPECT_EQ(string(reinterpret_cast<const char*>(large.getOctets().get()), large.getLen()), id);
+
+    smpp::TLV small(smpp::tags::RECEIPTED_MESSAGE_ID, 4, buffer, 8);
+    EXPECT_NE(small.getData(), buffer.get() + 8);
+    EXPECT_EQ(string(reinterpret_cast<const char*>(small.getData()), small.getLen()), string("dc0d"));
+
+    // a PDU writes and reads both kinds
+    smpp::PDU pdu(smpp::SUBMIT_SM, 0, 1);
+    pdu << state << smpp::TLV(smpp::tags::RECEIPTED_MESSAGE_ID, id);
+    pdu.resetMarker();
+    smpp::TLV read(0);
+    pdu >> read;
+    EXPECT_EQ(read.getTag(), smpp::tags::MESSAGE_STATE);
+    EXPECT_EQ(read.getData()[0], smpp::STATE_DELIVERED);
+    pdu >> read;
+    EXPECT_EQ(read.getTag(), smpp::tags::RECEIPTED_MESSAGE_ID);
+    EXPECT_EQ(string(reinterpret_cast<const char*>(read.getData()), read.getLen()), id);
+}
+
 int main(int argc, char** argv) {
     google::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
@@ -46,6 +46,16 @@ TEST(TimeTest, absolute) {
     ASSERT_TRUE(!pair3.second.is_not_a_date_time());
 }
 
+TEST(TimeTest, zones) {
+    EXPECT_EQ(smpp::timeformat::getOffsetZone(9), smpp::timeformat::getOffsetZone(9));
+    EXPECT_EQ(smpp::timeformat::getOffsetZone(9)->base_utc_offset(), time_duration(2, 15, 0));
+    EXPECT_EQ(smpp::timeformat::getOffsetZone(-48)->base_utc_offset(), time_duration(-12, 0, 0));
+    EXPECT_EQ(smpp::timeformat::getOffsetZone(0)->base_utc_offset(), time_duration(0, 0, 0));
+    EXPECT_THROW(smpp::timeformat::getOffsetZone(57), smpp::SmppException);
+    EXPECT_EQ(parseSmppTimestamp("111019080000009+").first.zone(), smpp::timeformat::getOffsetZone(9));
+    EXPECT_THROW(parseSmppTimestamp("111019080000049-"), smpp::SmppException);
+}
+
 TEST(TimeTest, relative) {
     DatePair pair1 = parseSmppTimestamp("000002000000000R");
     ASSERT_EQ(pair1.second, time_duration(48, 0, 0));
@@ -70,6 +80,15 @@ TEST(TimeTest, dlr) {
     ASSERT_EQ(pt1, ptime(date(2011, boost::gregorian::Feb, 3), time_duration(13, 37, 0)));
     ptime pt2 = parseDlrTimestamp("110203133755");
     ASSERT_EQ(pt2, ptime(date(2011, boost::gregorian::Feb, 3), time_duration(13, 37, 55)));
+    ASSERT_EQ(parseDlrTimestamp("1602291200"), ptime(date(2016, boost::gregorian::Feb, 29), time_duration(12, 0, 0)));
+    ASSERT_TRUE(parseDlrTimestamp("1502291200").is_not_a_date_time());
+    ASSERT_TRUE(parseDlrTimestamp("1113031337").is_not_a_date_time());
+    ASSERT_TRUE(parseDlrTimestamp("11020313375").is_not_a_date_time());
+    ASSERT_TRUE(parseDlrTimestamp("110203133x").is_not_a_date_time());
+
+    int64_t seconds = 0;
+    ASSERT_TRUE(smpp::timeformat::parseDlrEpoch("140101000001", 12, &seconds));
+    ASSERT_EQ(seconds, 1388534401);
 }
 
 TEST(TimeTest, formatAbsolute) {
@@ -87,6 +106,49 @@ TEST(TimeTest, formatRelative) {
     EXPECT_THROW(getTimeString(time_duration(876143, 34, 29)), smpp::SmppException);  // 876143 would overflow 99 years
 }
 
+TEST(TimeTest, formatBuffer) {
+    char buffer[smpp::timeformat::TIME_STRING_SIZE];
+    ASSERT_EQ(smpp::timeformat::formatTimeString(time_duration(48, 0, 0), buffer), 16u);
+    ASSERT_EQ(string(buffer), string("000002000000000R"));
+    EXPECT_THROW(smpp::timeformat::formatTimeString(time_duration(-1, 0, 0), buffer), smpp::SmppException);
+
+    local_date_time ldt(ptime(date(2011, boost::gregorian::Oct, 19), time_duration(7, 30, 5)),
+                        smpp::timeformat::getOffsetZone(-14));
+    ASSERT_EQ(smpp::timeformat::formatTimeString(ldt, buffer), 16u);
+    ASSERT_EQ(string(buffer), string("111019040005014-"));
+    ASSERT_EQ(parseSmppTimestamp(buffer).first, ldt);
+}
+
+TEST(TimeTest, cache) {
+    smpp::timeformat::TimeStringCache cache(time_duration(48, 0, 0));
+    ASSERT_EQ(string(cache.getRelative()), string("000002000000000R"));
+    time_t now = 1318923000;  // 2011-10-18 07:30:00 UTC
+    ASSERT_EQ(string(cache.getAbsolute(now)), string("111020073000000+"));
+    ASSERT_EQ(string(cache.getAbsolute(now)), string("111020073000000+"));
+    ASSERT_EQ(string(cache.getAbsolute(now + 1)), string("111020073001000+"));
+
+    smpp::timeformat::TimeStringCache local(time_duration(0, 0, 0), smpp::timeformat::getOffsetZone(8));
+    ASSERT_EQ(string(local.getAbsolute(now)), string("111018093000008+"));
+}
+
+TEST(TimeTest, coarseClock) {
+    time_t before = time(0);
+    time_t now = smpp::CoarseClock::now();
+    // the coarse clock may lag the system clock by a tick
+    ASSERT_LE(now, time(0));
+    ASSERT_GE(now, before - 1);
+    ASSERT_LE(smpp::CoarseClock::nowMillis() / 1000 - now, 1);
+    ASSERT_EQ(smpp::CoarseClock::universalTime().date(), boost::posix_time::from_time_t(now).date());
+}
+
+TEST(TimeTest, monotonicClock) {
+    int64_t millis = smpp::MonotonicClock::nowMillis();
+    int64_t micros = smpp::MonotonicClock::nowMicros();
+    ASSERT_LE(millis, micros / 1000);
+    ASSERT_LE(micros / 1000 - millis, 1000);
+    ASSERT_GE(smpp::MonotonicClock::nowMillis(), millis);
+}
+
 int main(int argc, char** argv) {
     google::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2014 OnlineCity
+ * Licensed under the MIT license, which can be read at: http://www.opensource.org/licenses/mit-license.php
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <list>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "smpp/exceptions.h"
+#include "smpp/pdu.h"
+#include "smpp/smpp.h"
+#include "smpp/tagregistry.h"
+#include "smpp/tlv.h"
+#include "smpp/tlvlist.h"
+
+using std::string;
+
+TEST(TlvTest, typedGet) {
+    smpp::TlvList tlvs;
+    tlvs.push_back(smpp::TLV(smpp::tags::SAR_MSG_REF_NUM, static_cast<uint16_t>(0xbeef)));
+    tlvs.push_back(smpp::TLV(smpp::tags::SAR_TOTAL_SEGMENTS, static_cast<uint8_t>(3)));
+    tlvs.push_back(smpp::TLV(smpp::tags::QOS_TIME_TO_LIVE, static_cast<uint32_t>(86400)));
+    tlvs.push_back(smpp::TLV(smpp::tags::RECEIPTED_MESSAGE_ID, string("a1b2c3") + '\0'));
+    tlvs.push_back(smpp::TLV(smpp::tags::ADDITIONAL_STATUS_INFO_TEXT, string("no terminator")));
+
+    EXPECT_EQ(tlvs.size(), size_t(5));
+    EXPECT_EQ(tlvs.get<uint16_t>(smpp::tags::SAR_MSG_REF_NUM), 0xbeef);
+    EXPECT_EQ(tlvs.get<uint8_t>(smpp::tags::SAR_TOTAL_SEGMENTS), 3);
+    EXPECT_EQ(tlvs.get<uint32_t>(smpp::tags::QOS_TIME_TO_LIVE), uint32_t(86400));
+    EXPECT_EQ(tlvs.getString(smpp::tags::RECEIPTED_MESSAGE_ID), string("a1b2c3"));
+    EXPECT_EQ(tlvs.getString(smpp::tags::ADDITIONAL_STATUS_INFO_TEXT), string("no terminator"));
+
+    // missing tags
+    EXPECT_FALSE(tlvs.contains(smpp::tags::MESSAGE_STATE));
+    EXPECT_EQ(tlvs.get<uint8_t>(smpp::tags::MESSAGE_STATE, 42), 42);
+    EXPECT_EQ(tlvs.getString(smpp::tags::CALLBACK_NUM), string());
+
+    // wrong length for the type
+    EXPECT_THROW(tlvs.get<uint32_t>(smpp::tags::SAR_MSG_REF_NUM), smpp::SmppException);
+}
+
+TEST(TlvTest, order) {
+    smpp::TlvList tlvs;
+    tlvs.push_back(smpp::TLV(smpp::tags::SAR_SEGMENT_SEQNUM, static_cast<uint8_t>(1)));
+    tlvs.push_back(smpp::TLV(smpp::tags::SAR_SEGMENT_SEQNUM, static_cast<uint8_t>(2)));
+    tlvs.push_back(smpp::TLV(smpp::tags::MESSAGE_STATE, smpp::STATE_DELIVERED));
+
+    // the first TLV with a tag is found, but all are kept in order
+    EXPECT_EQ(tlvs.get<uint8_t>(smpp::tags::SAR_SEGMENT_SEQNUM), 1);
+    EXPECT_EQ(tlvs[1].getData()[0], 2);
+    EXPECT_EQ(tlvs.back().getTag(), smpp::tags::MESSAGE_STATE);
+
+    tlvs.set(smpp::TLV(smpp::tags::SAR_SEGMENT_SEQNUM, static_cast<uint8_t>(7)));
+    EXPECT_EQ(tlvs.size(), size_t(3));
+    EXPECT_EQ(tlvs.get<uint8_t>(smpp::tags::SAR_SEGMENT_SEQNUM), 7);
+
+    tlvs.pop_back();
+    EXPECT_FALSE(tlvs.contains(smpp::tags::MESSAGE_STATE));
+    tlvs.clear();
+    EXPECT_TRUE(tlvs.empty());
+    EXPECT_FALSE(tlvs.contains(smpp::tags::SAR_SEGMENT_SEQNUM));
+
+    std::list<smpp::TLV> list;
+    list.push_back(smpp::TLV(smpp::tags::USER_MESSAGE_REFERENCE, static_cast<uint16_t>(12)));
+    smpp::TlvList copy(list.begin(), list.end());
+    EXPECT_EQ(copy.get<uint16_t>(smpp::tags::USER_MESSAGE_REFERENCE), 12);
+}
+
+TEST(TlvTest, many) {
+    // more TLVs than the index holds
+    smpp::TlvList tlvs;
+
+    for (uint16_t tag = 0x1400; tag < 0x1440; ++tag) {
+        tlvs.push_back(smpp::TLV(tag, tag));
+    }
+
+    for (uint16_t tag = 0x1400; tag < 0x1440; ++tag) {
+        ASSERT_EQ(tlvs.get<uint16_t>(tag), tag);
+    }
+
+    EXPECT_FALSE(tlvs.contains(0x1440));
+}
+
+TEST(TlvTest, listCompatible) {
+    // code written against std::list<TLV> modifies the TLVs in place
+    smpp::TlvList tlvs;
+    tlvs.push_back(smpp::TLV(smpp::tags::SAR_MSG_REF_NUM, static_cast<uint16_t>(1)));
+    tlvs.push_back(smpp::TLV(smpp::tags::SAR_SEGMENT_SEQNUM, static_cast<uint8_t>(1)));
+
+    for (smpp::TlvList::iterator it = tlvs.begin(); it != tlvs.end(); ++it) {
+        if (it->getTag() == smpp::tags::SAR_SEGMENT_SEQNUM) {
+            *it = smpp::TLV(smpp::tags::MESSAGE_STATE, smpp::STATE_DELIVERED);
+        }
+    }
+
+    // a TLV which changed tag is found under its new tag
+    EXPECT_FALSE(tlvs.contains(smpp::tags::SAR_SEGMENT_SEQNUM));
+    EXPECT_EQ(tlvs.get<uint8_t>(smpp::tags::MESSAGE_STATE), smpp::STATE_DELIVERED);
+    tlvs.back() = smpp::TLV(smpp::tags::SAR_TOTAL_SEGMENTS, static_cast<uint8_t>(3));
+    EXPECT_EQ(tlvs.get<uint8_t>(smpp::tags::SAR_TOTAL_SEGMENTS), 3);
+    tlvs.push_back(smpp::TLV(smpp::tags::USER_MESSAGE_REFERENCE, static_cast<uint16_t>(12)));
+    EXPECT_EQ(tlvs.get<uint16_t>(smpp::tags::USER_MESSAGE_REFERENCE), 12);
+
+    smpp::TlvList::iterator it = tlvs.insert(tlvs.begin(), smpp::TLV(smpp::tags::QOS_TIME_TO_LIVE,
+                                             static_cast<uint32_t>(60)));
+    EXPECT_EQ(it->getTag(), smpp::tags::QOS_TIME_TO_LIVE);
+    EXPECT_EQ(tlvs.size(), size_t(4));
+    it = tlvs.erase(tlvs.begin() + 1);
+    EXPECT_EQ(it->getTag(), smpp::tags::SAR_TOTAL_SEGMENTS);
+    EXPECT_FALSE(tlvs.contains(smpp::tags::SAR_MSG_REF_NUM));
+    EXPECT_EQ(tlvs.get<uint32_t>(smpp::tags::QOS_TIME_TO_LIVE), uint32_t(60));
+
+    tlvs.clear();
+    tlvs.push_back(smpp::TLV(smpp::tags::SAR_MSG_REF_NUM, static_cast<uint16_t>(2)));
+    EXPECT_EQ(tlvs.get<uint16_t>(smpp::tags::SAR_MSG_REF_NUM), 2);
+}
+
+namespace smpp {
+SMPP_DEFINE_TAG(0x1501, TLV_INT16, 2, 2)
+}  // namespace smpp
+
+TEST(TlvTest, registry) {
+    const smpp::TagInfo* info = smpp::findTagInfo(smpp::tags::RECEIPTED_MESSAGE_ID);
+    ASSERT_TRUE(info != 0);
+    EXPECT_EQ(info->type, smpp::TLV_CSTRING);
+    EXPECT_EQ(info->maxLength, 65);
+    EXPECT_EQ(string(info->name), string("RECEIPTED_MESSAGE_ID"));
+    EXPECT_TRUE(smpp::findTagInfo(smpp::tags::ITS_SESSION_INFO) != 0);
+    EXPECT_TRUE(smpp::findTagInfo(0x0001) == 0);
+
+    // typed access through the compile time traits
+    smpp::TlvList tlvs;
+    tlvs.set<smpp::tags::SAR_MSG_REF_NUM>(0x1234);
+    tlvs.set<smpp::tags::RECEIPTED_MESSAGE_ID>("a1b2c3");
+    tlvs.set<smpp::tags::ALERT_ON_MESSAGE_DELIVERY>(true);
+    tlvs.set<0x1501>(99);
+    EXPECT_EQ(tlvs.get<smpp::tags::SAR_MSG_REF_NUM>(), 0x1234);
+    EXPECT_EQ(tlvs.find(smpp::tags::RECEIPTED_MESSAGE_ID)->getLen(), 7);
+    EXPECT_EQ(tlvs.get<smpp::tags::RECEIPTED_MESSAGE_ID>(), string("a1b2c3"));
+    EXPECT_TRUE(tlvs.get<smpp::tags::ALERT_ON_MESSAGE_DELIVERY>());
+    EXPECT_FALSE(tlvs.get<smpp::tags::MORE_MESSAGES_TO_SEND>());
+    EXPECT_EQ(tlvs.get<0x1501>(), 99);
+
+    tlvs.set(smpp::TLV(smpp::tags::MESSAGE_STATE, static_cast<uint16_t>(2)));
+    EXPECT_THROW(tlvs.get<smpp::tags::MESSAGE_STATE>(), smpp::SmppException);
+
+    // vendor specific tags
+    smpp::TagInfo vendor = { 0x1400, smpp::TLV_INT32, 4, 4, "VENDOR_COST" };
+    smpp::registerVendorTag(vendor);
+    info = smpp::findTagInfo(0x1400);
+    ASSERT_TRUE(info != 0);
+    EXPECT_EQ(info->type, smpp::TLV_INT32);
+    smpp::TagInfo standard = { smpp::tags::MESSAGE_STATE, smpp::TLV_INT16, 2, 2, "MESSAGE_STATE" };
+    EXPECT_THROW(smpp::registerVendorTag(standard), smpp::SmppException);
+
+    EXPECT_NO_THROW(smpp::validateTlv(smpp::tags::MESSAGE_STATE, 1));
+    EXPECT_THROW(smpp::validateTlv(smpp::tags::MESSAGE_STATE, 2), smpp::SmppException);
+    EXPECT_THROW(smpp::validateTlv(smpp::tags::NETWORK_ERROR_CODE, 2), smpp::SmppException);
+    EXPECT_THROW(smpp::validateTlv(0x1400, 2), smpp::SmppException);
+    EXPECT_NO_THROW(smpp::validateTlv(0x1402, 2));
+}
+
+TEST(TlvTest, decoderValidation) {
+    smpp::PDU pdu(smpp::DELIVER_SM, 0, 1);
+    pdu << smpp::TLV(smpp::tags::MESSAGE_STATE, static_cast<uint32_t>(2));
+    pdu.resetMarker();
+    smpp::TLV tlv(0);
+    EXPECT_THROW(pdu >> tlv, smpp::SmppException);
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}